@@ -0,0 +1,173 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "archive.hpp"
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+#define ZIP_EOCD_SIGNATURE 0x06054b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ARCHIVE_MAX_ENTRY_SIZE ((size_t)512 * 1024 * 1024) // Largest page an entry may inflate to
+#define ARCHIVE_MAX_DEFLATE_RATIO 1032 // Deflate can't compress better than this, larger sizes are lies
+
+namespace chopfox {
+    static uint16_t read_u16 (const unsigned char* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    static uint32_t read_u32 (const unsigned char* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    struct Archive* archive_open (const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return NULL;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < 22) {
+            close(fd);
+            return NULL;
+        }
+
+        void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file open
+
+        if (mapped == MAP_FAILED) return NULL;
+
+        struct Archive* archive = new struct Archive;
+        archive->data = (const unsigned char*)mapped;
+        archive->length = info.st_size;
+
+        // The end of central directory record is at the end of the file, followed by a comment of up to 64K
+        const unsigned char* eocd = NULL;
+        size_t search_end = archive->length > 22 + 0xFFFF ? archive->length - 22 - 0xFFFF : 0;
+        for (size_t i = archive->length - 22; ; i--) {
+            if (read_u32(archive->data + i) == ZIP_EOCD_SIGNATURE) {
+                eocd = archive->data + i;
+                break;
+            }
+            if (i == search_end) break;
+        }
+
+        if (!eocd) {
+            archive_close(archive);
+            return NULL;
+        }
+
+        uint16_t count = read_u16(eocd + 10);
+        size_t offset = read_u32(eocd + 16); // size_t so the bounds checks can't wrap
+
+        for (uint16_t i = 0; i < count; i++) {
+            if (offset + 46 > archive->length || read_u32(archive->data + offset) != ZIP_CENTRAL_SIGNATURE) break;
+
+            const unsigned char* header = archive->data + offset;
+            uint16_t flags = read_u16(header + 8);
+            uint16_t name_length = read_u16(header + 28);
+            uint16_t extra_length = read_u16(header + 30);
+            uint16_t comment_length = read_u16(header + 32);
+
+            if (offset + 46 + name_length > archive->length) break;
+
+            struct ArchiveEntry entry;
+            entry.name = std::string((const char*)header + 46, name_length);
+            entry.method = read_u16(header + 10);
+            entry.compressed_size = read_u32(header + 20);
+            entry.size = read_u32(header + 24);
+            entry.header_offset = read_u32(header + 42);
+
+            offset += 46 + name_length + extra_length + comment_length;
+
+            // Skip directories and encrypted files
+            if (entry.name.empty() || entry.name.back() == '/' || (flags & 1)) continue;
+
+            archive->entries.push_back(entry);
+        }
+
+        return archive;
+    }
+
+    /**
+     * Find the compressed data of an entry behind its local header
+     */
+    static const unsigned char* archive_entry_data (struct Archive* archive, const struct ArchiveEntry& entry) {
+        size_t offset = entry.header_offset;
+        if (offset + 30 > archive->length || read_u32(archive->data + offset) != ZIP_LOCAL_SIGNATURE) return NULL;
+
+        // The local header has its own name & extra lengths which may differ from the central directory
+        offset += 30 + read_u16(archive->data + offset + 26) + read_u16(archive->data + offset + 28);
+        if (offset + entry.compressed_size > archive->length) return NULL;
+
+        return archive->data + offset;
+    }
+
+    bool archive_view (struct Archive* archive, size_t index, const unsigned char** data, size_t* size) {
+        if (index >= archive->entries.size()) return false;
+
+        struct ArchiveEntry& entry = archive->entries[index];
+        if (entry.method != 0 || entry.compressed_size != entry.size) return false;
+
+        *data = archive_entry_data(archive, entry);
+        *size = entry.size;
+        return *data != NULL;
+    }
+
+    bool archive_read (struct Archive* archive, size_t index, std::vector<unsigned char>& out) {
+        if (index >= archive->entries.size()) return false;
+
+        struct ArchiveEntry& entry = archive->entries[index];
+
+        const unsigned char* data = archive_entry_data(archive, entry);
+        if (!data) return false;
+
+        // The sizes come from the central directory, don't let a tiny archive make us allocate gigabytes
+        if (entry.size > ARCHIVE_MAX_ENTRY_SIZE || entry.size > (size_t)entry.compressed_size * ARCHIVE_MAX_DEFLATE_RATIO + 1024) return false;
+
+        out.resize(entry.size);
+
+        if (entry.method == 0) {
+            if (entry.compressed_size != entry.size) return false;
+            std::copy(data, data + entry.size, out.begin());
+            return true;
+        }
+
+        if (entry.method != 8) return false;
+
+        z_stream stream = {};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return false; // raw deflate, no zlib header
+
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = entry.compressed_size;
+        stream.next_out = out.data();
+        stream.avail_out = entry.size;
+
+        int status = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+
+        return status == Z_STREAM_END && stream.total_out == entry.size;
+    }
+
+    void archive_close (struct Archive* archive) {
+        if (!archive) return;
+        munmap((void*)archive->data, archive->length);
+        delete archive;
+    }
+}
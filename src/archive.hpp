@@ -0,0 +1,78 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace chopfox {
+    struct ArchiveEntry {
+        std::string name;
+        uint16_t method; // 0 for stored, 8 for deflate
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t header_offset;
+    };
+
+    /**
+     * A memory mapped zip archive (CBZ)
+     */
+    struct Archive {
+        const unsigned char* data;
+        size_t length;
+        std::vector<struct ArchiveEntry> entries;
+    };
+
+    /**
+     * Open a zip archive and read the list of files in it
+     * @param path The path to the archive
+     * @returns The archive or NULL if it could not be read
+     * @remarks Only stored and deflated files are supported, ZIP64 archives are not. Free the archive with archive_close
+     */
+    struct Archive* archive_open (const char* path);
+
+    /**
+     * Read and decompress a file from the archive
+     * @param archive The archive to read from
+     * @param index Index of the file in archive->entries
+     * @param out The contents of the file
+     * @returns false if the file could not be read
+     * @remarks Safe to call from several threads at once
+     */
+    bool archive_read (struct Archive* archive, size_t index, std::vector<unsigned char>& out);
+
+    /**
+     * Get the contents of a stored (uncompressed) file straight from the mapping, without copying it
+     * @param archive The archive to read from
+     * @param index Index of the file in archive->entries
+     * @param data Set to the contents of the file, valid until the archive is closed
+     * @param size Set to the size of the file
+     * @returns false if the file is compressed (use archive_read) or could not be read
+     */
+    bool archive_view (struct Archive* archive, size_t index, const unsigned char** data, size_t* size);
+
+    /**
+     * Unmap and free the archive
+     * @param archive The archive to close
+     */
+    void archive_close (struct Archive* archive);
+}
+
+#endif
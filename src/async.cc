@@ -0,0 +1,237 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "async.hpp"
+#include <stdio.h>
+
+namespace chopfox {
+    static void executor_push (struct SimpleExecutor* executor, std::function<void()> task, bool urgent) {
+        {
+            std::lock_guard<std::mutex> guard(executor->lock);
+            if (urgent) executor->tasks.push_front(task);
+            else executor->tasks.push_back(task);
+        }
+        executor->wake.notify_one();
+    }
+
+    static void executor_run (struct SimpleExecutor* executor) {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> guard(executor->lock);
+                while (executor->tasks.empty() && !executor->stopping) executor->wake.wait(guard);
+                if (executor->tasks.empty()) return;
+                task = executor->tasks.front();
+                executor->tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    struct SimpleExecutor* simple_executor_init (struct SimpleProcessor* proc, int threads) {
+        struct SimpleExecutor* executor = new struct SimpleExecutor;
+
+        executor->proc = proc;
+        executor->stopping = false;
+
+        if (threads < 1) threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+        for (int i = 0; i < threads; i++) executor->threads.push_back(std::thread(executor_run, executor));
+
+        if (proc->log_level >= 1) printf("[Chopfox] Started executor with %d threads\n", threads);
+
+        return executor;
+    }
+
+    void simple_executor_free (struct SimpleExecutor* executor) {
+        {
+            std::lock_guard<std::mutex> guard(executor->lock);
+            executor->stopping = true;
+        }
+        executor->wake.notify_all();
+
+        for (auto &thread : executor->threads) thread.join();
+
+        delete executor;
+    }
+
+    static void async_emit (struct SimpleAsyncPage* page, int index) {
+        static const std::vector<struct PageText> no_text;
+
+        if (!page->on_panel) return;
+
+        std::lock_guard<std::mutex> guard(page->callback_lock);
+        if (page->error) return;
+
+        // The callback runs on an executor thread, what it throws fails the page instead of the process
+        try {
+            page->on_panel(index, page->data.panels[index], page->include_text ? page->data.dialogue[index] : no_text);
+        } catch (...) {
+            page->error = std::current_exception();
+            page->cancelled = true;
+        }
+    }
+
+    /**
+     * Make the done future ready, the page may be freed by a waiting thread as soon as this returns
+     */
+    static void async_resolve (struct SimpleAsyncPage* page, bool complete, std::exception_ptr error = NULL) {
+        if (page->resolved.exchange(true)) return;
+
+        std::shared_future<bool> done = page->done; // keeps the shared state alive while the waiters are woken
+
+        if (error) page->promise.set_exception(error);
+        else page->promise.set_value(complete);
+    }
+
+    static void async_finish (struct SimpleAsyncPage* page) {
+        bool complete = !page->cancelled && !page->error;
+        if (complete) {
+            try {
+                simple_cache_store(page->executor->proc, page->cache_key, &page->data, page->include_text);
+            } catch (...) {
+                page->error = std::current_exception();
+                complete = false;
+            }
+        }
+
+        async_resolve(page, complete, page->error);
+    }
+
+    /**
+     * Transcribe one batch of a page, the last batch to finish completes the page
+     */
+    static void async_text_batch (struct SimpleAsyncPage* page, int b) {
+        struct SimpleProcessor* proc = page->executor->proc;
+
+        if (!page->cancelled) {
+            try {
+                EnginePoolLease<struct Workspace> ws(proc->workspace_pool);
+                simple_process_text_batch(proc, &page->data, 0, page->batches[b], ws.item);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(page->callback_lock);
+                if (!page->error) page->error = std::current_exception();
+                page->cancelled = true;
+            }
+
+            if (!page->cancelled) {
+                for (auto &i : page->batches[b]) async_emit(page, i);
+            }
+        }
+
+        if (--page->pending == 0) async_finish(page);
+    }
+
+    /**
+     * Find & chop the panels of a page, then queue its text batches
+     */
+    static void async_start (struct SimpleAsyncPage* page) {
+        struct SimpleExecutor* executor = page->executor;
+        struct SimpleProcessor* proc = executor->proc;
+
+        if (page->cancelled) {
+            async_resolve(page, false);
+            return;
+        }
+
+        try {
+            bool cached = simple_cache_lookup(proc, page->img, &page->data, page->include_text, &page->cache_key);
+
+            if (!cached) {
+                simple_process_panels(proc, page->img, &page->data);
+                simple_process_chop(proc, page->img, &page->data);
+            }
+
+            int count = page->data.panels.size();
+
+            if (cached || !page->include_text || count == 0) {
+                if (page->include_text) page->data.dialogue.resize(count);
+                for (int i = 0; i < count; i++) async_emit(page, i);
+                if (cached) async_resolve(page, !page->error, page->error);
+                else async_finish(page);
+                return;
+            }
+
+            page->data.dialogue.resize(count);
+            page->batches = simple_text_batches(proc, &page->data, proc->text_batch_size);
+        } catch (...) {
+            async_resolve(page, false, std::current_exception());
+            return;
+        }
+
+        // Panels skipped by the text prefilter are already complete
+        std::vector<bool> batched(page->data.panels.size(), false);
+        for (auto &batch : page->batches) {
+            for (auto &i : batch) batched[i] = true;
+        }
+        for (int i = 0; i < batched.size(); i++) {
+            if (!batched[i]) async_emit(page, i);
+        }
+
+        if (page->batches.empty()) {
+            async_finish(page);
+            return;
+        }
+
+        page->pending = page->batches.size();
+
+        for (int b = 0; b < page->batches.size(); b++) {
+            executor_push(executor, [page, b] () { async_text_batch(page, b); }, true);
+        }
+    }
+
+    struct SimpleAsyncPage* simple_process_async (
+        struct SimpleExecutor* executor,
+        cv::Mat img,
+        bool include_text,
+        SimplePanelCallback on_panel
+    ) {
+        assert(!include_text || executor->proc->ocr_pool);
+
+        struct SimpleAsyncPage* page = new struct SimpleAsyncPage;
+
+        page->executor = executor;
+        page->img = img;
+        page->include_text = include_text;
+        page->on_panel = on_panel;
+        page->cache_key = 0;
+        page->cancelled = false;
+        page->pending = 0;
+        page->resolved = false;
+        page->done = page->promise.get_future().share();
+
+        executor_push(executor, [page] () { async_start(page); }, false);
+
+        return page;
+    }
+
+    void simple_async_cancel (struct SimpleAsyncPage* page) {
+        page->cancelled = true;
+    }
+
+    bool simple_async_wait (struct SimpleAsyncPage* page) {
+        return page->done.get();
+    }
+
+    void simple_async_free (struct SimpleAsyncPage* page) {
+        page->done.wait();
+
+        simple_data_free(page->data);
+
+        delete page;
+    }
+}
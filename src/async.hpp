@@ -0,0 +1,121 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "simple.hpp"
+#include <deque>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+namespace chopfox {
+    /**
+     * Called with the text of a panel as soon as it is transcribed (panels may finish out of order)
+     * Callbacks of a page are never run concurrently, but they run on the executor threads and should return quickly.
+     */
+    typedef std::function<void (int index, const struct PanelInfo& panel, const std::vector<struct PageText>& text)> SimplePanelCallback;
+
+    /**
+     * Fixed set of threads running the stages of many pages at once
+     * Text batches of pages that are already started run before new pages, so pages finish in about the order they were submitted.
+     */
+    struct SimpleExecutor {
+        struct SimpleProcessor* proc;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> threads;
+        bool stopping;
+    };
+
+    /**
+     * A page submitted with simple_process_async
+     */
+    struct SimpleAsyncPage {
+        struct SimpleExecutor* executor;
+        cv::Mat img;
+        bool include_text;
+        SimplePanelCallback on_panel;
+        struct SimplePageData data; // Only complete once done is ready
+        uint64_t cache_key;
+        std::vector<std::vector<int>> batches;
+        std::atomic<bool> cancelled;
+        std::atomic<int> pending; // Text batches not finished yet
+        std::mutex callback_lock;
+        std::exception_ptr error; // First exception thrown by a stage
+        std::promise<bool> promise;
+        std::atomic<bool> resolved; // The promise is only set once
+        std::shared_future<bool> done; // true once the page is processed, false if it was cancelled
+    };
+
+    /**
+     * Start the executor threads
+     * @param proc The processor to use, must outlive the executor
+     * @param threads The amount of threads (0 for the amount of cores)
+     * @returns The executor
+     * @remarks Free the executor with simple_executor_free
+     */
+    struct SimpleExecutor* simple_executor_init (struct SimpleProcessor* proc, int threads = 0);
+
+    /**
+     * Finish the queued work and stop the executor threads
+     * @param executor The executor to free
+     * @remarks The pages still have to be freed with simple_async_free
+     */
+    void simple_executor_free (struct SimpleExecutor* executor);
+
+    /**
+     * Queue a page, returning immediately
+     * @param executor The executor to run the page on
+     * @param img The input image, kept referenced until the page is freed
+     * @param include_text Extract the text as well as the panels
+     * @param on_panel Called for every panel once its text is extracted (optional), an exception it throws fails the page and stops the callbacks
+     * @returns The page, its done future is ready once data is complete
+     * @remarks Free the page with simple_async_free
+     */
+    struct SimpleAsyncPage* simple_process_async (
+        struct SimpleExecutor* executor,
+        cv::Mat img,
+        bool include_text = true,
+        SimplePanelCallback on_panel = NULL
+    );
+
+    /**
+     * Skip the stages of a page that haven't started yet, the done future is then ready with false
+     * @param page The page to cancel
+     */
+    void simple_async_cancel (struct SimpleAsyncPage* page);
+
+    /**
+     * Wait for a page to finish
+     * @param page The page to wait for
+     * @returns false if the page was cancelled
+     * @remarks Rethrows the exception a stage failed with
+     */
+    bool simple_async_wait (struct SimpleAsyncPage* page);
+
+    /**
+     * Wait for the stages of a page to stop and free it with its results
+     * @param page The page to free
+     */
+    void simple_async_free (struct SimpleAsyncPage* page);
+}
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "batch.hpp"
+#include "archive.hpp"
+#include "queue.hpp"
+#include "decode.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <stdio.h>
+
+namespace chopfox {
+    struct BatchSource {
+        std::vector<std::string> names; // Used to name the output files
+        std::vector<std::string> paths;
+        struct Archive* archive;
+    };
+
+    struct BatchPage {
+        size_t index;
+        std::string name;
+        cv::Mat img;
+        cv::Size full_size; // Size of the page at full resolution, the image may be decoded at a reduced one
+        struct SimplePageData data;
+    };
+
+    static std::string lowercase_extension (const std::string& name) {
+        std::string ext = std::filesystem::path(name).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext;
+    }
+
+    static bool is_image_name (const std::string& name) {
+        static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".webp", ".bmp", ".tif", ".tiff", ".jp2", ".pbm", ".pgm", ".ppm" };
+        std::string ext = lowercase_extension(name);
+        for (auto &i : extensions) {
+            if (ext == i) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Name of the page without the extension, directories in archives are joined with an underscore
+     */
+    static std::string page_name (const std::string& path, bool keep_directories) {
+        std::filesystem::path p(path);
+        std::string name = keep_directories ? (p.parent_path() / p.stem()).string() : p.stem().string();
+        std::replace(name.begin(), name.end(), '/', '_');
+        return name;
+    }
+
+    static bool batch_source_open (const char* input, struct BatchSource* src) {
+        src->archive = NULL;
+
+        std::error_code err;
+        std::string ext = lowercase_extension(input);
+
+        if (std::filesystem::is_directory(input, err)) {
+            for (auto &entry : std::filesystem::directory_iterator(input, err)) {
+                if (entry.is_regular_file() && is_image_name(entry.path().string())) 
+                    src->paths.push_back(entry.path().string());
+            }
+            std::sort(src->paths.begin(), src->paths.end());
+            for (auto &path : src->paths) src->names.push_back(page_name(path, false));
+        } else if (ext == ".cbz" || ext == ".zip") {
+            src->archive = archive_open(input);
+            if (!src->archive) return false;
+            // Pages are read by index into the entries, so filter and sort them in place
+            std::vector<struct ArchiveEntry>& entries = src->archive->entries;
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [] (const struct ArchiveEntry& entry) { return !is_image_name(entry.name); }), entries.end());
+            std::sort(entries.begin(), entries.end(), [] (const struct ArchiveEntry& a, const struct ArchiveEntry& b) { return a.name < b.name; });
+            for (auto &entry : entries) src->names.push_back(page_name(entry.name, true));
+        } else {
+            std::ifstream list(input);
+            if (!list.is_open()) return false;
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty() || line[0] == '#') continue;
+                src->paths.push_back(line);
+                src->names.push_back(page_name(line, false));
+            }
+        }
+
+        return true;
+    }
+
+    static cv::Mat batch_source_decode (struct BatchSource* src, size_t index, enum DecodeMode mode, int reduce, cv::Size* full_size) {
+        if (!src->archive) return decode_image_file(src->paths[index].c_str(), mode, reduce, full_size);
+
+        // Stored pages (most CBZ files) are decoded straight from the mapped archive
+        const unsigned char* data;
+        size_t size;
+        if (archive_view(src->archive, index, &data, &size)) return decode_image(data, size, mode, reduce, full_size);
+
+        std::vector<unsigned char> bytes;
+        if (!archive_read(src->archive, index, bytes)) return cv::Mat();
+        return decode_image(bytes.data(), bytes.size(), mode, reduce, full_size);
+    }
+
+    int batch_process (struct SimpleProcessor* proc, const char* input, struct BatchOptions* options) {
+        struct BatchSource src;
+
+        if (!batch_source_open(input, &src)) {
+            printf("[Chopfox] Could not read batch input %s\n", input);
+            return -1;
+        }
+
+        size_t page_count = src.names.size();
+        if (proc->log_level >= 1) printf("[Chopfox] Processing %d pages\n", (int)page_count);
+
+        std::filesystem::create_directories(options->output_dir);
+
+        int decode_threads = std::max(1, options->decode_threads);
+        int process_threads = std::max(1, options->process_threads);
+        int write_threads = std::max(1, options->write_threads);
+
+        // Pages are the unit of parallelism here, so every page runs its text stage on a single worker
+        int text_workers = proc->text_workers;
+        if (options->include_text) simple_processor_set_workers(proc, process_threads);
+        proc->text_workers = 1;
+
+        // Streamed formats keep every page in one file, appended in the order the pages finish
+        struct InfoWriter* stream = NULL;
+        if (options->info_format != INFO_FORMAT_XML) {
+            std::string path = (std::filesystem::path(options->output_dir) / "pages.").string() + info_format_extension(options->info_format);
+            stream = info_writer_open(path.c_str(), options->info_format);
+            if (!stream) {
+                printf("[Chopfox] Could not create %s\n", path.c_str());
+                archive_close(src.archive);
+                proc->text_workers = text_workers;
+                return -1;
+            }
+        }
+
+        struct BoundedQueue<struct BatchPage*>* decoded = bounded_queue_init<struct BatchPage*>(options->queue_size);
+        struct BoundedQueue<struct BatchPage*>* processed = bounded_queue_init<struct BatchPage*>(options->queue_size);
+
+        std::atomic<size_t> next_page(0);
+        std::atomic<int> decoders_running(decode_threads);
+        std::atomic<int> processors_running(process_threads);
+        std::atomic<int> failed(0);
+        std::atomic<int> done(0);
+
+        int64_t start = cv::getTickCount();
+
+        // Only the panel geometry is written without text & chops, a reduced grayscale image is enough for it
+        bool geometry_only = !options->include_text && !options->write_chops && options->decode_reduce > 1;
+        enum DecodeMode decode_mode = geometry_only ? DECODE_GRAY : DECODE_UNCHANGED; // EAST & OCR convert to BGR, the chops keep the alpha channel
+        int decode_reduce = geometry_only ? options->decode_reduce : 1;
+
+        // Decoders take the next page that hasn't been claimed yet
+        auto decoder = [&] () {
+            for (size_t i = next_page++; i < page_count; i = next_page++) {
+                cv::Size full_size;
+                cv::Mat img = batch_source_decode(&src, i, decode_mode, decode_reduce, &full_size);
+                if (img.empty()) {
+                    printf("[Chopfox] Could not decode page %s\n", src.names[i].c_str());
+                    failed++;
+                    continue;
+                }
+                struct BatchPage* page = new struct BatchPage;
+                page->index = i;
+                page->name = src.names[i];
+                page->img = img;
+                page->full_size = full_size;
+                bounded_queue_push(decoded, page);
+            }
+            if (--decoders_running == 0) bounded_queue_close(decoded);
+        };
+
+        auto processor = [&] () {
+            struct BatchPage* page;
+            while (bounded_queue_pop(decoded, page)) {
+                // A page that can't be processed (a cv::Exception from a bad scan, out of memory) only fails that page
+                try {
+                    simple_process_page(proc, page->img, &page->data, options->include_text);
+                    simple_data_rescale(&page->data, page->img.size(), page->full_size);
+                } catch (const std::exception& e) {
+                    printf("[Chopfox] Could not process page %s: %s\n", page->name.c_str(), e.what());
+                    failed++;
+                    delete page;
+                    continue;
+                }
+                page->img.release();
+                bounded_queue_push(processed, page);
+            }
+            if (--processors_running == 0) bounded_queue_close(processed);
+        };
+
+        auto writer = [&] () {
+            struct BatchPage* page;
+            while (bounded_queue_pop(processed, page)) {
+                std::string base = (std::filesystem::path(options->output_dir) / page->name).string();
+                if (stream) {
+                    simple_write_info(stream, page->name.c_str(), page->data, options->include_text);
+                } else {
+                    struct InfoWriter* xml = info_writer_open((base + ".xml").c_str(), INFO_FORMAT_XML);
+                    if (xml) {
+                        simple_write_info(xml, page->name.c_str(), page->data, options->include_text);
+                        if (!info_writer_close(xml)) printf("[Chopfox] Could not write %s.xml\n", base.c_str());
+                    }
+                }
+                if (options->write_chops) {
+                    for (int i = 0; i < simple_frame_count(page->data); i++) {
+                        cv::imwrite(base + "_" + std::to_string(i) + ".png", simple_frame(page->data, i));
+                    }
+                }
+                simple_data_free(page->data);
+                delete page;
+                int count = ++done;
+                if (proc->log_level >= 1) printf("[Chopfox] Finished page %d/%d\n", count, (int)page_count);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < decode_threads; i++) threads.push_back(std::thread(decoder));
+        for (int i = 0; i < process_threads; i++) threads.push_back(std::thread(processor));
+        for (int i = 0; i < write_threads; i++) threads.push_back(std::thread(writer));
+        for (auto &thread : threads) thread.join();
+
+        double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+        printf("[Chopfox] Processed %d pages (%d failed) in %.2fs, %.2f pages/sec\n", (int)done, (int)failed, seconds, seconds > 0 ? done / seconds : 0.0);
+
+        if (proc->log_level >= 1) {
+            size_t reused, allocated, retained;
+            simple_workspace_stats(proc, &reused, &allocated, &retained);
+            printf("[Chopfox] Workspaces reused %d buffers, allocated %d, retaining %.1fMB\n", (int)reused, (int)allocated, retained / (1024.0 * 1024.0));
+        }
+
+        if (stream && !info_writer_close(stream)) printf("[Chopfox] Could not write the page info\n");
+
+        bounded_queue_free(decoded);
+        bounded_queue_free(processed);
+        archive_close(src.archive);
+
+        proc->text_workers = text_workers;
+
+        return failed;
+    }
+}
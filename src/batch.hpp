@@ -0,0 +1,47 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "simple.hpp"
+
+namespace chopfox {
+    struct BatchOptions {
+        const char* output_dir;
+        int decode_threads;
+        int process_threads;
+        int write_threads;
+        int queue_size; // Max pages waiting between two stages
+        bool include_text;
+        bool write_chops;
+        enum InfoFormat info_format; // XML writes a file per page, the other formats a single pages.<ext> stream
+        int decode_reduce; // Decode at 1/2, 1/4 or 1/8 of the resolution when only the panel geometry is written (1 disables)
+    };
+
+    /**
+     * Process many pages, overlapping decoding, panel & text extraction and writing the results
+     * Writes <output_dir>/<page>.xml for every page (or <output_dir>/pages.jsonl|cfxi) and <output_dir>/<page>_<panel>.png when write_chops is set
+     * @param proc The processor to use, shared by all the workers
+     * @param input A directory of images, a text file listing one image path per line or a CBZ/zip archive
+     * @param options The pipeline options
+     * @returns The amount of pages that could not be processed or -1 if the input could not be read
+     */
+    int batch_process (struct SimpleProcessor* proc, const char* input, struct BatchOptions* options);
+}
+
+#endif
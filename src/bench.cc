@@ -0,0 +1,979 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "simple.hpp"
+#include "incremental.hpp"
+#include "strip.hpp"
+#include "decode.hpp"
+#include "cli.hpp"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <new>
+
+using namespace chopfox;
+
+static std::atomic<size_t> bench_allocations(0); // operator new calls, OpenCV buffers use their own allocator and aren't counted
+
+void* operator new (size_t size) {
+    bench_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete (void* p) noexcept {
+    free(p);
+}
+
+void operator delete (void* p, size_t size) noexcept {
+    free(p);
+}
+
+static const char* BENCH_WORDS[] = {
+    "THE", "WHAT", "ARE", "YOU", "DOING", "HERE", "WAIT", "FOR", "ME", "I", "CAN'T", "BELIEVE", "IT",
+    "LOOK", "OUT", "BEHIND", "THAT", "WAS", "CLOSE", "COME", "ON", "WE", "HAVE", "TO", "GO", "NOW",
+    "NEVER", "AGAIN", "WHY", "NOT", "THIS", "IS", "FINE", "HEY", "STOP", "RIGHT", "THERE", "OKAY"
+};
+
+struct BenchOptions {
+    int pages;
+    int width;
+    int height;
+    int rows; // Panel rows on a page
+    int cols; // Panels per row
+    int gutter; // Space between panels in pixels
+    double text_density; // Average speech bubbles per panel
+    uint64_t seed;
+    int panel_downscale; // Also time get_panels_coarse with this factor (<= 1 to skip)
+    int batch; // Max panels per EAST forward pass
+    struct TextInputLimits limits; // Also time EAST with the input size capped by these limits
+    struct TextPrefilter prefilter; // Text presence check compared against the full EAST path
+    enum TextPrecision precision; // Also run EAST at this precision and compare its boxes with FP32
+    int calibration; // Pages generated to quantize the INT8 model, apart from the measured pages
+    int decode_reduce; // Also find the panels on pages decoded at 1/n of the resolution
+    int threads; // Time the text stage with 1 up to this many workers (0 skips the sweep)
+    const char* model; // EAST model (NULL skips the text stages)
+    const char* lang;
+    const char* output; // JSON output file (NULL for stdout)
+};
+
+struct BenchStage {
+    std::vector<double> ms; // Duration of every sample
+    size_t items; // Pages, panels or batches processed, used for the throughput
+};
+
+/**
+ * Time a stage and add the sample to it
+ */
+template <typename F>
+static void bench_time (std::map<std::string, struct BenchStage>& stages, const char* name, size_t items, F fn) {
+    int64_t start = cv::getTickCount();
+    fn();
+    double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+    struct BenchStage& stage = stages[name];
+    stage.ms.push_back(ms);
+    stage.items += items;
+}
+
+/**
+ * Split length into count parts separated (and surrounded) by gutter, each part jittered by up to 15%
+ */
+static std::vector<std::pair<int, int>> bench_split (int length, int count, int gutter, cv::RNG& rng) {
+    std::vector<double> weights;
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        weights.push_back(rng.uniform(0.85, 1.15));
+        total += weights.back();
+    }
+
+    std::vector<std::pair<int, int>> parts;
+    int available = length - (count + 1) * gutter;
+    double pos = gutter;
+    for (int i = 0; i < count; i++) {
+        double size = available * weights[i] / total;
+        parts.push_back(std::make_pair((int)pos, (int)size));
+        pos += size + gutter;
+    }
+    return parts;
+}
+
+/**
+ * Draw a speech bubble with a few lines of random words somewhere inside the panel
+ */
+static void bench_draw_bubble (cv::Mat page, cv::Rect panel, cv::RNG& rng) {
+    double font_scale = std::max(0.4, panel.width / 600.0);
+    int thickness = std::max(1, (int)(font_scale * 2));
+    int line_height = (int)(30 * font_scale);
+
+    std::vector<std::string> lines;
+    int lines_count = rng.uniform(1, 4);
+    int max_width = 0;
+    for (int i = 0; i < lines_count; i++) {
+        std::string line;
+        int words = rng.uniform(1, 5);
+        for (int w = 0; w < words; w++) {
+            if (w > 0) line += " ";
+            line += BENCH_WORDS[rng.uniform(0, (int)(sizeof(BENCH_WORDS) / sizeof(BENCH_WORDS[0])))];
+        }
+        int baseline;
+        max_width = std::max(max_width, cv::getTextSize(line, cv::FONT_HERSHEY_SIMPLEX, font_scale, thickness, &baseline).width);
+        lines.push_back(line);
+    }
+
+    cv::Size axes(max_width / 2 + line_height, lines_count * line_height / 2 + line_height);
+    if (axes.width * 2 >= panel.width || axes.height * 2 >= panel.height) return;
+
+    cv::Point center(
+        rng.uniform(panel.x + axes.width, panel.x + panel.width - axes.width + 1),
+        rng.uniform(panel.y + axes.height, panel.y + panel.height - axes.height + 1)
+    );
+
+    cv::ellipse(page, center, axes, 0, 0, 360, cv::Scalar(255, 255, 255), cv::FILLED, cv::LINE_AA);
+    cv::ellipse(page, center, axes, 0, 0, 360, cv::Scalar(0, 0, 0), 2, cv::LINE_AA);
+
+    for (int i = 0; i < lines_count; i++) {
+        int baseline;
+        cv::Size size = cv::getTextSize(lines[i], cv::FONT_HERSHEY_SIMPLEX, font_scale, thickness, &baseline);
+        cv::Point origin(center.x - size.width / 2, center.y - lines_count * line_height / 2 + i * line_height + size.height);
+        cv::putText(page, lines[i], origin, cv::FONT_HERSHEY_SIMPLEX, font_scale, cv::Scalar(0, 0, 0), thickness, cv::LINE_AA);
+    }
+}
+
+/**
+ * Generate a page with a grid of panels filled with shapes & speech bubbles, the same seed always gives the same page
+ */
+static cv::Mat bench_generate_page (const struct BenchOptions& options, cv::RNG& rng, std::vector<cv::Rect>& panels) {
+    cv::Mat page(options.height, options.width, CV_8UC3, cv::Scalar(255, 255, 255));
+
+    panels.clear();
+
+    std::vector<std::pair<int, int>> rows = bench_split(options.height, options.rows, options.gutter, rng);
+    for (auto &row : rows) {
+        // Every row is split differently, like a real page
+        std::vector<std::pair<int, int>> cols = bench_split(options.width, options.cols, options.gutter, rng);
+        for (auto &col : cols) {
+            cv::Rect panel(col.first, row.first, col.second, row.second);
+            panels.push_back(panel);
+
+            // Background & "artwork", drawn on a view of the panel so nothing spills into the gutters
+            cv::Mat art = page(panel);
+            art.setTo(cv::Scalar(rng.uniform(180, 256), rng.uniform(180, 256), rng.uniform(180, 256)));
+            int shapes = rng.uniform(3, 12);
+            for (int i = 0; i < shapes; i++) {
+                cv::Point center(rng.uniform(0, panel.width), rng.uniform(0, panel.height));
+                int radius = rng.uniform(5, std::max(6, std::min(panel.width, panel.height) / 4));
+                cv::Scalar color(rng.uniform(0, 200), rng.uniform(0, 200), rng.uniform(0, 200));
+                int thickness = rng.uniform(0, 2) ? cv::FILLED : rng.uniform(1, 4);
+                if (rng.uniform(0, 2)) cv::circle(art, center, radius, color, thickness, cv::LINE_AA);
+                else cv::line(art, center, cv::Point(center.x + rng.uniform(-radius, radius), center.y + rng.uniform(-radius, radius)), color, rng.uniform(1, 4), cv::LINE_AA);
+            }
+
+            // Average of text_density bubbles per panel
+            int bubbles = (int)options.text_density + (rng.uniform(0.0, 1.0) < options.text_density - (int)options.text_density ? 1 : 0);
+            for (int i = 0; i < bubbles; i++) bench_draw_bubble(page, panel, rng);
+
+            cv::rectangle(page, panel, cv::Scalar(0, 0, 0), 3);
+        }
+    }
+
+    return page;
+}
+
+static double bench_iou (cv::Rect a, cv::Rect b) {
+    double intersection = (a & b).area();
+    double united = a.area() + b.area() - intersection;
+    return united > 0 ? intersection / united : 0;
+}
+
+/**
+ * Match every rect of a to the best rect of b, returns the amount of matches with an IoU of at least thresh
+ */
+static int bench_match (const std::vector<cv::Rect>& a, const std::vector<cv::Rect>& b, double thresh, double* iou_sum = NULL) {
+    std::vector<bool> used(b.size(), false);
+    int matched = 0;
+    for (auto &rect : a) {
+        int best = -1;
+        double best_iou = 0;
+        for (int j = 0; j < b.size(); j++) {
+            double iou = bench_iou(rect, b[j]);
+            if (!used[j] && iou > best_iou) {
+                best = j;
+                best_iou = iou;
+            }
+        }
+        if (iou_sum) *iou_sum += best_iou;
+        if (best >= 0 && best_iou >= thresh) {
+            used[best] = true;
+            matched++;
+        }
+    }
+    return matched;
+}
+
+/**
+ * Record a check that has to hold, main fails once the JSON is written if any of them didn't
+ */
+static void bench_require (std::vector<std::string>& failures, const std::string& name, bool ok) {
+    if (!ok) failures.push_back(name);
+}
+
+/**
+ * Compare panel_edge_mask with the OpenCV reference on odd sizes, every supported channel count & a ROI,
+ * the sizes put band boundaries at different rows (bands are 8-128 rows depending on the width)
+ * @returns The amount of mismatched mask pixels, has to be 0
+ */
+static double bench_edge_mask_sweep (std::map<std::string, struct BenchStage>& stages, cv::RNG& rng) {
+    static const cv::Size sizes[] = { cv::Size(1, 1), cv::Size(3, 2), cv::Size(5, 9), cv::Size(33, 17), cv::Size(641, 129), cv::Size(1283, 257), cv::Size(4097, 65) };
+    double mismatch = 0;
+
+    for (auto &size : sizes) {
+        std::string name = "edge_mask_" + std::to_string(size.width) + "x" + std::to_string(size.height);
+
+        for (int cn : { 1, 3, 4 }) {
+            // Flat areas, sharp shapes & a noisy stripe, so both sides of the threshold show up
+            cv::Mat img(size, CV_8UC(cn), cv::Scalar::all(rng.uniform(0, 256)));
+            for (int i = 0; i < 6; i++) {
+                cv::Point a(rng.uniform(0, size.width), rng.uniform(0, size.height));
+                cv::Point b(rng.uniform(0, size.width), rng.uniform(0, size.height));
+                cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+                if (i % 2) cv::rectangle(img, a, b, color, rng.uniform(0, 2) ? cv::FILLED : rng.uniform(1, 4));
+                else cv::line(img, a, b, color, rng.uniform(1, 4));
+            }
+            for (int y = 0; y < std::max(1, size.height / 4); y++) {
+                uchar* row = img.ptr<uchar>(y);
+                for (int x = 0; x < size.width * cn; x++) row[x] = (uchar)rng.uniform(0, 256);
+            }
+
+            cv::Mat fused, reference, diff;
+            bench_time(stages, name.c_str(), 1, [&] () { panel_edge_mask(img, fused); });
+            bench_time(stages, (name + "_reference").c_str(), 1, [&] () { panel_edge_mask_reference(img, reference); });
+            cv::compare(fused, reference, diff, cv::CMP_NE);
+            mismatch += cv::countNonZero(diff);
+
+            // A ROI uses the pixels around it as neighbours, so it matches the same region of the whole mask
+            cv::Rect roi(size.width / 3, size.height / 3, std::max(1, size.width / 2), std::max(1, size.height / 2));
+            panel_edge_mask(img, fused, roi);
+            cv::compare(fused, reference(roi), diff, cv::CMP_NE);
+            mismatch += cv::countNonZero(diff);
+        }
+    }
+
+    return mismatch;
+}
+
+/**
+ * Time simple_process_text with 1, 2, 4, ... up to options.threads workers on the first pages,
+ * every worker count has to give the same dialogue in the same order as a single worker
+ */
+/**
+ * Compare the streaming XML writer with the TinyXML DOM on pages with & without panels, contours and text
+ * (markup characters, character references, control characters, empty text), then read every page back from a binary stream
+ * @param checks Gets info_xml_mismatches & info_binary_mismatches, both have to be 0
+ */
+static void bench_info_checks (std::map<std::string, double>& checks, std::vector<std::string>& failures) {
+    static const char* texts[] = { "plain", "a & b <c> \"d\" 'e'", "&#x41; &#x42", "&#x<", "line\nbreak\ttab\x01", "caf\xc3\xa9", "" };
+
+    std::vector<struct SimplePageData> pages(3);
+    for (int p = 1; p < pages.size(); p++) {
+        pages[p].panels.push_back({ { cv::Point(-3, 5), cv::Point(36, 5), cv::Point(36, 34), cv::Point(-3, 34) }, cv::Rect(-3, 5, 40, 30) });
+        pages[p].panels.push_back({ { cv::Point(50, 5) }, cv::Rect(50, 5, 1, 1) });
+        pages[p].dialogue.resize(2);
+    }
+    for (int i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) pages[2].dialogue[0].push_back({ cv::Rect(i, i * 7, 9, 3), texts[i] });
+
+    int xml_mismatches = 0;
+    for (auto &page : pages) {
+        for (int flags = 0; flags < 4; flags++) {
+            bool include_text = flags & 1, include_contour = flags & 2;
+            if (include_text && page.dialogue.size() < page.panels.size()) continue;
+
+            TiXmlPrinter printer;
+            simple_xml_info(page, include_text, include_contour).Accept(&printer);
+
+            std::string buffer;
+            struct InfoWriter* writer = info_writer_open_buffer(&buffer, INFO_FORMAT_XML);
+            simple_write_info(writer, "page", page, include_text, include_contour);
+            info_writer_close(writer);
+
+            xml_mismatches += buffer != printer.CStr();
+        }
+    }
+
+    std::string stream;
+    struct InfoWriter* writer = info_writer_open_buffer(&stream, INFO_FORMAT_BINARY);
+    for (int i = 0; i < pages.size(); i++) simple_write_info(writer, std::to_string(i).c_str(), pages[i], !pages[i].dialogue.empty());
+    info_writer_close(writer);
+
+    int binary_mismatches = 0, read = 0;
+    const uint8_t* data = (const uint8_t*)stream.data();
+    const uint8_t* end = data + stream.size();
+    std::string name;
+    PanelArray panels;
+    std::vector<std::vector<struct PageText>> dialogue;
+    if (!info_binary_header(&data, end)) binary_mismatches++;
+    while (read < pages.size() && info_binary_page(&data, end, name, panels, dialogue)) {
+        const struct SimplePageData& page = pages[read];
+        bool same = name == std::to_string(read) && panels.size() == page.panels.size() && dialogue.size() == page.dialogue.size();
+        for (int i = 0; same && i < panels.size(); i++) {
+            same = panels[i].bounding_box == page.panels[i].bounding_box && panels[i].contour == page.panels[i].contour;
+        }
+        for (int i = 0; same && i < dialogue.size(); i++) {
+            same = dialogue[i].size() == page.dialogue[i].size();
+            for (int j = 0; same && j < dialogue[i].size(); j++) {
+                same = dialogue[i][j].bounding_box == page.dialogue[i][j].bounding_box && dialogue[i][j].text == page.dialogue[i][j].text;
+            }
+        }
+        binary_mismatches += !same;
+        read++;
+    }
+    binary_mismatches += pages.size() - read + (data != end);
+
+    checks["info_xml_mismatches"] = xml_mismatches;
+    checks["info_binary_mismatches"] = binary_mismatches;
+    bench_require(failures, "info_xml_mismatches == 0", xml_mismatches == 0);
+    bench_require(failures, "info_binary_mismatches == 0", binary_mismatches == 0);
+}
+
+static void bench_thread_sweep (const struct BenchOptions& options, std::map<std::string, struct BenchStage>& stages, std::map<std::string, double>& checks, std::vector<std::string>& failures) {
+    cv::RNG rng(options.seed);
+    std::vector<cv::Mat> pages;
+    for (int p = 0; p < std::min(options.pages, 8); p++) {
+        std::vector<cv::Rect> unused;
+        pages.push_back(bench_generate_page(options, rng, unused));
+    }
+
+    std::vector<int> counts;
+    for (int t = 1; t < options.threads; t *= 2) counts.push_back(t);
+    counts.push_back(options.threads);
+
+    std::vector<std::vector<std::vector<struct PageText>>> single;
+    double single_ms = 0, mismatches = 0;
+
+    for (int t : counts) {
+        struct SimpleProcessor* proc = simple_processor_init(options.model, 0, options.lang, 0.4f, 0.001, 300, 15.0, t);
+        if (!proc || proc->text_detector.empty()) {
+            fprintf(stderr, "Chopfox-Bench: Could not create a text processor, skipping the thread sweep\n");
+            if (proc) simple_processor_free(proc);
+            return;
+        }
+        simple_processor_set_workers(proc, t);
+
+        std::string name = "text_threads_" + std::to_string(t);
+        double total_ms = 0;
+        for (int p = 0; p < pages.size(); p++) {
+            struct SimplePageData data;
+            simple_process_panels(proc, pages[p], &data);
+            simple_process_chop(proc, pages[p], &data);
+
+            int64_t start = cv::getTickCount();
+            bench_time(stages, name.c_str(), data.panels.size(), [&] () { simple_process_text(proc, &data); });
+            total_ms += (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+            if (t == 1) {
+                single.push_back(std::move(data.dialogue));
+                continue;
+            }
+
+            bool same = data.dialogue.size() == single[p].size();
+            for (int i = 0; same && i < data.dialogue.size(); i++) {
+                same = data.dialogue[i].size() == single[p][i].size();
+                for (int j = 0; same && j < data.dialogue[i].size(); j++) {
+                    same = data.dialogue[i][j].text == single[p][i][j].text && data.dialogue[i][j].bounding_box == single[p][i][j].bounding_box;
+                }
+            }
+            mismatches += !same;
+        }
+
+        if (t == 1) single_ms = total_ms;
+        checks[name + "_speedup"] = total_ms > 0 ? single_ms / total_ms : 0;
+
+        simple_processor_free(proc);
+    }
+
+    checks["text_threads_mismatched_pages"] = mismatches;
+    bench_require(failures, "text_threads_mismatched_pages == 0", mismatches == 0);
+}
+
+/**
+ * Whether two sets of detections hold the same boxes with the same scores, in the same order
+ */
+static bool bench_same_detections (const struct TextDetections& a, const struct TextDetections& b) {
+    if (a.boxes.size() != b.boxes.size()) return false;
+    for (int i = 0; i < a.boxes.size(); i++) {
+        if (a.confidences[i] != b.confidences[i]) return false;
+        if (a.boxes[i].center != b.boxes[i].center || a.boxes[i].angle != b.boxes[i].angle) return false;
+        if (a.boxes[i].size.width != b.boxes[i].size.width || a.boxes[i].size.height != b.boxes[i].size.height) return false;
+    }
+    return true;
+}
+
+/**
+ * Characters of a recognized text apart from the whitespace, the line & block recognition break lines differently
+ */
+static int bench_characters (const std::string& text) {
+    int count = 0;
+    for (auto c : text) {
+        if (!isspace((unsigned char)c)) count++;
+    }
+    return count;
+}
+
+/**
+ * Largest distance from a vertex of a to the polygon b, in pixels
+ */
+static double bench_contour_distance (const std::vector<cv::Point>& a, const std::vector<cv::Point>& b) {
+    double distance = 0;
+    for (auto &point : a) distance = std::max(distance, fabs(cv::pointPolygonTest(b, cv::Point2f(point), true)));
+    return distance;
+}
+
+static std::vector<cv::Rect> bench_panel_rects (const PanelArray& panels) {
+    std::vector<cv::Rect> rects;
+    for (auto &panel : panels) rects.push_back(panel.bounding_box);
+    return rects;
+}
+
+static void bench_write_json (FILE* out, const struct BenchOptions& options, std::map<std::string, struct BenchStage>& stages, std::map<std::string, double>& checks) {
+    fprintf(out, "{\n  \"config\": {\n");
+    fprintf(out, "    \"pages\": %d, \"width\": %d, \"height\": %d, \"rows\": %d, \"cols\": %d, \"gutter\": %d,\n", options.pages, options.width, options.height, options.rows, options.cols, options.gutter);
+    fprintf(out, "    \"text_density\": %g, \"seed\": %llu, \"panel_downscale\": %d, \"batch\": %d, \"max_side\": %d, \"precision\": \"%s\", \"threads\": %d, \"text_threads\": %d, \"text\": %s\n", options.text_density, (unsigned long long)options.seed, options.panel_downscale, options.batch, options.limits.max_side, options.precision == TEXT_PRECISION_INT8 ? "int8" : options.precision == TEXT_PRECISION_FP16 ? "fp16" : "fp32", cv::getNumThreads(), options.threads, options.model ? "true" : "false");
+    fprintf(out, "  },\n  \"stages\": {");
+
+    bool first = true;
+    for (auto &item : stages) {
+        std::vector<double> ms = item.second.ms;
+        std::sort(ms.begin(), ms.end());
+
+        double total = 0;
+        for (auto &v : ms) total += v;
+
+        // Nearest rank percentiles
+        auto percentile = [&ms] (double p) { return ms[std::min(ms.size() - 1, (size_t)(p / 100.0 * ms.size()))]; };
+
+        fprintf(out, "%s\n    \"%s\": { \"samples\": %d, \"items\": %d, \"total_ms\": %.3f, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, \"items_per_sec\": %.2f }",
+            first ? "" : ",", item.first.c_str(), (int)ms.size(), (int)item.second.items, total, total / ms.size(),
+            percentile(50), percentile(90), percentile(99), ms.back(), total > 0 ? item.second.items * 1000.0 / total : 0.0);
+        first = false;
+    }
+
+    fprintf(out, "\n  },\n  \"checks\": {");
+
+    first = true;
+    for (auto &item : checks) {
+        fprintf(out, "%s\n    \"%s\": %.6g", first ? "" : ",", item.first.c_str(), item.second);
+        first = false;
+    }
+
+    fprintf(out, "\n  }\n}\n");
+}
+
+int main (int argc, char** argv) {
+    struct BenchOptions options;
+    char* value;
+
+    options.pages = (value = getCmdOption(argv, argv+argc, "--pages")) ? atoi(value) : 20;
+    options.width = (value = getCmdOption(argv, argv+argc, "--width")) ? atoi(value) : 1654;
+    options.height = (value = getCmdOption(argv, argv+argc, "--height")) ? atoi(value) : 2339;
+    options.rows = (value = getCmdOption(argv, argv+argc, "--rows")) ? atoi(value) : 3;
+    options.cols = (value = getCmdOption(argv, argv+argc, "--cols")) ? atoi(value) : 2;
+    options.gutter = (value = getCmdOption(argv, argv+argc, "--gutter")) ? atoi(value) : 30;
+    options.text_density = (value = getCmdOption(argv, argv+argc, "--text_density")) ? atof(value) : 1.5;
+    options.seed = (value = getCmdOption(argv, argv+argc, "--seed")) ? strtoull(value, NULL, 10) : 1234;
+    options.panel_downscale = (value = getCmdOption(argv, argv+argc, "--panel_downscale")) ? atoi(value) : 4;
+    options.batch = (value = getCmdOption(argv, argv+argc, "--batch")) ? atoi(value) : 8;
+    options.limits.max_side = (value = getCmdOption(argv, argv+argc, "--max_side")) ? atoi(value) : 512;
+    options.limits.large_frames = TEXT_LARGE_AUTO;
+    options.limits.min_text_height = 24;
+    options.limits.tile_overlap = 128;
+    if ((value = getCmdOption(argv, argv+argc, "--large_frames"))) {
+        if (strcmp(value, "downscale") == 0) options.limits.large_frames = TEXT_LARGE_DOWNSCALE;
+        else if (strcmp(value, "tile") == 0) options.limits.large_frames = TEXT_LARGE_TILE;
+    }
+    options.prefilter.thumb_side = 384;
+    options.prefilter.min_contrast = 48;
+    options.prefilter.min_density = (value = getCmdOption(argv, argv+argc, "--prefilter_density")) ? atof(value) : 0.002;
+    options.precision = TEXT_PRECISION_FP32;
+    if ((value = getCmdOption(argv, argv+argc, "--precision")) && !text_precision_parse(value, &options.precision)) {
+        fprintf(stderr, "Chopfox-Bench Error: Unknown precision %s (use fp32, fp16 or int8)\n", value);
+        return 1;
+    }
+    options.calibration = (value = getCmdOption(argv, argv+argc, "--calibration")) ? atoi(value) : 8;
+    options.decode_reduce = (value = getCmdOption(argv, argv+argc, "--decode_reduce")) ? atoi(value) : 2;
+    options.threads = (value = getCmdOption(argv, argv+argc, "--threads")) ? atoi(value) : 0;
+    options.model = getCmdOption(argv, argv+argc, "--model");
+    options.lang = (value = getCmdOption(argv, argv+argc, "--lang")) ? value : "eng";
+    options.output = getCmdOption(argv, argv+argc, "--output");
+
+    if (options.pages < 1 || options.rows < 1 || options.cols < 1 || options.width < 64 || options.height < 64) {
+        fprintf(stderr, "Chopfox-Bench Error: Invalid page options\n");
+        return 1;
+    }
+
+    cv::dnn::Net detector;
+    tesseract::TessBaseAPI* ocr = NULL;
+    if (options.model) {
+        detector = cv::dnn::readNet(options.model);
+        ocr = ocr_engine_init(options.lang);
+        if (detector.empty()) fprintf(stderr, "Chopfox-Bench: Could not load %s, skipping text detection\n", options.model);
+        if (!ocr) fprintf(stderr, "Chopfox-Bench: Could not load tesseract %s data, skipping OCR\n", options.lang);
+    }
+
+    // Reduced precision model, the calibration pages come from their own generator so the measured pages stay the same
+    cv::dnn::Net reduced;
+    if (!detector.empty() && options.precision != TEXT_PRECISION_FP32) {
+        struct TextModelOptions model_options;
+        model_options.backend = cv::dnn::DNN_BACKEND_OPENCV;
+        model_options.target = cv::dnn::DNN_TARGET_CPU;
+        model_options.precision = options.precision;
+
+        cv::RNG calibration_rng(options.seed + 1);
+        for (int i = 0; i < options.calibration; i++) {
+            std::vector<cv::Rect> unused;
+            model_options.calibration.push_back(bench_generate_page(options, calibration_rng, unused));
+        }
+
+        reduced = text_detector_load(options.model, &model_options);
+        if (reduced.empty()) fprintf(stderr, "Chopfox-Bench: Could not load %s at reduced precision, skipping the comparison\n", options.model);
+    }
+
+    std::map<std::string, struct BenchStage> stages;
+    std::map<std::string, double> checks;
+
+    struct Workspace* ws = workspace_init();
+    cv::RNG rng(options.seed);
+
+    cv::RNG sweep_rng(options.seed + 2);
+    double mask_sweep_mismatch = bench_edge_mask_sweep(stages, sweep_rng);
+
+    struct SimpleProcessor* panel_proc = simple_processor_init_notext(0);
+    panel_proc->lazy_frames = true;
+    struct SimpleIncremental* inc = simple_incremental_init(panel_proc, false);
+    double incremental_changed = 0, incremental_full = 0, incremental_splits = 0, incremental_splits_missed = 0;
+
+    double mask_mismatch = 0, panels_expected = 0, panels_found = 0, panels_matched = 0, coarse_iou = 0, coarse_panels = 0;
+    double coarse_contours = 0, coarse_contour_distance = 0, coarse_contour_max = 0;
+    double regions_mask = 0, regions_geometric = 0, regions_matched = 0;
+    double regions_capped = 0, regions_capped_matched = 0;
+    double boxes_full = 0, boxes_reduced = 0, boxes_reduced_matched = 0, regions_reduced_matched = 0;
+    double prefilter_panels = 0, prefilter_skipped = 0, prefilter_with_text = 0, prefilter_kept_with_text = 0;
+    double allocations_page = 0, allocations_comic_data = 0;
+    double ocr_characters = 0, ocr_line_characters = 0, ocr_panels = 0, ocr_reuse_mismatches = 0;
+    double batch_decode_frames = 0, batch_decode_mismatches = 0, batch_single_mismatches = 0;
+    std::vector<std::string> failures;
+    double crops_bytes = 0, stream_peak_bytes = 0, stream_emitted = 0;
+    double strip_panels = 0, strip_mismatches = 0, strip_capped_oversized = 0;
+    double reduced_panels_matched = 0, reduced_iou = 0;
+    std::map<std::string, double> info_bytes;
+
+    for (int p = 0; p < options.pages; p++) {
+        std::vector<cv::Rect> truth;
+        cv::Mat page = bench_generate_page(options, rng, truth);
+
+        // Panel extraction
+        cv::Mat fused, reference;
+        bench_time(stages, "edge_mask", 1, [&] () { panel_edge_mask(page, fused); });
+        bench_time(stages, "edge_mask_reference", 1, [&] () { panel_edge_mask_reference(page, reference); });
+
+        cv::Mat diff;
+        cv::compare(fused, reference, diff, cv::CMP_NE);
+        mask_mismatch += cv::countNonZero(diff);
+
+        PanelArray panels;
+        bench_time(stages, "panels", 1, [&] () { panels = get_panels_rgb(page, 0.001, 15.0, ws); });
+
+        panels_expected += truth.size();
+        panels_found += panels.size();
+        panels_matched += bench_match(truth, bench_panel_rects(panels), 0.9);
+
+        // Decoding the page as a JPEG at full & reduced resolution, the reduced panels are mapped back and matched with the full ones
+        std::vector<unsigned char> encoded;
+        cv::imencode(".jpg", page, encoded);
+
+        cv::Mat decoded, reduced_page;
+        cv::Size full_size;
+        bench_time(stages, "decode_full", 1, [&] () { decoded = decode_image(encoded.data(), encoded.size()); });
+        bench_time(stages, "decode_reduced", 1, [&] () { reduced_page = decode_image(encoded.data(), encoded.size(), DECODE_GRAY, options.decode_reduce, &full_size); });
+
+        PanelArray reduced_panels;
+        bench_time(stages, "panels_reduced", 1, [&] () { reduced_panels = get_panels_rgb(reduced_page, 0.001, 15.0, ws); });
+        rescale_panels(reduced_panels, reduced_page.size(), full_size);
+        reduced_panels_matched += bench_match(bench_panel_rects(panels), bench_panel_rects(reduced_panels), 0.9, &reduced_iou);
+
+        // Heap allocations of a whole page, with SimplePageData and through the SimpleComicData functions:
+        // processing, writing the info, the XML document & the debug boxes, then freeing it
+        cv::Mat debug = page.clone();
+        std::string info;
+        info.reserve(1 << 16);
+        size_t allocations = bench_allocations;
+        {
+            struct SimplePageData page_data = simple_process_page(panel_proc, page, false);
+            struct InfoWriter* writer = info_writer_open_buffer(&info, INFO_FORMAT_JSONL);
+            simple_write_info(writer, "page", page_data, false);
+            info_writer_close(writer);
+            simple_xml_info(page_data, false);
+            simple_draw_bounding_boxes(page_data, debug);
+            simple_data_free(page_data);
+        }
+        allocations_page += bench_allocations - allocations;
+
+        info.clear();
+        allocations = bench_allocations;
+        {
+            struct SimpleComicData comic_data;
+            simple_process_page(panel_proc, page, &comic_data, false);
+            struct InfoWriter* writer = info_writer_open_buffer(&info, INFO_FORMAT_JSONL);
+            simple_write_info(writer, "page", &comic_data, false);
+            info_writer_close(writer);
+            simple_xml_info(&comic_data, false);
+            simple_draw_bounding_boxes(&comic_data, debug);
+            simple_data_free(&comic_data);
+        }
+        allocations_comic_data += bench_allocations - allocations;
+
+        if (options.panel_downscale > 1) {
+            PanelArray coarse;
+            bench_time(stages, "panels_coarse", 1, [&] () { coarse = get_panels_coarse(page, 0.001, 15.0, options.panel_downscale, ws); });
+            bench_match(bench_panel_rects(panels), bench_panel_rects(coarse), 0.9, &coarse_iou);
+            coarse_panels += panels.size();
+
+            // How far the refined contours are from the full resolution ones, vertex to polygon both ways
+            for (auto &full : panels) {
+                for (auto &refined : coarse) {
+                    if (bench_iou(full.bounding_box, refined.bounding_box) < 0.9) continue;
+                    double distance = std::max(bench_contour_distance(full.contour, refined.contour), bench_contour_distance(refined.contour, full.contour));
+                    coarse_contour_distance += distance;
+                    coarse_contour_max = std::max(coarse_contour_max, distance);
+                    coarse_contours++;
+                    break;
+                }
+            }
+        }
+
+        std::vector<cv::Mat> frames;
+        bench_time(stages, "crop", panels.size(), [&] () { frames = crop_frames(page, panels, ws); });
+
+        // Streaming the same page only holds one crop at a time, against all of them above
+        size_t stream_peak = 0;
+        int streamed = 0;
+        bench_time(stages, "stream", panels.size(), [&] () {
+            stream_peak = simple_process_stream(panel_proc, page, [&] (int index, const struct PanelInfo& panel, cv::Mat frame, std::vector<struct PageText>& text) { streamed++; }, false);
+        });
+        for (auto &frame : frames) crops_bytes += frame.total() * frame.elemSize();
+        stream_peak_bytes += stream_peak;
+        stream_emitted += streamed;
+
+        // Animated frames: a new page needs a full pass, then a frame where a single panel changed reuses the others
+        if (!truth.empty()) {
+            size_t full_passes = inc->full_passes;
+            bench_time(stages, "incremental_new_layout", 1, [&] () { simple_incremental_frame(inc, page); });
+
+            cv::Mat next = page.clone();
+            cv::Rect panel = truth[0];
+            cv::circle(next, (panel.tl() + panel.br()) * 0.5, std::max(4, std::min(panel.width, panel.height) / 8), cv::Scalar(0, 0, 255), cv::FILLED);
+            bench_time(stages, "incremental_one_panel", 1, [&] () { simple_incremental_frame(inc, next); });
+
+            incremental_full += inc->full_passes - full_passes;
+            for (bool changed : inc->changed) incremental_changed += changed;
+
+            // A border drawn across the middle of a panel splits it, the gutters stay the same but the layout has to be found again
+            cv::Mat split = next.clone();
+            int middle = panel.y + panel.height / 2;
+            cv::line(split, cv::Point(panel.x, middle), cv::Point(panel.x + panel.width - 1, middle), cv::Scalar(0, 0, 0), 3);
+            full_passes = inc->full_passes;
+            bench_time(stages, "incremental_split", 1, [&] () { simple_incremental_frame(inc, split); });
+            incremental_splits++;
+            incremental_splits_missed += inc->full_passes == full_passes;
+        }
+
+        // Two pages stacked as a strip, read band by band it has to give the same panels as the whole image.
+        // With max_rows the panels taller than it come out in pieces that fit in the window.
+        cv::Mat strip;
+        cv::vconcat(page, page, strip);
+        PanelArray strip_whole, strip_streamed, strip_capped;
+        bench_time(stages, "strip_whole", 1, [&] () { strip_whole = get_panels_rgb(strip, 0.001, 15.0, ws); });
+        struct StripReader* reader = strip_reader_mat(strip);
+        bench_time(stages, "strip_streaming", 1, [&] () {
+            get_panels_streaming(reader, [&] (const struct PanelInfo& panel, cv::Mat pixels) { strip_streamed.push_back(panel); }, 0.001, 15.0, 256);
+        });
+        strip_reader_free(reader);
+        std::vector<cv::Rect> whole_rects = bench_panel_rects(strip_whole), streamed_rects = bench_panel_rects(strip_streamed);
+        strip_panels += whole_rects.size();
+        strip_mismatches += whole_rects.size() + streamed_rects.size() - 2 * bench_match(whole_rects, streamed_rects, 0.999);
+
+        reader = strip_reader_mat(strip);
+        get_panels_streaming(reader, [&] (const struct PanelInfo& panel, cv::Mat pixels) { strip_capped.push_back(panel); }, 0.001, 15.0, 256, 512);
+        strip_reader_free(reader);
+        for (auto &panel : strip_capped) strip_capped_oversized += panel.bounding_box.height > 512;
+
+        // Page info serialization, the DOM against the streaming writers
+        struct SimplePageData data;
+        data.panels = panels;
+        bench_time(stages, "info_xml_dom", 1, [&] () {
+            TiXmlPrinter printer;
+            simple_xml_info(data, false).Accept(&printer);
+            info_bytes["xml_dom"] += printer.Size();
+        });
+        for (int f = INFO_FORMAT_XML; f <= INFO_FORMAT_BINARY; f++) {
+            std::string name = info_format_extension((enum InfoFormat)f);
+            std::string buffer;
+            bench_time(stages, ("info_" + name).c_str(), 1, [&] () {
+                struct InfoWriter* writer = info_writer_open_buffer(&buffer, (enum InfoFormat)f);
+                simple_write_info(writer, "page", data, false);
+                info_writer_close(writer);
+            });
+            info_bytes[name] += buffer.size();
+        }
+
+        if (frames.empty()) continue;
+
+        // Text presence prefilter, its recall is measured against the regions EAST finds below
+        std::vector<bool> likely(frames.size());
+        for (int i = 0; i < frames.size(); i++) {
+            bench_time(stages, "text_prefilter", 1, [&] () { likely[i] = text_likely(frames[i], &options.prefilter, ws); });
+            prefilter_panels++;
+            prefilter_skipped += !likely[i];
+        }
+
+        if (detector.empty()) continue;
+
+        // Text detection, one forward pass per bucket
+        std::vector<cv::Size> frame_sizes;
+        for (auto &frame : frames) frame_sizes.push_back(frame.size());
+
+        std::vector<std::vector<cv::Rect>> uncapped(frames.size());
+        std::vector<struct TextDetections> full(frames.size());
+        for (auto &batch : text_batch_buckets(frame_sizes, options.batch)) {
+            std::vector<cv::Mat> outs;
+            std::vector<struct TextInput> inputs;
+            std::vector<struct TextDetections> detections;
+
+            bench_time(stages, "east_forward", batch.size(), [&] () { text_forward_batch(frames, batch, detector, outs, inputs, ws); });
+            bench_time(stages, "east_decode_nms", batch.size(), [&] () { text_decode_batch(frames, batch, outs, inputs, 0.4f, detections); });
+
+            // Decoding a frame out of the batch has to give the same boxes & scores as decoding its slice of the outputs alone
+            for (int k = 0; batch.size() > 1 && k < batch.size(); k++) {
+                std::vector<struct TextInput> alone_inputs;
+                int first = -1;
+                for (int j = 0; j < inputs.size(); j++) {
+                    if (inputs[j].frame != k) continue;
+                    if (first < 0) first = j;
+                    alone_inputs.push_back(inputs[j]);
+                    alone_inputs.back().frame = 0;
+                }
+
+                std::vector<cv::Range> slice = { cv::Range(first, first + (int)alone_inputs.size()), cv::Range::all(), cv::Range::all(), cv::Range::all() };
+                std::vector<cv::Mat> alone_outs = { outs[0](slice).clone(), outs[1](slice).clone() };
+                std::vector<struct TextDetections> alone;
+                text_decode_batch(frames, std::vector<int>{ batch[k] }, alone_outs, alone_inputs, 0.4f, alone);
+
+                batch_decode_frames++;
+                batch_decode_mismatches += !bench_same_detections(detections[k], alone[0]);
+
+                // Forwarding the frame alone has to find the same boxes, the batch mates must not leak into them
+                std::vector<cv::Mat> single_outs;
+                std::vector<struct TextInput> single_inputs;
+                std::vector<struct TextDetections> single;
+                text_forward_batch(frames, std::vector<int>{ batch[k] }, detector, single_outs, single_inputs, ws);
+                text_decode_batch(frames, std::vector<int>{ batch[k] }, single_outs, single_inputs, 0.4f, single);
+
+                std::vector<cv::Rect> batched_boxes, single_boxes;
+                for (auto &box : detections[k].boxes) batched_boxes.push_back(box.boundingRect());
+                for (auto &box : single[0].boxes) single_boxes.push_back(box.boundingRect());
+                batch_single_mismatches += batched_boxes.size() != single_boxes.size() || bench_match(batched_boxes, single_boxes, 0.99) != single_boxes.size();
+            }
+
+            for (int k = 0; k < batch.size(); k++) {
+                cv::Size frame_size = frames[batch[k]].size();
+
+                std::vector<cv::Rect> geometric, mask;
+                bench_time(stages, "grouping", 1, [&] () { geometric = text_regions(frame_size, detections[k], TEXT_GROUPING_GEOMETRIC, ws); });
+                bench_time(stages, "grouping_mask", 1, [&] () { mask = text_regions(frame_size, detections[k], TEXT_GROUPING_MASK, ws); });
+
+                regions_geometric += geometric.size();
+                regions_mask += mask.size();
+                regions_matched += bench_match(mask, geometric, 0.9);
+                uncapped[batch[k]] = geometric;
+                full[batch[k]] = detections[k];
+                if (!geometric.empty()) {
+                    prefilter_with_text++;
+                    prefilter_kept_with_text += likely[batch[k]];
+                }
+
+                if (!ocr) continue;
+
+                std::vector<struct PageText> blocks, lines;
+                bench_time(stages, "ocr", 1, [&] () { blocks = recognize_text(frames[batch[k]], detections[k], ocr, 300, TEXT_GROUPING_GEOMETRIC, ws); });
+                bench_time(stages, "ocr_lines", 1, [&] () { lines = recognize_text(frames[batch[k]], detections[k], ocr, 300, TEXT_GROUPING_GEOMETRIC, ws, NULL, TEXT_RECOGNITION_LINE); });
+
+                // Before the engine pool every panel loaded its own engine, a reused engine has to read the same text
+                std::vector<struct PageText> fresh;
+                bench_time(stages, "ocr_engine_per_panel", 1, [&] () {
+                    tesseract::TessBaseAPI* panel_ocr = ocr_engine_init(options.lang);
+                    fresh = recognize_text(frames[batch[k]], detections[k], panel_ocr, 300, TEXT_GROUPING_GEOMETRIC, ws);
+                    ocr_engine_free(panel_ocr);
+                });
+                ocr_panels++;
+                bool same = fresh.size() == blocks.size();
+                for (int j = 0; same && j < blocks.size(); j++) same = fresh[j].text == blocks[j].text && fresh[j].bounding_box == blocks[j].bounding_box;
+                ocr_reuse_mismatches += !same;
+
+                for (auto &block : blocks) ocr_characters += bench_characters(block.text);
+                for (auto &block : lines) ocr_line_characters += bench_characters(block.text);
+            }
+        }
+
+        // Same frames at reduced precision, boxes & regions are matched against the FP32 ones
+        for (auto &batch : reduced.empty() ? std::vector<std::vector<int>>() : text_batch_buckets(frame_sizes, options.batch)) {
+            std::vector<cv::Mat> reduced_outs;
+            std::vector<struct TextInput> inputs;
+            std::vector<struct TextDetections> reduced_detections;
+
+            std::string name = options.precision == TEXT_PRECISION_INT8 ? "east_int8_forward" : "east_fp16_forward";
+            bench_time(stages, name.c_str(), batch.size(), [&] () { text_forward_batch(frames, batch, reduced, reduced_outs, inputs, ws); });
+            text_decode_batch(frames, batch, reduced_outs, inputs, 0.4f, reduced_detections);
+
+            for (int k = 0; k < batch.size(); k++) {
+                std::vector<cv::Rect> full_boxes, reduced_boxes;
+                for (auto &box : full[batch[k]].boxes) full_boxes.push_back(box.boundingRect());
+                for (auto &box : reduced_detections[k].boxes) reduced_boxes.push_back(box.boundingRect());
+
+                boxes_full += full_boxes.size();
+                boxes_reduced += reduced_boxes.size();
+                boxes_reduced_matched += bench_match(full_boxes, reduced_boxes, 0.5);
+
+                std::vector<cv::Rect> regions = text_regions(frames[batch[k]].size(), reduced_detections[k], TEXT_GROUPING_GEOMETRIC, ws);
+                regions_reduced_matched += bench_match(uncapped[batch[k]], regions, 0.5);
+            }
+        }
+
+        // Same frames with the EAST input capped, the regions should mostly be the same as uncapped
+        for (auto &batch : text_batch_buckets(frame_sizes, options.batch, &options.limits)) {
+            std::vector<cv::Mat> outs;
+            std::vector<struct TextInput> inputs;
+            std::vector<struct TextDetections> detections;
+
+            bench_time(stages, "east_capped_forward", batch.size(), [&] () { text_forward_batch(frames, batch, detector, outs, inputs, ws, NULL, &options.limits); });
+            bench_time(stages, "east_capped_decode_nms", batch.size(), [&] () { text_decode_batch(frames, batch, outs, inputs, 0.4f, detections); });
+
+            for (int k = 0; k < batch.size(); k++) {
+                std::vector<cv::Rect> capped = text_regions(frames[batch[k]].size(), detections[k], TEXT_GROUPING_GEOMETRIC, ws);
+                regions_capped += uncapped[batch[k]].size();
+                regions_capped_matched += bench_match(uncapped[batch[k]], capped, 0.5);
+            }
+        }
+
+        free_mat_vector(frames);
+    }
+
+    checks["edge_mask_mismatched_pixels"] = mask_mismatch;
+    checks["edge_mask_sweep_mismatched_pixels"] = mask_sweep_mismatch;
+    bench_require(failures, "edge_mask_mismatched_pixels == 0", mask_mismatch == 0);
+    bench_require(failures, "edge_mask_sweep_mismatched_pixels == 0", mask_sweep_mismatch == 0);
+
+    // The fused kernel replaces the OpenCV chain, it has to be faster on the pages
+    if (stages.count("edge_mask")) {
+        double fused_ms = 0, reference_ms = 0;
+        for (auto &ms : stages["edge_mask"].ms) fused_ms += ms;
+        for (auto &ms : stages["edge_mask_reference"].ms) reference_ms += ms;
+        checks["edge_mask_speedup"] = fused_ms > 0 ? reference_ms / fused_ms : 0;
+        bench_require(failures, "edge_mask_speedup >= 1", fused_ms <= reference_ms);
+    }
+    checks["panels_expected"] = panels_expected;
+    checks["panels_found"] = panels_found;
+    checks["panels_recall"] = panels_expected > 0 ? panels_matched / panels_expected : 0;
+    if (coarse_panels > 0) checks["coarse_mean_iou"] = coarse_iou / coarse_panels;
+    if (coarse_contours > 0) {
+        checks["coarse_contour_mean_distance"] = coarse_contour_distance / coarse_contours;
+        checks["coarse_contour_max_distance"] = coarse_contour_max;
+    }
+    checks["reduced_decode_panels_recall"] = panels_found > 0 ? reduced_panels_matched / panels_found : 0;
+    checks["reduced_decode_mean_iou"] = panels_found > 0 ? reduced_iou / panels_found : 0;
+    if (!detector.empty()) {
+        checks["batch_decode_frames"] = batch_decode_frames;
+        checks["batch_decode_mismatches"] = batch_decode_mismatches;
+        bench_require(failures, "batch_decode_mismatches == 0", batch_decode_mismatches == 0);
+        checks["batch_single_mismatches"] = batch_single_mismatches;
+        bench_require(failures, "batch_single_mismatches == 0", batch_single_mismatches == 0);
+        checks["grouping_regions_mask"] = regions_mask;
+        checks["grouping_regions_geometric"] = regions_geometric;
+        checks["grouping_agreement"] = regions_mask + regions_geometric > 0 ? 2 * regions_matched / (regions_mask + regions_geometric) : 1;
+        checks["capped_region_recall"] = regions_capped > 0 ? regions_capped_matched / regions_capped : 1;
+        if (!reduced.empty()) {
+            checks["reduced_boxes"] = boxes_reduced;
+            checks["reduced_box_agreement"] = boxes_full + boxes_reduced > 0 ? 2 * boxes_reduced_matched / (boxes_full + boxes_reduced) : 1;
+            checks["reduced_region_recall"] = regions_geometric > 0 ? regions_reduced_matched / regions_geometric : 1;
+        }
+        if (ocr) {
+            checks["ocr_lines_character_ratio"] = ocr_characters > 0 ? ocr_line_characters / ocr_characters : 1;
+            checks["ocr_panels"] = ocr_panels;
+            checks["ocr_reuse_mismatches"] = ocr_reuse_mismatches;
+            bench_require(failures, "ocr_reuse_mismatches == 0", ocr_reuse_mismatches == 0);
+        }
+        checks["prefilter_recall"] = prefilter_with_text > 0 ? prefilter_kept_with_text / prefilter_with_text : 1;
+    }
+    checks["prefilter_skipped"] = prefilter_skipped;
+    checks["prefilter_skipped_ratio"] = prefilter_panels > 0 ? prefilter_skipped / prefilter_panels : 0;
+    checks["stream_panels_emitted"] = panels_found > 0 ? stream_emitted / panels_found : 0;
+    checks["stream_peak_to_crops_bytes"] = crops_bytes > 0 ? stream_peak_bytes / crops_bytes : 0;
+    checks["allocations_per_page"] = allocations_page / options.pages;
+    checks["allocations_per_page_comic_data"] = allocations_comic_data / options.pages;
+    checks["incremental_full_passes"] = incremental_full;
+    checks["incremental_changed_panels"] = incremental_changed;
+    checks["strip_panels"] = strip_panels;
+    checks["strip_mismatches"] = strip_mismatches;
+    checks["strip_capped_oversized"] = strip_capped_oversized;
+    bench_require(failures, "strip_mismatches == 0", strip_mismatches == 0);
+    bench_require(failures, "strip_capped_oversized == 0", strip_capped_oversized == 0);
+    checks["incremental_splits"] = incremental_splits;
+    checks["incremental_splits_missed"] = incremental_splits_missed;
+    bench_require(failures, "incremental_splits_missed == 0", incremental_splits_missed == 0);
+    for (auto &item : info_bytes) checks["info_bytes_" + item.first] = item.second;
+    bench_info_checks(checks, failures);
+
+    if (options.model && options.threads > 0) bench_thread_sweep(options, stages, checks, failures);
+
+    checks["workspace_reused"] = ws->reused;
+    checks["workspace_allocated"] = ws->allocated;
+    checks["workspace_retained_bytes"] = workspace_retained_bytes(ws);
+
+    FILE* out = options.output ? fopen(options.output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Chopfox-Bench Error: Could not write %s\n", options.output);
+        return 1;
+    }
+
+    bench_write_json(out, options, stages, checks);
+
+    if (out != stdout) fclose(out);
+
+    simple_incremental_free(inc);
+    simple_processor_free(panel_proc);
+    workspace_free(ws);
+    ocr_engine_free(ocr);
+
+    for (auto &failure : failures) fprintf(stderr, "Chopfox-Bench Error: Check failed: %s\n", failure.c_str());
+
+    return failures.empty() ? 0 : 1;
+}
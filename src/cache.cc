@@ -0,0 +1,405 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "cache.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <assert.h>
+
+#define CACHE_MAGIC 0x43584643 // "CFXC"
+#define CACHE_VERSION 1
+#define CACHE_RESCAN_STORES 64 // Rescan the directory to see what other processes stored
+#define CACHE_TRIM_RATIO 0.9 // Trim to this fraction of max_bytes so the next stores don't evict again
+#define CACHE_STALE_TMP_SECONDS 3600 // Temporary files left behind by crashed processes
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+namespace fs = std::filesystem;
+
+namespace chopfox {
+    /// Hashing
+
+    static inline uint64_t rotl64 (uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static inline uint64_t read64 (const unsigned char* p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    static inline uint64_t xxh_round (uint64_t acc, uint64_t input) {
+        acc += input * XXH_P2;
+        acc = rotl64(acc, 31);
+        return acc * XXH_P1;
+    }
+
+    static inline uint64_t xxh_merge (uint64_t acc, uint64_t val) {
+        acc ^= xxh_round(0, val);
+        return acc * XXH_P1 + XXH_P4;
+    }
+
+    uint64_t result_cache_hash_bytes (const void* data, size_t length, uint64_t seed) {
+        const unsigned char* p = (const unsigned char*)data;
+        const unsigned char* end = p + length;
+        uint64_t h;
+
+        if (length >= 32) {
+            uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed, v4 = seed - XXH_P1;
+            for (; p + 32 <= end; p += 32) {
+                v1 = xxh_round(v1, read64(p));
+                v2 = xxh_round(v2, read64(p + 8));
+                v3 = xxh_round(v3, read64(p + 16));
+                v4 = xxh_round(v4, read64(p + 24));
+            }
+            h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+            h = xxh_merge(h, v1);
+            h = xxh_merge(h, v2);
+            h = xxh_merge(h, v3);
+            h = xxh_merge(h, v4);
+        } else {
+            h = seed + XXH_P5;
+        }
+
+        h += length;
+
+        for (; p + 8 <= end; p += 8) {
+            h ^= xxh_round(0, read64(p));
+            h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+        }
+        if (p + 4 <= end) {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            h ^= (uint64_t)v * XXH_P1;
+            h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= (*p) * XXH_P5;
+            h = rotl64(h, 11) * XXH_P1;
+        }
+
+        h ^= h >> 33;
+        h *= XXH_P2;
+        h ^= h >> 29;
+        h *= XXH_P3;
+        h ^= h >> 32;
+
+        return h;
+    }
+
+    uint64_t result_cache_hash_image (cv::Mat img, uint64_t seed) {
+        int header[3] = { img.rows, img.cols, img.type() };
+        uint64_t h = result_cache_hash_bytes(header, sizeof(header), seed);
+
+        if (img.isContinuous()) return result_cache_hash_bytes(img.data, img.total() * img.elemSize(), h);
+
+        size_t row_bytes = img.cols * img.elemSize();
+        for (int y = 0; y < img.rows; y++) h = result_cache_hash_bytes(img.ptr<uchar>(y), row_bytes, h);
+
+        return h;
+    }
+
+    /// Entries
+
+    static std::string cache_entry_path (struct ResultCache* cache, uint64_t key) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+
+        // Fan out over 256 directories so none of them gets too large
+        return (fs::path(cache->dir) / std::string(name, 2) / (std::string(name) + ".cfx")).string();
+    }
+
+    static void put_u32 (std::string& buffer, uint32_t value) {
+        buffer.append((const char*)&value, 4);
+    }
+
+    static void put_rect (std::string& buffer, const cv::Rect& rect) {
+        put_u32(buffer, rect.x);
+        put_u32(buffer, rect.y);
+        put_u32(buffer, rect.width);
+        put_u32(buffer, rect.height);
+    }
+
+    /**
+     * Bounds checked reader of an entry
+     */
+    struct EntryReader {
+        const unsigned char* p;
+        const unsigned char* end;
+        bool ok;
+    };
+
+    static uint32_t get_u32 (struct EntryReader& reader) {
+        if (reader.end - reader.p < 4) {
+            reader.ok = false;
+            return 0;
+        }
+        uint32_t value;
+        memcpy(&value, reader.p, 4);
+        reader.p += 4;
+        return value;
+    }
+
+    static cv::Rect get_rect (struct EntryReader& reader) {
+        int x = get_u32(reader), y = get_u32(reader), width = get_u32(reader), height = get_u32(reader);
+        return cv::Rect(x, y, width, height);
+    }
+
+    struct ResultCache* result_cache_open (const char* dir, size_t max_bytes) {
+        std::error_code error;
+        fs::create_directories(dir, error);
+        if (!fs::is_directory(dir, error)) return NULL;
+
+        struct ResultCache* cache = new struct ResultCache;
+
+        cache->dir = dir;
+        cache->max_bytes = max_bytes;
+        cache->estimated_bytes = 0;
+        cache->stores_since_scan = CACHE_RESCAN_STORES; // scan on the first store
+        cache->hits = 0;
+        cache->misses = 0;
+
+        return cache;
+    }
+
+    bool result_cache_load (
+        struct ResultCache* cache,
+        uint64_t key,
+        PanelArray& panels,
+        std::vector<std::vector<struct PageText>>& dialogue
+    ) {
+        std::string path = cache_entry_path(cache, key);
+
+        std::string buffer;
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file) {
+            char chunk[64 * 1024];
+            size_t length;
+            while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) buffer.append(chunk, length);
+            fclose(file);
+        }
+
+        // The payload is followed by its hash, truncated or corrupted entries are treated as misses
+        bool valid = buffer.size() >= 16;
+        if (valid) {
+            uint64_t stored;
+            memcpy(&stored, buffer.data() + buffer.size() - 8, 8);
+            valid = stored == result_cache_hash_bytes(buffer.data(), buffer.size() - 8);
+        }
+
+        struct EntryReader reader = { (const unsigned char*)buffer.data(), (const unsigned char*)buffer.data() + (valid ? buffer.size() - 8 : 0), valid };
+
+        if (valid && (get_u32(reader) != CACHE_MAGIC || get_u32(reader) != CACHE_VERSION)) reader.ok = false;
+
+        PanelArray loaded_panels;
+        std::vector<std::vector<struct PageText>> loaded_dialogue;
+
+        uint32_t panel_count = reader.ok ? get_u32(reader) : 0;
+        for (uint32_t i = 0; reader.ok && i < panel_count; i++) {
+            struct PanelInfo panel;
+            panel.bounding_box = get_rect(reader);
+            uint32_t points = get_u32(reader);
+            if (points > (size_t)(reader.end - reader.p) / 8) reader.ok = false;
+            for (uint32_t j = 0; reader.ok && j < points; j++) {
+                int x = get_u32(reader), y = get_u32(reader);
+                panel.contour.push_back(cv::Point(x, y));
+            }
+            loaded_panels.push_back(panel);
+        }
+
+        bool has_text = reader.ok && get_u32(reader) != 0;
+        for (uint32_t i = 0; has_text && reader.ok && i < panel_count; i++) {
+            std::vector<struct PageText> blocks;
+            uint32_t block_count = get_u32(reader);
+            for (uint32_t j = 0; reader.ok && j < block_count; j++) {
+                struct PageText block;
+                block.bounding_box = get_rect(reader);
+                uint32_t length = get_u32(reader);
+                if (!reader.ok || length > (size_t)(reader.end - reader.p)) {
+                    reader.ok = false;
+                    break;
+                }
+                block.text.assign((const char*)reader.p, length);
+                reader.p += length;
+                blocks.push_back(std::move(block));
+            }
+            loaded_dialogue.push_back(std::move(blocks));
+        }
+
+        if (!reader.ok) {
+            std::lock_guard<std::mutex> guard(cache->lock);
+            cache->misses++;
+            return false;
+        }
+
+        panels = std::move(loaded_panels);
+        dialogue = std::move(loaded_dialogue);
+
+        // The modification time orders the entries for eviction
+        std::error_code error;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->hits++;
+        return true;
+    }
+
+    bool result_cache_store (
+        struct ResultCache* cache,
+        uint64_t key,
+        const PanelArray& panels,
+        const std::vector<std::vector<struct PageText>>& dialogue
+    ) {
+        std::string buffer;
+        put_u32(buffer, CACHE_MAGIC);
+        put_u32(buffer, CACHE_VERSION);
+
+        put_u32(buffer, panels.size());
+        for (auto &panel : panels) {
+            put_rect(buffer, panel.bounding_box);
+            put_u32(buffer, panel.contour.size());
+            for (auto &point : panel.contour) {
+                put_u32(buffer, point.x);
+                put_u32(buffer, point.y);
+            }
+        }
+
+        bool has_text = !dialogue.empty();
+        assert(!has_text || dialogue.size() == panels.size());
+
+        put_u32(buffer, has_text ? 1 : 0);
+        for (auto &blocks : dialogue) {
+            put_u32(buffer, blocks.size());
+            for (auto &block : blocks) {
+                put_rect(buffer, block.bounding_box);
+                put_u32(buffer, block.text.size());
+                buffer.append(block.text);
+            }
+        }
+
+        uint64_t check = result_cache_hash_bytes(buffer.data(), buffer.size());
+        buffer.append((const char*)&check, 8);
+
+        std::string path = cache_entry_path(cache, key);
+
+        std::error_code error;
+        fs::create_directories(fs::path(path).parent_path(), error);
+
+        // Unique name per process & thread, readers only ever see complete entries
+        std::string tmp_path = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+        FILE* file = fopen(tmp_path.c_str(), "wb");
+        if (!file) return false;
+
+        bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        written = fclose(file) == 0 && written;
+
+        if (!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            remove(tmp_path.c_str());
+            return false;
+        }
+
+        bool evict;
+        {
+            std::lock_guard<std::mutex> guard(cache->lock);
+            cache->estimated_bytes += buffer.size();
+            cache->stores_since_scan++;
+            evict = cache->max_bytes > 0 && (cache->estimated_bytes > cache->max_bytes || cache->stores_since_scan >= CACHE_RESCAN_STORES);
+        }
+
+        if (evict) result_cache_evict(cache);
+
+        return true;
+    }
+
+    struct CacheFile {
+        fs::path path;
+        fs::file_time_type time;
+        size_t size;
+    };
+
+    void result_cache_evict (struct ResultCache* cache) {
+        std::string lock_path = (fs::path(cache->dir) / ".lock").string();
+        int lock_fd = open(lock_path.c_str(), O_CREAT | O_RDWR, 0644);
+        if (lock_fd < 0) return;
+
+        // Another process is already trimming the cache
+        if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+            close(lock_fd);
+            return;
+        }
+
+        std::vector<struct CacheFile> files;
+        size_t total = 0;
+        fs::file_time_type now = fs::file_time_type::clock::now();
+
+        std::error_code error;
+        for (fs::recursive_directory_iterator it(cache->dir, error), end; !error && it != end; it.increment(error)) {
+            if (!it->is_regular_file(error)) continue;
+
+            fs::path path = it->path();
+            fs::file_time_type time = fs::last_write_time(path, error);
+            if (error) continue;
+
+            if (path.extension() == ".cfx") {
+                struct CacheFile file = { path, time, (size_t)fs::file_size(path, error) };
+                if (error) continue;
+                files.push_back(file);
+                total += file.size;
+            } else if (path.filename().string().find(".cfx.tmp.") != std::string::npos && now - time > std::chrono::seconds(CACHE_STALE_TMP_SECONDS)) {
+                fs::remove(path, error);
+            }
+            error.clear();
+        }
+
+        if (total > cache->max_bytes) {
+            std::sort(files.begin(), files.end(), [] (const struct CacheFile& a, const struct CacheFile& b) {
+                return a.time < b.time;
+            });
+
+            size_t target = cache->max_bytes * CACHE_TRIM_RATIO;
+            for (auto &file : files) {
+                if (total <= target) break;
+                // Readers that already opened the entry keep reading it
+                if (fs::remove(file.path, error)) total -= file.size;
+            }
+        }
+
+        flock(lock_fd, LOCK_UN);
+        close(lock_fd);
+
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->estimated_bytes = total;
+        cache->stores_since_scan = 0;
+    }
+
+    void result_cache_close (struct ResultCache* cache) {
+        delete cache;
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "extract.hpp"
+#include "text_detect.hpp"
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+namespace chopfox {
+    /**
+     * On-disk cache of extraction results keyed by a hash of the page pixels and the processing parameters
+     * Entries are written to a temporary file and renamed into place, so several processes can share a cache directory.
+     */
+    struct ResultCache {
+        std::string dir;
+        size_t max_bytes; // Size the cache is trimmed to when it grows past it (0 for no limit)
+        std::mutex lock;
+        size_t estimated_bytes; // Size of the cache when it was last scanned plus what this process stored since
+        int stores_since_scan;
+        size_t hits;
+        size_t misses;
+    };
+
+    /**
+     * Open (and create) a cache directory
+     * @param dir The directory to keep the entries in
+     * @param max_bytes The max size of the cache, the least recently used entries are removed past it (0 for no limit)
+     * @returns The cache or NULL if the directory could not be created
+     * @remarks Close the cache with result_cache_close
+     */
+    struct ResultCache* result_cache_open (const char* dir, size_t max_bytes);
+
+    /**
+     * Hash a block of memory (XXH64)
+     * @param data The memory to hash
+     * @param length The size of data in bytes
+     * @param seed Hash of the previous data when hashing several blocks
+     * @returns The 64 bit hash
+     */
+    uint64_t result_cache_hash_bytes (const void* data, size_t length, uint64_t seed = 0);
+
+    /**
+     * Hash the size, type and pixels of an image
+     * @param img The image to hash
+     * @param seed Usually the hash of the parameters the image is processed with
+     * @returns The 64 bit hash
+     */
+    uint64_t result_cache_hash_image (cv::Mat img, uint64_t seed = 0);
+
+    /**
+     * Read an entry from the cache
+     * @param cache The cache to read from
+     * @param key The key of the entry, usually from result_cache_hash_image
+     * @param panels The panels that were stored
+     * @param dialogue The text of every panel that was stored (empty if it was stored without text)
+     * @returns false if there is no valid entry for the key
+     */
+    bool result_cache_load (
+        struct ResultCache* cache,
+        uint64_t key,
+        PanelArray& panels,
+        std::vector<std::vector<struct PageText>>& dialogue
+    );
+
+    /**
+     * Write an entry to the cache, replacing any existing one, and trim the cache if it grew too large
+     * @param cache The cache to write to
+     * @param key The key of the entry
+     * @param panels The panels to store
+     * @param dialogue The text of every panel (empty to store the panels only)
+     * @returns false if the entry could not be written
+     */
+    bool result_cache_store (
+        struct ResultCache* cache,
+        uint64_t key,
+        const PanelArray& panels,
+        const std::vector<std::vector<struct PageText>>& dialogue
+    );
+
+    /**
+     * Remove the least recently used entries until the cache fits in max_bytes
+     * Skipped if another process is already trimming the cache.
+     * @param cache The cache to trim
+     */
+    void result_cache_evict (struct ResultCache* cache);
+
+    /**
+     * Free the cache, the entries stay on disk
+     * @param cache The cache to close
+     */
+    void result_cache_close (struct ResultCache* cache);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLI_H
+#define CLI_H
+
+#include <string>
+#include <algorithm>
+
+namespace chopfox {
+    /**
+     * Get the value following an option on the command line
+     * @param begin The first argument
+     * @param end Past the last argument
+     * @param option The option, like --pages
+     * @returns The value or NULL if the option or its value is missing
+     */
+    inline char* getCmdOption (char** begin, char** end, const std::string& option) {
+        char** itr = std::find(begin, end, option);
+        if (itr != end && ++itr != end) {
+            return *itr;
+        }
+        return 0;
+    }
+
+    /**
+     * Check whether a flag is on the command line
+     * @param begin The first argument
+     * @param end Past the last argument
+     * @param option The flag, like --chop
+     * @returns true if the flag was given
+     */
+    inline bool cmdOptionExists (char** begin, char** end, const std::string& option) {
+        return std::find(begin, end, option) != end;
+    }
+}
+
+#endif
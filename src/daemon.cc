@@ -0,0 +1,411 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "daemon.hpp"
+#include "decode.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <set>
+#include <exception>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#define DAEMON_LATENCY_WINDOW 10000 // Latest requests the percentiles are computed on
+
+namespace chopfox {
+    struct DaemonState {
+        struct SimpleProcessor* proc;
+        struct DaemonOptions* options;
+        std::mutex lock;
+        std::condition_variable changed;
+        int active_jobs;
+        int waiting_jobs;
+        int connections;
+        std::set<int> client_fds;
+        size_t requests;
+        size_t failed;
+        double wait_ms; // Total time spent waiting for a job slot
+        std::vector<double> latencies; // Ring of the latest request latencies in ms
+        size_t next_latency;
+        int64_t started;
+    };
+
+    static volatile sig_atomic_t daemon_stopping = 0;
+    static int daemon_listen_fd = -1;
+
+    static void daemon_signal (int) {
+        daemon_stopping = 1;
+        if (daemon_listen_fd >= 0) shutdown(daemon_listen_fd, SHUT_RDWR); // wakes up accept
+    }
+
+    /// Framing
+
+    static bool read_full (int fd, void* data, size_t length) {
+        char* p = (char*)data;
+        while (length > 0) {
+            ssize_t n = recv(fd, p, length, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    static bool write_full (int fd, const void* data, size_t length) {
+        const char* p = (const char*)data;
+        while (length > 0) {
+            ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    static bool read_message (int fd, std::string& payload) {
+        uint32_t length;
+        if (!read_full(fd, &length, 4) || length > DAEMON_MAX_MESSAGE) return false;
+        payload.resize(length);
+        return read_full(fd, &payload[0], length);
+    }
+
+    static bool write_message (int fd, const std::string& header, const std::string& body) {
+        uint32_t length = header.size() + body.size();
+        return write_full(fd, &length, 4) && write_full(fd, header.data(), header.size()) && write_full(fd, body.data(), body.size());
+    }
+
+    /// Server
+
+    static double daemon_percentile (std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::max((size_t)1, rank) - 1];
+    }
+
+    static std::string daemon_stats_json (struct DaemonState* state) {
+        std::lock_guard<std::mutex> guard(state->lock);
+
+        std::vector<double> sorted = state->latencies;
+        std::sort(sorted.begin(), sorted.end());
+
+        double mean = 0;
+        for (auto &ms : sorted) mean += ms;
+        if (!sorted.empty()) mean /= sorted.size();
+
+        char json[512];
+        snprintf(json, sizeof(json),
+            "{\"uptime_s\":%.1f,\"requests\":%d,\"failed\":%d,\"active_jobs\":%d,\"waiting_jobs\":%d,\"connections\":%d,\"max_jobs\":%d,"
+            "\"latency_ms\":{\"samples\":%d,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},\"mean_wait_ms\":%.3f}",
+            (cv::getTickCount() - state->started) / cv::getTickFrequency(), (int)state->requests, (int)state->failed,
+            state->active_jobs, state->waiting_jobs, state->connections, state->options->max_jobs,
+            (int)sorted.size(), mean, daemon_percentile(sorted, 50), daemon_percentile(sorted, 90), daemon_percentile(sorted, 99),
+            sorted.empty() ? 0.0 : sorted.back(), state->requests ? state->wait_ms / state->requests : 0.0);
+
+        return json;
+    }
+
+    static void daemon_record (struct DaemonState* state, int64_t start, bool ok) {
+        double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->requests++;
+        if (!ok) state->failed++;
+        if (state->latencies.size() < DAEMON_LATENCY_WINDOW) state->latencies.push_back(ms);
+        else state->latencies[state->next_latency] = ms;
+        state->next_latency = (state->next_latency + 1) % DAEMON_LATENCY_WINDOW;
+    }
+
+    /**
+     * One of the max_jobs slots, held from decoding the image to writing the response so the decoded pages are bounded too
+     */
+    struct DaemonSlot {
+        struct DaemonState* state;
+
+        DaemonSlot (struct DaemonState* state) : state(state) {
+            int64_t wait_start = cv::getTickCount();
+            std::unique_lock<std::mutex> guard(state->lock);
+            state->waiting_jobs++;
+            while (state->active_jobs >= state->options->max_jobs) state->changed.wait(guard);
+            state->waiting_jobs--;
+            state->active_jobs++;
+            state->wait_ms += (cv::getTickCount() - wait_start) * 1000.0 / cv::getTickFrequency();
+        }
+
+        ~DaemonSlot () {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->active_jobs--;
+            state->changed.notify_all();
+        }
+    };
+
+    /**
+     * Process a page request, waiting for a job slot first
+     */
+    static enum DaemonStatus daemon_page (struct DaemonState* state, const std::string& payload, std::string& body) {
+        enum DaemonRequestKind kind = (enum DaemonRequestKind)payload[0];
+        uint8_t format_byte = payload[1];
+        uint8_t flags = payload[2];
+
+        if (format_byte > INFO_FORMAT_BINARY) {
+            body = "Unknown info format";
+            return DAEMON_ERROR;
+        }
+        enum InfoFormat format = (enum InfoFormat)format_byte;
+
+        bool include_text = (flags & DAEMON_FLAG_TEXT) != 0;
+        if (include_text && !state->options->allow_text) {
+            body = "The daemon was started without text extraction";
+            return DAEMON_ERROR;
+        }
+
+        struct DaemonSlot slot(state);
+
+        // Without text only the geometry is needed
+        enum DecodeMode mode = include_text ? DECODE_COLOR : state->options->decode_reduce <= 1 ? DECODE_UNCHANGED : DECODE_GRAY;
+        int reduce = mode == DECODE_GRAY ? state->options->decode_reduce : 1;
+
+        std::string path;
+        struct SimplePageData page;
+        enum DaemonStatus status = DAEMON_OK;
+
+        // Decoding runs on the connection thread as well, a corrupt image must not take the daemon down
+        try {
+            cv::Mat img;
+            cv::Size full_size;
+            if (kind == DAEMON_REQUEST_PATH) {
+                path = payload.substr(3);
+                img = decode_image_file(path.c_str(), mode, reduce, &full_size);
+            } else if (payload.size() > 3) {
+                img = decode_image(payload.data() + 3, payload.size() - 3, mode, reduce, &full_size);
+            }
+
+            if (img.empty()) {
+                body = "Invalid input image";
+                return DAEMON_ERROR;
+            }
+
+            simple_process_page(state->proc, img, &page, include_text);
+            simple_data_rescale(&page, img.size(), full_size);
+
+            struct InfoWriter* writer = info_writer_open_buffer(&body, format);
+            simple_write_info(writer, path.c_str(), page, include_text, (flags & DAEMON_FLAG_CONTOUR) != 0);
+            info_writer_close(writer);
+        } catch (const std::exception& error) {
+            body = error.what();
+            status = DAEMON_ERROR;
+        } catch (...) {
+            body = "Processing failed";
+            status = DAEMON_ERROR;
+        }
+
+        simple_data_free(page);
+
+        return status;
+    }
+
+    static void daemon_connection (struct DaemonState* state, int fd) {
+        std::string payload;
+
+        while (read_message(fd, payload)) {
+            int64_t start = cv::getTickCount();
+            std::string body;
+            enum DaemonStatus status;
+
+            if (payload.size() < 3) {
+                status = DAEMON_ERROR;
+                body = "Malformed request";
+            } else if (payload[0] == DAEMON_REQUEST_STATS) {
+                status = DAEMON_OK;
+                body = daemon_stats_json(state);
+            } else if (payload[0] == DAEMON_REQUEST_PATH || payload[0] == DAEMON_REQUEST_BYTES) {
+                status = daemon_page(state, payload, body);
+                daemon_record(state, start, status == DAEMON_OK);
+                if (state->proc->log_level >= 1) printf("[Chopfox] Request done in %.2fms\n", (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+            } else {
+                status = DAEMON_ERROR;
+                body = "Unknown request";
+            }
+
+            if (!write_message(fd, std::string(1, (char)status), body)) break;
+        }
+
+        // Notified under the lock, daemon_serve frees the state as soon as it sees the last connection gone
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->client_fds.erase(fd);
+        close(fd);
+        state->connections--;
+        state->changed.notify_all();
+    }
+
+    bool daemon_serve (struct SimpleProcessor* proc, struct DaemonOptions* options) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (strlen(options->socket_path) >= sizeof(addr.sun_path)) {
+            printf("[Chopfox] Socket path too long: %s\n", options->socket_path);
+            return false;
+        }
+        strcpy(addr.sun_path, options->socket_path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+
+        // Only a socket left behind by a previous daemon is removed, never a file given by mistake
+        struct stat existing;
+        if (lstat(options->socket_path, &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode)) {
+                printf("[Chopfox] %s exists and is not a socket\n", options->socket_path);
+                close(fd);
+                return false;
+            }
+            unlink(options->socket_path);
+        }
+
+        // Path requests open files with the daemon's privileges, so only its own user may connect
+        mode_t mask = umask(0077);
+        int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+        umask(mask);
+        if (bound != 0 || listen(fd, 64) != 0) {
+            printf("[Chopfox] Could not listen on %s: %s\n", options->socket_path, strerror(errno));
+            close(fd);
+            return false;
+        }
+
+        struct DaemonState state;
+        state.proc = proc;
+        state.options = options;
+        state.active_jobs = 0;
+        state.waiting_jobs = 0;
+        state.connections = 0;
+        state.requests = 0;
+        state.failed = 0;
+        state.wait_ms = 0;
+        state.next_latency = 0;
+        state.started = cv::getTickCount();
+
+        if (options->max_jobs < 1) options->max_jobs = 1;
+        if (options->max_connections < options->max_jobs) options->max_connections = options->max_jobs;
+
+        // Every job runs its text stage on a single worker, the jobs are the unit of parallelism
+        if (options->allow_text) simple_processor_set_workers(proc, options->max_jobs);
+        proc->text_workers = 1;
+
+        daemon_stopping = 0;
+        daemon_listen_fd = fd;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = daemon_signal; // no SA_RESTART so accept is interrupted
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+
+        printf("[Chopfox] Listening on %s, %d jobs at once\n", options->socket_path, options->max_jobs);
+        fflush(stdout);
+
+        while (!daemon_stopping) {
+            // Every connection may hold a request of up to DAEMON_MAX_MESSAGE, further clients wait in the listen backlog
+            {
+                std::unique_lock<std::mutex> guard(state.lock);
+                while (state.connections >= options->max_connections && !daemon_stopping) state.changed.wait_for(guard, std::chrono::milliseconds(100));
+            }
+            if (daemon_stopping) break;
+
+            int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (!daemon_stopping) printf("[Chopfox] Accept failed: %s\n", strerror(errno));
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(state.lock);
+                state.client_fds.insert(client);
+                state.connections++;
+            }
+            std::thread(daemon_connection, &state, client).detach();
+        }
+
+        daemon_listen_fd = -1;
+        close(fd);
+        unlink(options->socket_path);
+
+        // Idle connections stop reading, the requests being processed still get their response
+        {
+            std::unique_lock<std::mutex> guard(state.lock);
+            for (auto &client : state.client_fds) shutdown(client, SHUT_RD);
+            while (state.connections > 0) state.changed.wait(guard);
+        }
+
+        printf("[Chopfox] Stopped: %s\n", daemon_stats_json(&state).c_str());
+
+        return true;
+    }
+
+    /// Client
+
+    enum DaemonStatus daemon_request (
+        const char* socket_path,
+        enum DaemonRequestKind kind,
+        const std::string& data,
+        enum InfoFormat format,
+        uint8_t flags,
+        std::string& response
+    ) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            response = std::string("Could not connect to ") + socket_path + ": " + strerror(errno);
+            if (fd >= 0) close(fd);
+            return DAEMON_ERROR;
+        }
+
+        std::string header;
+        header += (char)kind;
+        header += (char)format;
+        header += (char)flags;
+
+        std::string payload;
+        bool ok = write_message(fd, header, data) && read_message(fd, payload) && !payload.empty();
+        close(fd);
+
+        if (!ok) {
+            response = "The daemon closed the connection";
+            return DAEMON_ERROR;
+        }
+
+        response = payload.substr(1);
+        return (enum DaemonStatus)payload[0];
+    }
+}
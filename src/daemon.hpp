@@ -0,0 +1,84 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "simple.hpp"
+#include <stdint.h>
+#include <string>
+
+namespace chopfox {
+    /**
+     * What a daemon request carries
+     *
+     * Every message is a little endian uint32 length followed by the payload, a connection may send several requests one after the other.
+     * Request payload: kind byte, InfoFormat byte, flags byte (DAEMON_FLAG_*), then the path or the encoded image bytes (empty for stats)
+     * Response payload: DaemonStatus byte, then the page info in the requested format, the stats as JSON or the error message
+     */
+    enum DaemonRequestKind {
+        DAEMON_REQUEST_PATH = 1, // Image file readable by the daemon
+        DAEMON_REQUEST_BYTES = 2, // Encoded image (PNG, JPEG, ...)
+        DAEMON_REQUEST_STATS = 3
+    };
+
+    enum DaemonStatus {
+        DAEMON_OK = 0,
+        DAEMON_ERROR = 1
+    };
+
+    #define DAEMON_FLAG_TEXT 1
+    #define DAEMON_FLAG_CONTOUR 2
+    #define DAEMON_MAX_MESSAGE (256 * 1024 * 1024)
+
+    struct DaemonOptions {
+        const char* socket_path;
+        int max_jobs; // Pages decoded & processed at once, further requests wait for a slot
+        int max_connections; // Clients connected at once (at least max_jobs), further clients wait to be accepted
+        bool allow_text; // false when the daemon was started without a text model
+        int decode_reduce; // Requests without text are decoded at 1/2, 1/4 or 1/8 of the resolution (1 disables)
+    };
+
+    /**
+     * Accept requests on a Unix domain socket until SIGINT or SIGTERM, processing them with an already loaded processor
+     * @param proc The processor to use, shared by all the requests
+     * @param options The daemon options
+     * @returns false if the socket could not be created
+     */
+    bool daemon_serve (struct SimpleProcessor* proc, struct DaemonOptions* options);
+
+    /**
+     * Send a request to a running daemon and wait for the response
+     * @param socket_path The socket the daemon listens on
+     * @param kind What data holds
+     * @param data The image path or encoded image bytes
+     * @param format The format of the page info to return
+     * @param flags DAEMON_FLAG_* options of the request
+     * @param response The page info, stats or error message
+     * @returns The status of the response, DAEMON_ERROR with a message if the daemon could not be reached
+     */
+    enum DaemonStatus daemon_request (
+        const char* socket_path,
+        enum DaemonRequestKind kind,
+        const std::string& data,
+        enum InfoFormat format,
+        uint8_t flags,
+        std::string& response
+    );
+}
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "decode.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace chopfox {
+    static uint32_t read_be32 (const unsigned char* p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    static uint16_t read_be16 (const unsigned char* p) {
+        return ((uint16_t)p[0] << 8) | p[1];
+    }
+
+    static bool png_size (const unsigned char* p, size_t size, cv::Size* image_size) {
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        if (size < 24 || memcmp(p, signature, 8) != 0 || memcmp(p + 12, "IHDR", 4) != 0) return false;
+
+        *image_size = cv::Size(read_be32(p + 16), read_be32(p + 20));
+        return image_size->width > 0 && image_size->height > 0;
+    }
+
+    static bool jpeg_size (const unsigned char* p, size_t size, cv::Size* image_size) {
+        if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+
+        // Walk the marker segments up to the frame header (SOFn)
+        size_t offset = 2;
+        while (offset + 4 <= size) {
+            if (p[offset] != 0xFF) return false;
+
+            unsigned char marker = p[offset + 1];
+            if (marker == 0xFF) {
+                offset++; // fill byte
+                continue;
+            }
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+                offset += 2; // markers without a segment
+                continue;
+            }
+            if (marker == 0xDA || marker == 0xD9) return false; // scan data before any frame header
+
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+                if (offset + 9 > size) return false;
+                *image_size = cv::Size(read_be16(p + offset + 7), read_be16(p + offset + 5));
+                return image_size->width > 0 && image_size->height > 0;
+            }
+
+            offset += 2 + read_be16(p + offset + 2);
+        }
+
+        return false;
+    }
+
+    bool decode_image_size (const void* data, size_t size, cv::Size* image_size) {
+        const unsigned char* p = (const unsigned char*)data;
+        return png_size(p, size, image_size) || jpeg_size(p, size, image_size);
+    }
+
+    static int decode_flags (enum DecodeMode mode, int reduce) {
+        if (mode == DECODE_UNCHANGED) return cv::IMREAD_UNCHANGED;
+
+        bool gray = mode == DECODE_GRAY;
+        if (reduce >= 8) return gray ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+        if (reduce >= 4) return gray ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+        if (reduce >= 2) return gray ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+        return gray ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+    }
+
+    /**
+     * Reduce 16 bit & float images to 8 bits, the only conversion left after decoding
+     */
+    static void decode_depth (cv::Mat& img) {
+        if (img.depth() == CV_16U) img.convertTo(img, CV_8U, 1.0 / 256);
+        else if (img.depth() == CV_32F || img.depth() == CV_64F) img.convertTo(img, CV_8U, 255.0);
+        else if (img.depth() != CV_8U) img.convertTo(img, CV_8U);
+    }
+
+    cv::Mat decode_image (const void* data, size_t size, enum DecodeMode mode, int reduce, cv::Size* full_size) {
+        if (!data || size == 0 || size > INT_MAX) return cv::Mat();
+
+        // Without the full size the geometry couldn't be mapped back exactly, so those images are decoded at full resolution
+        cv::Size header_size;
+        if (reduce > 1 && (mode == DECODE_UNCHANGED || !decode_image_size(data, size, &header_size))) reduce = 1;
+
+        cv::Mat img = cv::imdecode(cv::Mat(1, (int)size, CV_8UC1, (void*)data), decode_flags(mode, reduce));
+        if (img.empty()) return img;
+
+        decode_depth(img);
+
+        if (full_size) {
+            *full_size = img.size();
+            if (reduce > 1) {
+                // The decoder applies the EXIF orientation, the header has the size before the rotation
+                bool rotated = abs(img.cols - header_size.width / reduce) > 1 && abs(img.cols - header_size.height / reduce) <= 1;
+                *full_size = rotated ? cv::Size(header_size.height, header_size.width) : header_size;
+            }
+        }
+
+        return img;
+    }
+
+    cv::Mat decode_image_file (const char* path, enum DecodeMode mode, int reduce, cv::Size* full_size) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return cv::Mat();
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            close(fd);
+            return cv::Mat();
+        }
+
+        void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file open
+
+        if (mapped == MAP_FAILED) return cv::Mat();
+
+        cv::Mat img = decode_image(mapped, info.st_size, mode, reduce, full_size);
+
+        munmap(mapped, info.st_size);
+
+        return img;
+    }
+
+    bool decode_image_frames_file (const char* path, std::vector<cv::Mat>& frames, enum DecodeMode mode) {
+        frames.clear();
+        if (!cv::imreadmulti(path, frames, decode_flags(mode, 1)) || frames.empty()) return false;
+
+        for (auto &frame : frames) decode_depth(frame);
+
+        return true;
+    }
+}
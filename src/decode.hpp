@@ -0,0 +1,76 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <opencv2/core.hpp>
+#include <stddef.h>
+#include <vector>
+
+namespace chopfox {
+    /**
+     * Pixel format the decoded image is normalized to while decoding
+     */
+    enum DecodeMode {
+        DECODE_UNCHANGED, // Channels as stored (gray, BGR or BGRA), deeper images are reduced to 8 bits
+        DECODE_COLOR, // Always 8 bit BGR, the alpha channel is dropped by the decoder
+        DECODE_GRAY // 8 bit grayscale, enough to find the panel geometry
+    };
+
+    /**
+     * Decode an encoded image (PNG, JPEG, ...) straight from memory
+     * @param data The encoded bytes, only read during the call
+     * @param size The amount of bytes
+     * @param mode The pixel format to decode to
+     * @param reduce Decode at 1/2, 1/4 or 1/8 of the resolution (JPEG uses DCT scaling, other formats are resized after decoding).
+     *               Ignored with DECODE_UNCHANGED, and for formats whose size can't be read from the header (PNG & JPEG are supported).
+     * @param full_size Set to the size of the image at full resolution (optional)
+     * @returns The image, empty if it could not be decoded
+     */
+    cv::Mat decode_image (const void* data, size_t size, enum DecodeMode mode = DECODE_UNCHANGED, int reduce = 1, cv::Size* full_size = NULL);
+
+    /**
+     * Decode an image file, the file is memory mapped instead of read into a buffer
+     * @param path The image file
+     * @param mode The pixel format to decode to
+     * @param reduce See decode_image
+     * @param full_size Set to the size of the image at full resolution (optional)
+     * @returns The image, empty if it could not be read or decoded
+     */
+    cv::Mat decode_image_file (const char* path, enum DecodeMode mode = DECODE_UNCHANGED, int reduce = 1, cv::Size* full_size = NULL);
+
+    /**
+     * Decode every frame of a multi page image file (animated GIF, multi page TIFF, ...)
+     * @param path The image file
+     * @param frames The frames are stored in it, normalized like decode_image
+     * @param mode The pixel format to decode to
+     * @returns false if the file could not be read or has no frames
+     */
+    bool decode_image_frames_file (const char* path, std::vector<cv::Mat>& frames, enum DecodeMode mode = DECODE_UNCHANGED);
+
+    /**
+     * Read the size of an image from its header without decoding it
+     * @param data The encoded bytes
+     * @param size The amount of bytes
+     * @param image_size The size stored in the header, before any EXIF rotation
+     * @returns false if the format isn't PNG or JPEG, or the header is truncated
+     */
+    bool decode_image_size (const void* data, size_t size, cv::Size* image_size);
+}
+
+#endif
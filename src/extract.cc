@@ -16,25 +16,215 @@
  */
 
 #include "extract.hpp"
+#include <opencv2/core/hal/intrin.hpp>
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#define EDGE_THRESHOLD 50
+#define EDGE_BAND_BYTES (256 * 1024) // Keep the intermediates of a band in L2
+#define REFINE_TILE 32 // Size of the full resolution tiles processed around a coarse contour
 
 namespace chopfox {
-    PanelArray get_panels_rgb (cv::Mat img, double precision, double min_area_divider) {
-        assert(!img.empty());
+    /**
+     * Same as BORDER_REFLECT_101 (the default border of Laplacian)
+     */
+    static inline int reflect_101 (int i, int n) {
+        if (n == 1) return 0;
+        while (i < 0 || i >= n) i = i < 0 ? -i : 2 * n - 2 - i;
+        return i;
+    }
+
+#if CV_SIMD
+    /**
+     * Gray of 16 bit B, G & R lanes, (b * 1868 + g * 9617 + r * 4899 + 2^13) >> 14 in 32 bit lanes
+     */
+    static inline cv::v_uint16 gray_lanes (const cv::v_uint16& b, const cv::v_uint16& g, const cv::v_uint16& r) {
+        const cv::v_uint32 cb = cv::v_setall_u32(1868), cg = cv::v_setall_u32(9617), cr = cv::v_setall_u32(4899), half = cv::v_setall_u32(1 << 13);
+        cv::v_uint32 b0, b1, g0, g1, r0, r1;
+        cv::v_expand(b, b0, b1);
+        cv::v_expand(g, g0, g1);
+        cv::v_expand(r, r0, r1);
+        cv::v_uint32 y0 = cv::v_shr<14>(b0 * cb + g0 * cg + r0 * cr + half);
+        cv::v_uint32 y1 = cv::v_shr<14>(b1 * cb + g1 * cg + r1 * cr + half);
+        return cv::v_pack(y0, y1);
+    }
+
+    static inline cv::v_uint8 gray_lanes (const cv::v_uint8& b, const cv::v_uint8& g, const cv::v_uint8& r) {
+        cv::v_uint16 b0, b1, g0, g1, r0, r1;
+        cv::v_expand(b, b0, b1);
+        cv::v_expand(g, g0, g1);
+        cv::v_expand(r, r0, r1);
+        return cv::v_pack(gray_lanes(b0, g0, r0), gray_lanes(b1, g1, r1));
+    }
+#endif
+
+    /**
+     * Convert columns [c0, c1) of row y to gray, indices outside of the image are reflected
+     * Uses the same fixed point coefficients as cvtColor(COLOR_BGR2GRAY)
+     */
+    static void gray_row (const cv::Mat& src, int y, int c0, int c1, uchar* out) {
+        const uchar* row = src.ptr<uchar>(reflect_101(y, src.rows));
+        const int cn = src.channels();
+        const int inner0 = std::max(c0, 0), inner1 = std::min(c1, src.cols);
+
+        uchar* dst = out + (inner0 - c0);
+        const uchar* px = row + inner0 * cn;
+        const int n = inner1 - inner0;
+
+        if (cn == 1) {
+            memcpy(dst, px, n);
+        } else if (cn == 3) {
+            int x = 0;
+#if CV_SIMD
+            for (; x <= n - CV_SIMD_WIDTH; x += CV_SIMD_WIDTH) {
+                cv::v_uint8 b, g, r;
+                cv::v_load_deinterleave(px + x * 3, b, g, r);
+                cv::v_store(dst + x, gray_lanes(b, g, r));
+            }
+#endif
+            for (; x < n; x++) dst[x] = (uchar)((px[x*3] * 1868 + px[x*3+1] * 9617 + px[x*3+2] * 4899 + (1 << 13)) >> 14);
+        } else {
+            int x = 0;
+#if CV_SIMD
+            for (; x <= n - CV_SIMD_WIDTH; x += CV_SIMD_WIDTH) {
+                cv::v_uint8 b, g, r, a;
+                cv::v_load_deinterleave(px + x * 4, b, g, r, a);
+                cv::v_store(dst + x, gray_lanes(b, g, r));
+            }
+#endif
+            for (; x < n; x++) dst[x] = (uchar)((px[x*4] * 1868 + px[x*4+1] * 9617 + px[x*4+2] * 4899 + (1 << 13)) >> 14);
+        }
+
+        for (int x = c0; x < c1; x++) {
+            if (x == inner0) x = inner1; // only the pixels outside the image are left
+            if (x >= c1) break;
+            const uchar* p = row + reflect_101(x, src.cols) * cn;
+            out[x - c0] = cn == 1 ? p[0] : (uchar)((p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + (1 << 13)) >> 14);
+        }
+    }
+
+    /**
+     * Generate rows [y0, y1) of the edge mask for columns [x0, x1), writing to dst (relative to roi)
+     */
+    static void panel_edge_mask_band (const cv::Mat& src, cv::Mat& dst, cv::Rect roi, int y0, int y1, std::vector<uchar>& buffer) {
+        const int W = src.cols, H = src.rows;
+        const int x0 = roi.x, x1 = roi.x + roi.width;
+
+        // Thresholded laplacian needed by the dilation, clamped to the image (dilation ignores the border)
+        const int l0 = std::max(x0 - 1, 0), l1 = std::min(x1 + 1, W);
+        const int t0 = std::max(y0 - 1, 0), t1 = std::min(y1 + 1, H);
+        const int lw = l1 - l0;
+
+        // Gray needed by the laplacian, one extra pixel on every side (reflected at the border)
+        const int gw = lw + 2;
+        const int grows = t1 - t0 + 2;
+
+        buffer.resize(grows * gw + (t1 - t0) * lw + lw + 2);
+        uchar* gray = buffer.data();
+        uchar* thresh = gray + grows * gw;
+
+        // The mask is never negative, so zero padding has the same effect as ignoring pixels outside the image
+        uchar* vmax = thresh + (t1 - t0) * lw + 1;
+        vmax[-1] = vmax[lw] = 0;
+
+        for (int y = t0 - 1; y <= t1; y++) gray_row(src, y, l0 - 1, l1 + 1, gray + (y - t0 + 1) * gw);
+
+        for (int y = t0; y < t1; y++) {
+            const uchar* up = gray + (y - t0) * gw + 1;
+            const uchar* mid = up + gw;
+            const uchar* down = mid + gw;
+            uchar* out = thresh + (y - t0) * lw;
+            int x = 0;
+#if CV_SIMD
+            // 16 bit lanes: the laplacian of 8 bit pixels is within [-1020, 1020]
+            const cv::v_int16 threshold = cv::v_setall_s16(EDGE_THRESHOLD);
+            for (; x <= lw - CV_SIMD_WIDTH; x += CV_SIMD_WIDTH) {
+                cv::v_uint16 u0, u1, d0, d1, l0, l1, r0, r1, m0, m1;
+                cv::v_expand(cv::vx_load(up + x), u0, u1);
+                cv::v_expand(cv::vx_load(down + x), d0, d1);
+                cv::v_expand(cv::vx_load(mid + x - 1), l0, l1);
+                cv::v_expand(cv::vx_load(mid + x + 1), r0, r1);
+                cv::v_expand(cv::vx_load(mid + x), m0, m1);
+                cv::v_int16 lap0 = cv::v_reinterpret_as_s16(u0 + d0 + l0 + r0) - cv::v_shl<2>(cv::v_reinterpret_as_s16(m0));
+                cv::v_int16 lap1 = cv::v_reinterpret_as_s16(u1 + d1 + l1 + r1) - cv::v_shl<2>(cv::v_reinterpret_as_s16(m1));
+                // The comparison gives -1 lanes, packed to 0xFF bytes
+                cv::v_store(out + x, cv::v_reinterpret_as_u8(cv::v_pack(lap0 > threshold, lap1 > threshold)));
+            }
+#endif
+            for (; x < lw; x++) {
+                int lap = up[x] + down[x] + mid[x - 1] + mid[x + 1] - 4 * mid[x];
+                out[x] = lap > EDGE_THRESHOLD ? 255 : 0;
+            }
+        }
+
+        for (int y = y0; y < y1; y++) {
+            // Vertical pass
+            const uchar* a = thresh + (std::max(y - 1, t0) - t0) * lw;
+            const uchar* b = thresh + (y - t0) * lw;
+            const uchar* c = thresh + (std::min(y + 1, t1 - 1) - t0) * lw;
+            int x = 0;
+#if CV_SIMD
+            for (; x <= lw - CV_SIMD_WIDTH; x += CV_SIMD_WIDTH) cv::v_store(vmax + x, cv::v_max(cv::v_max(cv::vx_load(a + x), cv::vx_load(b + x)), cv::vx_load(c + x)));
+#endif
+            for (; x < lw; x++) vmax[x] = std::max(std::max(a[x], b[x]), c[x]);
 
-        cv::Mat gray, lapl, thresh, dilated;
+            // Horizontal pass
+            uchar* out = dst.ptr<uchar>(y - roi.y);
+            const uchar* row = vmax + (x0 - l0);
+            x = 0;
+#if CV_SIMD
+            for (; x <= x1 - x0 - CV_SIMD_WIDTH; x += CV_SIMD_WIDTH) cv::v_store(out + x, cv::v_max(cv::v_max(cv::vx_load(row + x - 1), cv::vx_load(row + x)), cv::vx_load(row + x + 1)));
+#endif
+            for (; x < x1 - x0; x++) out[x] = std::max(std::max(row[x - 1], row[x]), row[x + 1]);
+        }
+    }
+
+    void panel_edge_mask (cv::Mat src, cv::Mat& dst, cv::Rect roi) {
+        assert(!src.empty());
+        assert(src.depth() == CV_8U && (src.channels() == 1 || src.channels() == 3 || src.channels() == 4));
+
+        if (roi.empty()) roi = cv::Rect(0, 0, src.cols, src.rows);
+        assert((roi & cv::Rect(0, 0, src.cols, src.rows)) == roi);
+
+        dst.create(roi.size(), CV_8UC1);
+
+        int band_rows = EDGE_BAND_BYTES / (2 * (roi.width + 4));
+        band_rows = std::min(std::max(band_rows, 8), 128);
+        int bands = (roi.height + band_rows - 1) / band_rows;
+
+        cv::parallel_for_(cv::Range(0, bands), [&] (const cv::Range& range) {
+            std::vector<uchar> buffer;
+            for (int band = range.start; band < range.end; band++) {
+                int y0 = roi.y + band * band_rows;
+                int y1 = std::min(y0 + band_rows, roi.y + roi.height);
+                panel_edge_mask_band(src, dst, roi, y0, y1, buffer);
+            }
+        });
+    }
+
+    void panel_edge_mask_reference (cv::Mat src, cv::Mat& dst) {
+        cv::Mat gray, lapl, thresh;
         
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+        if (src.channels() == 1) gray = src;
+        else cv::cvtColor(src, gray, src.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
 
         cv::Laplacian(gray, lapl, CV_8U);
 
-        cv::threshold(lapl, thresh, 50, 255, cv::THRESH_BINARY);
+        cv::threshold(lapl, thresh, EDGE_THRESHOLD, 255, cv::THRESH_BINARY);
 
         // Close some small imperfections in the countours
         cv::Mat dilation_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3,3));
-        cv::dilate(thresh, dilated, dilation_kernel);
+        cv::dilate(thresh, dst, dilation_kernel);
+    }
+
+    PanelArray get_panels_rgb (cv::Mat img, double precision, double min_area_divider, struct Workspace* ws) {
+        assert(!img.empty());
 
-        dilation_kernel.release();
+        cv::Mat dilated = workspace_mat(ws, WS_EDGE_MASK, img.size(), CV_8UC1);
+
+        // Edges closed with a small dilation to fix some imperfections in the countours
+        panel_edge_mask(img, dilated);
 
         std::vector<std::vector<cv::Point>> contours;
 
@@ -57,53 +247,219 @@ namespace chopfox {
         }
 
         dilated.release();
-        thresh.release();
-        lapl.release();
-        gray.release();
 
         return retVal;
     }
 
-    void sort_panels (PanelArray panels, int sorting_params) {
+    /**
+     * Downscale the image to gray by taking the minimum of every scale x scale block
+     */
+    static void min_pool_gray (cv::Mat src, int scale, cv::Mat& dst) {
+        dst.create((src.rows + scale - 1) / scale, (src.cols + scale - 1) / scale, CV_8UC1);
+
+        cv::parallel_for_(cv::Range(0, dst.rows), [&] (const cv::Range& range) {
+            std::vector<uchar> gray(src.cols);
+            for (int cy = range.start; cy < range.end; cy++) {
+                uchar* out = dst.ptr<uchar>(cy);
+                std::fill(out, out + dst.cols, 255);
+                for (int y = cy * scale; y < std::min((cy + 1) * scale, src.rows); y++) {
+                    gray_row(src, y, 0, src.cols, gray.data());
+                    for (int cx = 0; cx < dst.cols; cx++) {
+                        const uchar* block = gray.data() + cx * scale;
+                        int n = std::min(scale, src.cols - cx * scale);
+                        uchar v = out[cx];
+                        for (int k = 0; k < n; k++) v = std::min(v, block[k]);
+                        out[cx] = v;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * Find the full resolution contour near a contour found on the downscaled image
+     */
+    static std::vector<cv::Point> refine_panel_contour (cv::Mat img, const std::vector<cv::Point>& coarse, int scale, struct Workspace* ws) {
+        int margin = 2 * scale;
+
+        std::vector<cv::Point> scaled;
+        for (auto &p : coarse) scaled.push_back(cv::Point(p.x * scale + scale / 2, p.y * scale + scale / 2));
+
+        cv::Rect roi = cv::boundingRect(scaled);
+        roi = cv::Rect(roi.x - margin, roi.y - margin, roi.width + 2 * margin, roi.height + 2 * margin) & cv::Rect(0, 0, img.cols, img.rows);
+
+        std::vector<std::vector<cv::Point>> local(1), tile_local(1);
+        for (auto &p : scaled) {
+            local[0].push_back(p - roi.tl());
+            tile_local[0].push_back(cv::Point((p.x - roi.x) / REFINE_TILE, (p.y - roi.y) / REFINE_TILE));
+        }
+
+        // Tiles covering the band of pixels the refined contour may be in, generated from the contour so the band doesn't have to be scanned
+        cv::Mat tiles = workspace_mat(ws, WS_REFINE_TILES, cv::Size((roi.width + REFINE_TILE - 1) / REFINE_TILE, (roi.height + REFINE_TILE - 1) / REFINE_TILE), CV_8UC1);
+        tiles.setTo(cv::Scalar(0));
+        cv::polylines(tiles, tile_local, true, cv::Scalar(255), 2 * ((margin + REFINE_TILE - 1) / REFINE_TILE) + 1);
+
+        // The edges stay the size of the ROI for findContours, but only the band tiles are generated.
+        // The band itself is drawn one tile at a time, so it never takes more than a tile.
+        cv::Mat edges = workspace_mat(ws, WS_REFINE_EDGES, roi.size(), CV_8UC1);
+        cv::Mat band = workspace_mat(ws, WS_REFINE_BAND, cv::Size(REFINE_TILE, REFINE_TILE), CV_8UC1);
+        std::vector<std::vector<cv::Point>> shifted(1, std::vector<cv::Point>(local[0].size()));
+        edges.setTo(cv::Scalar(0));
+        for (int ty = 0; ty < tiles.rows; ty++) {
+            for (int tx = 0; tx < tiles.cols; tx++) {
+                if (!tiles.at<uchar>(ty, tx)) continue;
+                cv::Rect tile = cv::Rect(tx * REFINE_TILE, ty * REFINE_TILE, REFINE_TILE, REFINE_TILE) & cv::Rect(0, 0, roi.width, roi.height);
+                cv::Mat tile_edges = edges(tile);
+                panel_edge_mask(img, tile_edges, tile + roi.tl());
+
+                cv::Mat tile_band = band(cv::Rect(0, 0, tile.width, tile.height));
+                tile_band.setTo(cv::Scalar(0));
+                for (int i = 0; i < local[0].size(); i++) shifted[0][i] = local[0][i] - tile.tl();
+                cv::polylines(tile_band, shifted, true, cv::Scalar(255), 2 * margin + 1);
+                cv::bitwise_and(tile_edges, tile_band, tile_edges);
+            }
+        }
+        band.release();
+
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(edges, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, roi.tl());
+
+        edges.release();
+
+        int best = -1;
+        double best_area = 0;
+        for (int i = 0; i < contours.size(); i++) {
+            double area = cv::contourArea(contours[i]);
+            if (best < 0 || area > best_area) {
+                best = i;
+                best_area = area;
+            }
+        }
+
+        return best < 0 ? scaled : contours[best];
+    }
+
+    PanelArray get_panels_coarse (cv::Mat img, double precision, double min_area_divider, int downscale, struct Workspace* ws) {
+        assert(!img.empty());
+
+        if (downscale <= 1) return get_panels_rgb(img, precision, min_area_divider, ws);
+
+        cv::Size coarse_size((img.cols + downscale - 1) / downscale, (img.rows + downscale - 1) / downscale);
+        cv::Mat coarse = workspace_mat(ws, WS_COARSE, coarse_size, CV_8UC1);
+        cv::Mat coarse_mask = workspace_mat(ws, WS_COARSE_MASK, coarse_size, CV_8UC1);
+        min_pool_gray(img, downscale, coarse);
+        panel_edge_mask(coarse, coarse_mask);
+
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(coarse_mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+        coarse_mask.release();
+
+        // Same divider on the coarse image keeps the min area relative to the strip size
+        double min_area = (coarse.size().height / min_area_divider) * (coarse.size().width / min_area_divider);
+
+        coarse.release();
+
+        PanelArray retVal;
+
+        for (auto &contour : contours) {
+            if (cv::contourArea(contour) <= min_area) continue;
+
+            std::vector<cv::Point> refined = refine_panel_contour(img, contour, downscale, ws);
+
+            std::vector<cv::Point> approx;
+            double epsilon = precision * cv::arcLength(refined, true);
+            cv::approxPolyDP(refined, approx, epsilon, true);
+
+            struct PanelInfo info;
+            info.contour = approx;
+            info.bounding_box = cv::boundingRect(approx);
+            retVal.push_back(info);
+        }
+
+        return retVal;
+    }
+
+    void rescale_panels (PanelArray& panels, cv::Size from, cv::Size to) {
+        double sx = (double)to.width / from.width;
+        double sy = (double)to.height / from.height;
+        cv::Rect bounds(cv::Point(0, 0), to);
+
+        // Pixel centers are mapped to pixel centers so the far borders land on the last full resolution pixel
+        for (auto &panel : panels) {
+            for (auto &point : panel.contour) {
+                point.x = std::min(std::max(cvRound((point.x + 0.5) * sx - 0.5), 0), to.width - 1);
+                point.y = std::min(std::max(cvRound((point.y + 0.5) * sy - 0.5), 0), to.height - 1);
+            }
+            panel.bounding_box = cv::boundingRect(panel.contour) & bounds;
+        }
+    }
+
+    void sort_panels (PanelArray& panels, int sorting_params) {
         for (auto &panel : panels) {
             
         }
     }
 
-    void free_mat_vector (std::vector<cv::Mat> arr) {
+    void free_mat_vector (std::vector<cv::Mat>&& arr) {
+        free_mat_vector(arr);
+    }
+
+    void free_mat_vector (std::vector<cv::Mat>& arr) {
         for (auto &i : arr) {
             i.release();
         }
+        arr.clear();
     }
 
-    std::vector<cv::Mat> crop_frames (cv::Mat src, PanelArray panels) {
+    std::vector<struct PanelView> view_frames (cv::Mat src, const PanelArray& panels) {
         assert(!src.empty());
 
-        std::vector<cv::Mat> retVal;
+        std::vector<struct PanelView> retVal;
+        retVal.reserve(panels.size());
         for (auto &panel : panels) {
-            // Create the Mats we're gonna use
-            cv::Mat crop = src(panel.bounding_box);
-            cv::Mat mask(crop.size(), CV_8UC1, cv::Scalar(0));
-            cv::Mat isolated;
+            struct PanelView view;
 
-            // Create the cropping mask
-            std::vector<std::vector<cv::Point>> contours = { panel.contour };
-            cv::fillPoly(mask, contours, 255, 8, 0, cv::Point(-panel.bounding_box.x, -panel.bounding_box.y));
-            
-            // Remove the dilation added by the extraction process
-            // NOTE: This isn't working well on straight edges... Look for better solution.
-            cv::Mat eroded;
-            cv::Mat erode_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3,3));
-            cv::erode(mask, eroded, erode_kernel);
-            erode_kernel.release();
+            view.roi = src(panel.bounding_box);
+            view.polygon.reserve(panel.contour.size());
+            for (auto &point : panel.contour) view.polygon.push_back(point - panel.bounding_box.tl());
+
+            retVal.push_back(std::move(view));
+        }
+        return retVal;
+    }
+
+    void panel_view_materialize (const struct PanelView& view, cv::Mat& dst, struct Workspace* ws) {
+        // Create the cropping mask
+        cv::Mat mask = workspace_mat(ws, WS_CROP_MASK, view.roi.size(), CV_8UC1);
+        mask.setTo(cv::Scalar(0));
+        std::vector<std::vector<cv::Point>> contours = { view.polygon };
+        cv::fillPoly(mask, contours, 255);
 
-            // Crop the image
-            crop.copyTo(isolated, eroded);
+        // Remove the dilation added by the extraction process
+        // NOTE: This isn't working well on straight edges... Look for better solution.
+        cv::Mat eroded = workspace_mat(ws, WS_CROP_ERODED, view.roi.size(), CV_8UC1);
+        cv::Mat erode_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3,3));
+        cv::erode(mask, eroded, erode_kernel);
+        erode_kernel.release();
+        mask.release();
 
-            // Release the data
-            crop.release();
-            mask.release();
-            eroded.release();
+        // Crop the image
+        dst.create(view.roi.size(), view.roi.type());
+        dst.setTo(cv::Scalar::all(0));
+        view.roi.copyTo(dst, eroded);
+
+        eroded.release();
+    }
+
+    std::vector<cv::Mat> crop_frames (cv::Mat src, const PanelArray& panels, struct Workspace* ws) {
+        std::vector<struct PanelView> views = view_frames(src, panels);
+
+        std::vector<cv::Mat> retVal;
+        retVal.reserve(views.size());
+        for (auto &view : views) {
+            cv::Mat isolated;
+            panel_view_materialize(view, isolated, ws);
 
             // Add to return vector
             retVal.push_back(isolated);
@@ -111,7 +467,7 @@ namespace chopfox {
         return retVal;
     }
 
-    void draw_panel_bounds (PanelArray panels, cv::Mat dst, cv::Scalar color, int thickness) {
+    void draw_panel_bounds (const PanelArray& panels, cv::Mat dst, cv::Scalar color, int thickness) {
         assert(!dst.empty());
 
         for (auto &panel : panels) {
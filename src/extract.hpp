@@ -20,6 +20,7 @@
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include "workspace.hpp"
 #include <vector>
 
 namespace chopfox {
@@ -35,40 +36,109 @@ namespace chopfox {
         BOTTOM_UP
     };
 
+    /**
+     * A panel that hasn't been cropped out yet, referencing the pixels of the source image
+     */
+    struct PanelView {
+        cv::Mat roi; // View into the source image covering the bounding box of the panel
+        std::vector<cv::Point> polygon; // Contour of the panel relative to the roi
+    };
+
     #define PanelArray std::vector<struct PanelInfo>
 
     /// Extraction
 
+    /**
+     * Generate the binary edge mask the panels are found on in a single pass over row bands.
+     * Produces the same mask as cvtColor -> Laplacian -> threshold(50) -> 3x3 dilate without the full size intermediates.
+     * @param src The BGR, BGRA or grayscale input image
+     * @param dst The resulting CV_8UC1 mask (255 on edges), the size of roi
+     * @param roi The region of src to generate the mask for (empty for the whole image), pixels around it are used as neighbours
+     */
+    void panel_edge_mask (cv::Mat src, cv::Mat& dst, cv::Rect roi = cv::Rect());
+
+    /**
+     * Generate the edge mask using the separate OpenCV operations, used to verify panel_edge_mask
+     * @param src The BGR, BGRA or grayscale input image
+     * @param dst The resulting CV_8UC1 mask
+     */
+    void panel_edge_mask_reference (cv::Mat src, cv::Mat& dst);
+
     /**
      * Extract the panel ROIs from the input image
      * @param img The input image to process
      * @param precision The accuracy of the approximated contour (lower is more precise)
      * @param panel_min_area_divider Min area of panel calculates as min_area = (strip.width / panel_min_area_divider) * (strip.height / panel_min_area_divider)
+     * @param ws Workspace to keep the intermediates in between calls (NULL allocates them every time)
      * @returns An vector containing the regoins of interest and contour for each panel
      */
-    PanelArray get_panels_rgb (cv::Mat img, double precision = 0.001, double min_area_divider = 15.0);
+    PanelArray get_panels_rgb (cv::Mat img, double precision = 0.001, double min_area_divider = 15.0, struct Workspace* ws = NULL);
+
+    /**
+     * Extract the panel ROIs by finding the panels on a downscaled image and refining the contours at full resolution
+     * Only a narrow band around every coarse contour is processed at full resolution.
+     * @param img The input image to process
+     * @param precision The accuracy of the approximated contour (lower is more precise)
+     * @param panel_min_area_divider Min area of panel calculates as min_area = (strip.width / panel_min_area_divider) * (strip.height / panel_min_area_divider)
+     * @param downscale The factor the image is reduced by for the coarse detection (1 is the same as get_panels_rgb)
+     * @param ws Workspace to keep the intermediates in between calls (NULL allocates them every time)
+     * @returns An vector containing the regoins of interest and contour for each panel
+     * @remarks The coarse image is reduced by taking the darkest pixel, so thin dark panel borders survive the downscale
+     */
+    PanelArray get_panels_coarse (cv::Mat img, double precision = 0.001, double min_area_divider = 15.0, int downscale = 4, struct Workspace* ws = NULL);
+
+    /**
+     * Map panels found on a reduced image back to the coordinates of the full resolution image
+     * @param panels The panels to rescale in place
+     * @param from The size of the image the panels were found on
+     * @param to The size of the full resolution image
+     */
+    void rescale_panels (PanelArray& panels, cv::Size from, cv::Size to);
 
     /**
      * Sort the extracted panels into the order they appear
      */
-    void sort_panels (PanelArray panels, int sorting_params);
+    void sort_panels (PanelArray& panels, int sorting_params);
 
     /// Cropping
 
     /**
-     * Free all the Mat objects in a vector
+     * Free all the Mat objects in a vector, leaving it empty
+     * @param arr The vector to free.
+     */
+    void free_mat_vector (std::vector<cv::Mat>& arr);
+
+    /**
+     * Free all the Mat objects in a temporary vector
      * @param arr The vector to free.
      */
-    void free_mat_vector (std::vector<cv::Mat> arr);
+    void free_mat_vector (std::vector<cv::Mat>&& arr);
 
     /**
      * Chop the image into panels using array of PanelInfo, usually generated from get_panels_rgb
      * @param src The source image
      * @param panels The vector containing the regoins of interest and contour for each panel
+     * @param ws Workspace to keep the cropping masks in (NULL allocates them for every panel)
      * @returns A vector of the chopped Mats
      * @remarks Free the returned vector with free_mat_vector
      */
-    std::vector<cv::Mat> crop_frames (cv::Mat src, PanelArray panels);
+    std::vector<cv::Mat> crop_frames (cv::Mat src, const PanelArray& panels, struct Workspace* ws = NULL);
+
+    /**
+     * Create views of the panels without copying any pixels, usually from the panels generated by get_panels_rgb
+     * @param src The source image, the views keep a reference to it
+     * @param panels The vector containing the regoins of interest and contour for each panel
+     * @returns A vector of views, crop them with panel_view_materialize when the pixels are needed
+     */
+    std::vector<struct PanelView> view_frames (cv::Mat src, const PanelArray& panels);
+
+    /**
+     * Crop the panel out of the source image, clearing the pixels outside of the panel contour
+     * @param view The panel to crop
+     * @param dst The cropped panel
+     * @param ws Workspace to keep the cropping mask in (NULL allocates it)
+     */
+    void panel_view_materialize (const struct PanelView& view, cv::Mat& dst, struct Workspace* ws = NULL);
 
     /// Drawing functions
 
@@ -79,7 +149,7 @@ namespace chopfox {
      * @param color The color of the box
      * @param thickness The thickness of the lines to draw
      */
-    void draw_panel_bounds (PanelArray panels, cv::Mat dst, cv::Scalar color = cv::Scalar(255,255,0), int thickness = 2);
+    void draw_panel_bounds (const PanelArray& panels, cv::Mat dst, cv::Scalar color = cv::Scalar(255,255,0), int thickness = 2);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "incremental.hpp"
+#include <opencv2/imgproc.hpp>
+#include <stdio.h>
+
+#define INCREMENTAL_DIFF_THRESH 32 // Gray level difference of a thumbnail pixel counted as changed
+#define INCREMENTAL_BORDER_MARGIN 3 // Thumbnail pixels inside the panel contours still checked as part of the border
+#define INCREMENTAL_LINE_SPAN 0.8 // Fraction of a panel interior row or column on edges counted as a border line
+
+namespace chopfox {
+    struct SimpleIncremental* simple_incremental_init (struct SimpleProcessor* proc, bool include_text, double layout_tolerance) {
+        struct SimpleIncremental* inc = new struct SimpleIncremental;
+
+        inc->proc = proc;
+        inc->include_text = include_text;
+        inc->layout_tolerance = layout_tolerance;
+        inc->thumb_scale = 4;
+        inc->type = -1;
+        inc->frames = 0;
+        inc->full_passes = 0;
+        inc->panels_reused = 0;
+        inc->panels_redone = 0;
+
+        return inc;
+    }
+
+    static cv::Mat incremental_thumb (struct SimpleIncremental* inc, cv::Mat frame) {
+        cv::Mat gray;
+        if (frame.channels() == 4) cv::cvtColor(frame, gray, cv::COLOR_BGRA2GRAY);
+        else if (frame.channels() == 3) cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        else gray = frame;
+
+        cv::Mat thumb;
+        cv::resize(gray, thumb, cv::Size(), 1.0 / inc->thumb_scale, 1.0 / inc->thumb_scale, cv::INTER_AREA);
+        return thumb;
+    }
+
+    static void incremental_clear (struct SimpleIncremental* inc) {
+        simple_data_free(inc->data);
+        inc->hashes.clear();
+        inc->changed.clear();
+        inc->lines.clear();
+    }
+
+    /**
+     * The interior of a panel on the thumbnail, its bounding box shrunk by the border margin
+     */
+    static cv::Rect incremental_interior (struct SimpleIncremental* inc, const struct PanelInfo& panel) {
+        cv::Rect box(panel.bounding_box.tl() / inc->thumb_scale, panel.bounding_box.br() / inc->thumb_scale);
+        box = box & cv::Rect(cv::Point(0, 0), inc->thumb.size());
+
+        int margin = std::min(INCREMENTAL_BORDER_MARGIN, std::min(box.width, box.height) / 2);
+        return cv::Rect(box.x + margin, box.y + margin, box.width - 2 * margin, box.height - 2 * margin);
+    }
+
+    /**
+     * Rows & columns of the thumbnail region that are edges over most of their length, a panel border or split crossing it
+     */
+    static int incremental_lines (cv::Mat thumb, cv::Rect interior) {
+        if (interior.width < 2 || interior.height < 2) return 0;
+
+        cv::Mat edges;
+        cv::Canny(thumb(interior), edges, 50, 150);
+
+        cv::Mat rows, cols;
+        cv::reduce(edges, rows, 1, cv::REDUCE_SUM, CV_32S);
+        cv::reduce(edges, cols, 0, cv::REDUCE_SUM, CV_32S);
+
+        int lines = 0;
+        for (int y = 0; y < rows.rows; y++) lines += rows.at<int>(y) >= INCREMENTAL_LINE_SPAN * 255 * interior.width;
+        for (int x = 0; x < cols.cols; x++) lines += cols.at<int>(x) >= INCREMENTAL_LINE_SPAN * 255 * interior.height;
+        return lines;
+    }
+
+    static void incremental_full_pass (struct SimpleIncremental* inc, cv::Mat frame) {
+        incremental_clear(inc);
+
+        simple_process_page(inc->proc, frame, &inc->data, inc->include_text);
+
+        int count = inc->data.panels.size();
+        for (int i = 0; i < count; i++) inc->hashes.push_back(result_cache_hash_image(frame(inc->data.panels[i].bounding_box)));
+        inc->changed.assign(count, true);
+
+        // Gutters & borders: everything but the panel interiors, shrunk by a margin so the contour lines are checked too
+        inc->thumb = incremental_thumb(inc, frame);
+        cv::Mat interiors = cv::Mat::zeros(inc->thumb.size(), CV_8UC1);
+        for (auto &panel : inc->data.panels) {
+            std::vector<cv::Point> scaled;
+            for (auto &point : panel.contour) scaled.push_back(point / inc->thumb_scale);
+            std::vector<std::vector<cv::Point>> polygons = { scaled };
+            cv::fillPoly(interiors, polygons, cv::Scalar(255));
+        }
+        cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * INCREMENTAL_BORDER_MARGIN + 1, 2 * INCREMENTAL_BORDER_MARGIN + 1));
+        cv::erode(interiors, interiors, kernel);
+        cv::bitwise_not(interiors, inc->structure);
+
+        for (auto &panel : inc->data.panels) inc->lines.push_back(incremental_lines(inc->thumb, incremental_interior(inc, panel)));
+
+        inc->size = frame.size();
+        inc->type = frame.type();
+        inc->full_passes++;
+        inc->panels_redone += count;
+    }
+
+    /**
+     * Whether the gutters & borders changed enough since the last full pass for the panels to have moved
+     */
+    static bool incremental_layout_changed (struct SimpleIncremental* inc, cv::Mat frame, cv::Mat thumb) {
+        if (frame.size() != inc->size || frame.type() != inc->type) return true;
+
+        cv::Mat diff;
+        cv::absdiff(thumb, inc->thumb, diff);
+        cv::threshold(diff, diff, INCREMENTAL_DIFF_THRESH, 255, cv::THRESH_BINARY);
+        cv::bitwise_and(diff, inc->structure, diff);
+
+        int changed = cv::countNonZero(diff);
+        return changed > inc->layout_tolerance * cv::countNonZero(inc->structure);
+    }
+
+    struct SimplePageData* simple_incremental_frame (struct SimpleIncremental* inc, cv::Mat frame) {
+        struct SimpleProcessor* proc = inc->proc;
+
+        inc->frames++;
+
+        cv::Mat thumb;
+        bool layout_changed = inc->type < 0 || frame.size() != inc->size || frame.type() != inc->type;
+        if (!layout_changed) {
+            thumb = incremental_thumb(inc, frame);
+            layout_changed = incremental_layout_changed(inc, frame, thumb);
+        }
+
+        // Same layout, only the panels whose pixels changed are chopped & transcribed again
+        int64_t span = trace_begin(proc->tracer);
+
+        struct SimplePageData redo;
+        std::vector<int> redo_indices;
+        std::vector<uint64_t> hashes;
+        for (int i = 0; !layout_changed && i < inc->data.panels.size(); i++) {
+            uint64_t hash = result_cache_hash_image(frame(inc->data.panels[i].bounding_box));
+            hashes.push_back(hash);
+            if (hash == inc->hashes[i]) continue;
+
+            // The gutters didn't move, but a border drawn across the panel splits it
+            if (incremental_lines(thumb, incremental_interior(inc, inc->data.panels[i])) > inc->lines[i]) {
+                layout_changed = true;
+                break;
+            }
+
+            redo.panels.push_back(inc->data.panels[i]);
+            redo_indices.push_back(i);
+        }
+
+        trace_end(proc->tracer, "panel_diff", span);
+
+        if (layout_changed) {
+            incremental_full_pass(inc, frame);
+            trace_count(proc->tracer, "incremental_full_passes", 1);
+            if (proc->log_level >= 1) printf("[Chopfox] Layout changed, found %d panels\n", (int)inc->data.panels.size());
+            return &inc->data;
+        }
+
+        for (int i = 0; i < hashes.size(); i++) inc->changed[i] = hashes[i] != inc->hashes[i];
+        inc->hashes = hashes;
+
+        if (!redo_indices.empty()) {
+            // After a cache hit the data holds views, the redone panels have to be the same
+            if (inc->data.frames.empty()) redo.views = view_frames(frame, redo.panels);
+            else simple_process_chop(proc, frame, &redo);
+            if (inc->include_text) simple_process_text(proc, &redo);
+
+            for (int k = 0; k < redo_indices.size(); k++) {
+                int i = redo_indices[k];
+                if (!redo.frames.empty()) inc->data.frames[i] = redo.frames[k];
+                if (!redo.views.empty()) inc->data.views[i] = redo.views[k];
+                if (inc->include_text) inc->data.dialogue[i] = std::move(redo.dialogue[k]);
+            }
+        }
+
+        int reused = inc->data.panels.size() - redo_indices.size();
+        inc->panels_reused += reused;
+        inc->panels_redone += redo_indices.size();
+        trace_count(proc->tracer, "panels_reused", reused);
+
+        if (proc->log_level >= 1) printf("[Chopfox] Reused %d panels, processed %d again\n", reused, (int)redo_indices.size());
+
+        return &inc->data;
+    }
+
+    void simple_incremental_reset (struct SimpleIncremental* inc) {
+        incremental_clear(inc);
+        inc->type = -1;
+    }
+
+    void simple_incremental_free (struct SimpleIncremental* inc) {
+        incremental_clear(inc);
+        delete inc;
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "simple.hpp"
+#include <stdint.h>
+
+namespace chopfox {
+    /**
+     * Processes the frames of an animated comic or motion comic video, reusing the results of the previous frame
+     * The layout is only detected again when the gutters & panel borders change or a changed panel gets a new border line across it,
+     * and only the panels whose pixels changed are chopped & transcribed again.
+     */
+    struct SimpleIncremental {
+        struct SimpleProcessor* proc;
+        bool include_text;
+        double layout_tolerance; // Fraction of the gutter & border pixels that may change before the layout is detected again
+        int thumb_scale; // Downscale of the thumbnails the layout is compared on
+        struct SimplePageData data; // Results of the last frame
+        std::vector<uint64_t> hashes; // Hash of the pixels of every panel
+        std::vector<bool> changed; // Panels that were processed again for the last frame
+        cv::Mat thumb; // Grayscale thumbnail of the frame the layout was detected on
+        cv::Mat structure; // Thumbnail pixels outside of the panel interiors (255)
+        std::vector<int> lines; // Edge lines spanning the interior of every panel on the thumbnail, a new one is a new border or split
+        cv::Size size;
+        int type;
+        size_t frames;
+        size_t full_passes;
+        size_t panels_reused;
+        size_t panels_redone;
+    };
+
+    /**
+     * Create an incremental processor
+     * @param proc The processor to use, must outlive the incremental processor
+     * @param include_text Extract the text as well as the panels
+     * @param layout_tolerance Fraction of the gutter & border pixels that may change before the layout is detected again
+     * @returns The incremental processor
+     * @remarks Free it with simple_incremental_free
+     */
+    struct SimpleIncremental* simple_incremental_init (struct SimpleProcessor* proc, bool include_text = true, double layout_tolerance = 0.002);
+
+    /**
+     * Process the next frame
+     * Falls back to a full pass on the first frame, when the frame size changes or when the layout shifted.
+     * @param inc The incremental processor
+     * @param frame The frame to process
+     * @returns The panels, frames and text of the frame, valid until the next frame (inc->changed lists the panels that were processed again)
+     */
+    struct SimplePageData* simple_incremental_frame (struct SimpleIncremental* inc, cv::Mat frame);
+
+    /**
+     * Forget the previous frame so the next one gets a full pass
+     * @param inc The incremental processor
+     */
+    void simple_incremental_reset (struct SimpleIncremental* inc);
+
+    /**
+     * Free an incremental processor and the results it holds
+     * @param inc The incremental processor to free
+     */
+    void simple_incremental_free (struct SimpleIncremental* inc);
+}
+
+#endif
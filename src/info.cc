@@ -0,0 +1,492 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "info.hpp"
+#include <charconv>
+#include <string.h>
+#include <assert.h>
+
+#define INFO_MAGIC "CFXI"
+#define INFO_VERSION 1
+#define INFO_FLAG_TEXT 1
+#define INFO_FLAG_CONTOUR 2
+
+namespace chopfox {
+    /// Text helpers
+
+    static void put_int (std::string& out, long long value) {
+        char digits[24];
+        char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        out.append(digits, end - digits);
+    }
+
+    /**
+     * Escape a string the same way TinyXML does (character references are passed through)
+     */
+    static void put_xml_escaped (std::string& out, const char* text) {
+        size_t length = strlen(text);
+        size_t i = 0;
+        while (i < length) {
+            unsigned char c = text[i];
+            if (c == '&' && i + 2 < length && text[i + 1] == '#' && text[i + 2] == 'x') {
+                // Copied up to the ';', which (like an unterminated reference's last character) is then written as usual
+                while (i + 1 < length) {
+                    out += text[i++];
+                    if (text[i] == ';') break;
+                }
+                continue;
+            }
+            if (c == '&') out += "&amp;";
+            else if (c == '<') out += "&lt;";
+            else if (c == '>') out += "&gt;";
+            else if (c == '"') out += "&quot;";
+            else if (c == '\'') out += "&apos;";
+            else if (c < 32) {
+                char ref[8];
+                snprintf(ref, sizeof(ref), "&#x%02X;", c);
+                out += ref;
+            } else out += (char)c;
+            i++;
+        }
+    }
+
+    static void put_json_string (std::string& out, const char* text) {
+        out += '"';
+        for (const char* c = text; c && *c; c++) {
+            if (*c == '"') out += "\\\"";
+            else if (*c == '\\') out += "\\\\";
+            else if (*c == '\n') out += "\\n";
+            else if (*c == '\r') out += "\\r";
+            else if (*c == '\t') out += "\\t";
+            else if ((unsigned char)*c < 32) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)*c);
+                out += escape;
+            } else out += *c;
+        }
+        out += '"';
+    }
+
+    static void put_xml_attribute (std::string& out, const char* name, int value) {
+        out += ' ';
+        out += name;
+        out += "=\"";
+        put_int(out, value);
+        out += '"';
+    }
+
+    static void put_json_rect (std::string& out, const cv::Rect& rect) {
+        out += "\"x\":";
+        put_int(out, rect.x);
+        out += ",\"y\":";
+        put_int(out, rect.y);
+        out += ",\"width\":";
+        put_int(out, rect.width);
+        out += ",\"height\":";
+        put_int(out, rect.height);
+    }
+
+    /// Binary helpers
+
+    static void put_varint (std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += (char)(value | 0x80);
+            value >>= 7;
+        }
+        out += (char)value;
+    }
+
+    static void put_zigzag (std::string& out, int64_t value) {
+        put_varint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    /**
+     * Bounds checked reader of a binary record
+     */
+    struct RecordReader {
+        const uint8_t* p;
+        const uint8_t* end;
+        bool ok;
+    };
+
+    static uint64_t get_varint (struct RecordReader& reader) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (reader.p >= reader.end) break;
+            uint8_t byte = *reader.p++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        reader.ok = false;
+        return 0;
+    }
+
+    static int64_t get_zigzag (struct RecordReader& reader) {
+        uint64_t value = get_varint(reader);
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    static cv::Rect get_rect (struct RecordReader& reader) {
+        int x = get_zigzag(reader), y = get_zigzag(reader);
+        int width = get_varint(reader), height = get_varint(reader);
+        return cv::Rect(x, y, width, height);
+    }
+
+    /// Page serialization
+
+    template <typename Text>
+    static void put_page_xml (
+        std::string& out,
+        const PanelArray& panels,
+        const std::vector<std::vector<Text>>& dialogue,
+        bool include_contour
+    ) {
+        out += "<?xml version=\"1.0\" ?>\n<!--Generated by Chopfox-->\n";
+
+        if (panels.empty()) {
+            out += "<comic-strip />\n";
+            return;
+        }
+
+        out += "<comic-strip>";
+        for (int i = 0; i < panels.size(); i++) {
+            const cv::Rect& box = panels[i].bounding_box;
+
+            out += "\n    <panel";
+            put_xml_attribute(out, "top", box.x);
+            put_xml_attribute(out, "left", box.y);
+            put_xml_attribute(out, "width", box.width);
+            put_xml_attribute(out, "height", box.height);
+            if (include_contour) {
+                out += " path=\"";
+                for (int j = 0; j < panels[i].contour.size(); j++) {
+                    if (j > 0) out += ' ';
+                    put_int(out, panels[i].contour[j].x);
+                    out += ' ';
+                    put_int(out, panels[i].contour[j].y);
+                }
+                out += '"';
+            }
+
+            if (dialogue.empty() || dialogue[i].empty()) {
+                out += " />";
+                continue;
+            }
+
+            out += '>';
+            for (auto &text : dialogue[i]) {
+                out += "\n        <dialogue";
+                put_xml_attribute(out, "top", text.bounding_box.x);
+                put_xml_attribute(out, "left", text.bounding_box.y);
+                put_xml_attribute(out, "width", text.bounding_box.width);
+                put_xml_attribute(out, "height", text.bounding_box.height);
+                out += '>';
+                put_xml_escaped(out, text_string(text));
+                out += "</dialogue>";
+            }
+            out += "\n    </panel>";
+        }
+        out += "\n</comic-strip>\n";
+    }
+
+    template <typename Text>
+    static void put_page_jsonl (
+        std::string& out,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<Text>>& dialogue,
+        bool include_contour
+    ) {
+        out += "{\"page\":";
+        put_json_string(out, name ? name : "");
+        out += ",\"panels\":[";
+        for (int i = 0; i < panels.size(); i++) {
+            if (i > 0) out += ',';
+            out += '{';
+            put_json_rect(out, panels[i].bounding_box);
+            if (include_contour) {
+                out += ",\"contour\":[";
+                for (int j = 0; j < panels[i].contour.size(); j++) {
+                    if (j > 0) out += ',';
+                    put_int(out, panels[i].contour[j].x);
+                    out += ',';
+                    put_int(out, panels[i].contour[j].y);
+                }
+                out += ']';
+            }
+            if (!dialogue.empty()) {
+                out += ",\"dialogue\":[";
+                for (int j = 0; j < dialogue[i].size(); j++) {
+                    if (j > 0) out += ',';
+                    out += '{';
+                    put_json_rect(out, dialogue[i][j].bounding_box);
+                    out += ",\"text\":";
+                    put_json_string(out, text_string(dialogue[i][j]));
+                    out += '}';
+                }
+                out += ']';
+            }
+            out += '}';
+        }
+        out += "]}\n";
+    }
+
+    template <typename Text>
+    static void put_page_binary (
+        std::string& out,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<Text>>& dialogue,
+        bool include_contour
+    ) {
+        size_t name_length = name ? strlen(name) : 0;
+        put_varint(out, name_length);
+        out.append(name ? name : "", name_length);
+
+        out += (char)((dialogue.empty() ? 0 : INFO_FLAG_TEXT) | (include_contour ? INFO_FLAG_CONTOUR : 0));
+
+        put_varint(out, panels.size());
+        for (int i = 0; i < panels.size(); i++) {
+            const cv::Rect& box = panels[i].bounding_box;
+            put_zigzag(out, box.x);
+            put_zigzag(out, box.y);
+            put_varint(out, box.width);
+            put_varint(out, box.height);
+
+            // Contours are mostly short axis aligned steps, the deltas fit in one or two bytes
+            if (include_contour) {
+                put_varint(out, panels[i].contour.size());
+                cv::Point previous = box.tl();
+                for (auto &point : panels[i].contour) {
+                    put_zigzag(out, point.x - previous.x);
+                    put_zigzag(out, point.y - previous.y);
+                    previous = point;
+                }
+            }
+
+            if (!dialogue.empty()) {
+                put_varint(out, dialogue[i].size());
+                for (auto &text : dialogue[i]) {
+                    put_zigzag(out, text.bounding_box.x);
+                    put_zigzag(out, text.bounding_box.y);
+                    put_varint(out, text.bounding_box.width);
+                    put_varint(out, text.bounding_box.height);
+                    const char* value = text_string(text);
+                    size_t length = strlen(value);
+                    put_varint(out, length);
+                    out.append(value, length);
+                }
+            }
+        }
+    }
+
+    /// Writer
+
+    bool info_format_parse (const char* name, enum InfoFormat* format) {
+        if (!strcmp(name, "xml")) *format = INFO_FORMAT_XML;
+        else if (!strcmp(name, "jsonl")) *format = INFO_FORMAT_JSONL;
+        else if (!strcmp(name, "binary")) *format = INFO_FORMAT_BINARY;
+        else return false;
+        return true;
+    }
+
+    const char* info_format_extension (enum InfoFormat format) {
+        if (format == INFO_FORMAT_JSONL) return "jsonl";
+        if (format == INFO_FORMAT_BINARY) return "cfxi";
+        return "xml";
+    }
+
+    static bool info_writer_emit (struct InfoWriter* writer, const std::string& data) {
+        if (writer->file) {
+            if (fwrite(data.data(), 1, data.size(), writer->file) != data.size()) writer->ok = false;
+        } else {
+            writer->buffer->append(data);
+        }
+        return writer->ok;
+    }
+
+    static struct InfoWriter* info_writer_create (FILE* file, std::string* buffer, enum InfoFormat format) {
+        struct InfoWriter* writer = new struct InfoWriter;
+
+        writer->format = format;
+        writer->file = file;
+        writer->buffer = buffer;
+        writer->pages = 0;
+        writer->ok = true;
+
+        if (format == INFO_FORMAT_BINARY) {
+            std::string header(INFO_MAGIC);
+            header += (char)INFO_VERSION;
+            info_writer_emit(writer, header);
+        }
+
+        return writer;
+    }
+
+    struct InfoWriter* info_writer_open (const char* path, enum InfoFormat format) {
+        FILE* file = fopen(path, format == INFO_FORMAT_BINARY ? "wb" : "w");
+        if (!file) return NULL;
+
+        return info_writer_create(file, NULL, format);
+    }
+
+    struct InfoWriter* info_writer_open_buffer (std::string* buffer, enum InfoFormat format) {
+        assert(buffer);
+
+        return info_writer_create(NULL, buffer, format);
+    }
+
+    template <typename Text>
+    static bool info_writer_put (
+        struct InfoWriter* writer,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<Text>>& dialogue,
+        bool include_contour
+    ) {
+        assert(dialogue.empty() || dialogue.size() >= panels.size());
+
+        std::lock_guard<std::mutex> guard(writer->lock);
+
+        assert(writer->format != INFO_FORMAT_XML || writer->pages == 0);
+
+        std::string& page = writer->scratch;
+        page.clear();
+
+        if (writer->format == INFO_FORMAT_XML) {
+            put_page_xml(page, panels, dialogue, include_contour);
+        } else if (writer->format == INFO_FORMAT_JSONL) {
+            put_page_jsonl(page, name, panels, dialogue, include_contour);
+        } else {
+            // Records are prefixed with their length so readers can skip pages
+            std::string record;
+            put_page_binary(record, name, panels, dialogue, include_contour);
+            put_varint(page, record.size());
+            page += record;
+        }
+
+        writer->pages++;
+
+        return info_writer_emit(writer, page);
+    }
+
+    bool info_writer_page (
+        struct InfoWriter* writer,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<struct PageText>>& dialogue,
+        bool include_contour
+    ) {
+        return info_writer_put(writer, name, panels, dialogue, include_contour);
+    }
+
+    bool info_writer_page (
+        struct InfoWriter* writer,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<struct TextBlock>>& dialogue,
+        bool include_contour
+    ) {
+        return info_writer_put(writer, name, panels, dialogue, include_contour);
+    }
+
+    bool info_writer_close (struct InfoWriter* writer) {
+        bool ok = writer->ok;
+        if (writer->file && fclose(writer->file) != 0) ok = false;
+        delete writer;
+        return ok;
+    }
+
+    /// Reader
+
+    bool info_binary_header (const uint8_t** data, const uint8_t* end) {
+        if (end - *data < 5 || memcmp(*data, INFO_MAGIC, 4) != 0 || (*data)[4] != INFO_VERSION) return false;
+        *data += 5;
+        return true;
+    }
+
+    bool info_binary_page (
+        const uint8_t** data,
+        const uint8_t* end,
+        std::string& name,
+        PanelArray& panels,
+        std::vector<std::vector<struct PageText>>& dialogue
+    ) {
+        struct RecordReader stream = { *data, end, *data < end };
+        uint64_t record_length = stream.ok ? get_varint(stream) : 0;
+        if (!stream.ok || record_length > (uint64_t)(stream.end - stream.p)) return false;
+
+        struct RecordReader reader = { stream.p, stream.p + record_length, true };
+
+        uint64_t name_length = get_varint(reader);
+        if (!reader.ok || name_length > (uint64_t)(reader.end - reader.p)) return false;
+        std::string page_name((const char*)reader.p, name_length);
+        reader.p += name_length;
+
+        uint8_t flags = reader.p < reader.end ? *reader.p++ : 0;
+        bool has_text = flags & INFO_FLAG_TEXT;
+
+        PanelArray read_panels;
+        std::vector<std::vector<struct PageText>> read_dialogue;
+
+        uint64_t panel_count = get_varint(reader);
+        for (uint64_t i = 0; reader.ok && i < panel_count; i++) {
+            struct PanelInfo panel;
+            panel.bounding_box = get_rect(reader);
+
+            if (flags & INFO_FLAG_CONTOUR) {
+                uint64_t points = get_varint(reader);
+                if (points > (uint64_t)(reader.end - reader.p) / 2) reader.ok = false;
+                cv::Point point = panel.bounding_box.tl();
+                for (uint64_t j = 0; reader.ok && j < points; j++) {
+                    point.x += get_zigzag(reader);
+                    point.y += get_zigzag(reader);
+                    panel.contour.push_back(point);
+                }
+            }
+
+            if (has_text) {
+                std::vector<struct PageText> blocks;
+                uint64_t block_count = get_varint(reader);
+                for (uint64_t j = 0; reader.ok && j < block_count; j++) {
+                    struct PageText block;
+                    block.bounding_box = get_rect(reader);
+                    uint64_t length = get_varint(reader);
+                    if (!reader.ok || length > (uint64_t)(reader.end - reader.p)) {
+                        reader.ok = false;
+                        break;
+                    }
+                    block.text.assign((const char*)reader.p, length);
+                    reader.p += length;
+                    blocks.push_back(std::move(block));
+                }
+                read_dialogue.push_back(std::move(blocks));
+            }
+
+            read_panels.push_back(panel);
+        }
+
+        if (!reader.ok) return false;
+
+        name = page_name;
+        panels = std::move(read_panels);
+        dialogue = std::move(read_dialogue);
+        *data = reader.end;
+
+        return true;
+    }
+}
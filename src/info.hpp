@@ -0,0 +1,156 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef INFO_H
+#define INFO_H
+
+#include "extract.hpp"
+#include "text_detect.hpp"
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+namespace chopfox {
+    /**
+     * Formats the panel & text info can be written in
+     *
+     * INFO_FORMAT_XML: the simple_xml_info schema, one document per page (top is the x coordinate and left the y coordinate)
+     * INFO_FORMAT_JSONL: one JSON object per line and page
+     *     {"page":"name","panels":[{"x":0,"y":0,"width":1,"height":1,"contour":[x0,y0,x1,y1,...],"dialogue":[{"x":0,"y":0,"width":1,"height":1,"text":"..."}]}]}
+     * INFO_FORMAT_BINARY: "CFXI" and a version byte, then one record per page
+     *     varint record length, varint name length, name, flags byte (1 text, 2 contours), varint panel count
+     *     every panel: zigzag x, zigzag y, varint width, varint height
+     *         with contours: varint point count, zigzag deltas of every point from the previous one (the first from the bounding box corner)
+     *         with text: varint block count, every block: zigzag x, zigzag y, varint width, varint height, varint text length, text
+     */
+    enum InfoFormat {
+        INFO_FORMAT_XML,
+        INFO_FORMAT_JSONL,
+        INFO_FORMAT_BINARY
+    };
+
+    /**
+     * Writes the info of pages as they are processed, without building a document in memory
+     * Pages may be written from several threads, each page is written at once.
+     */
+    struct InfoWriter {
+        enum InfoFormat format;
+        FILE* file; // NULL when writing to buffer
+        std::string* buffer;
+        std::mutex lock;
+        std::string scratch; // The page being serialized, keeps its capacity between pages
+        size_t pages;
+        bool ok; // false once a write failed
+    };
+
+    /**
+     * Get a format from its name
+     * @param name xml, jsonl or binary
+     * @param format The format
+     * @returns false if the name is not known
+     */
+    bool info_format_parse (const char* name, enum InfoFormat* format);
+
+    /**
+     * Default file extension of a format
+     * @param format The format
+     * @returns The extension without the dot
+     */
+    const char* info_format_extension (enum InfoFormat format);
+
+    /**
+     * Open a file to write page info to
+     * @param path The file to write
+     * @param format The format to write in
+     * @returns The writer or NULL if the file could not be created
+     * @remarks Close the writer with info_writer_close
+     */
+    struct InfoWriter* info_writer_open (const char* path, enum InfoFormat format);
+
+    /**
+     * Write page info to a memory buffer
+     * @param buffer The buffer to append to, must outlive the writer
+     * @param format The format to write in
+     * @returns The writer
+     * @remarks Close the writer with info_writer_close
+     */
+    struct InfoWriter* info_writer_open_buffer (std::string* buffer, enum InfoFormat format);
+
+    /**
+     * Write the info of a page
+     * XML writers only take a single page.
+     * @param writer The writer to use
+     * @param name The name of the page (not written in XML)
+     * @param panels The panels of the page
+     * @param dialogue The text of every panel (empty to write the panels only)
+     * @param include_contour Include the contour points of the panels
+     * @returns false if the page could not be written
+     */
+    bool info_writer_page (
+        struct InfoWriter* writer,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<struct PageText>>& dialogue,
+        bool include_contour = true
+    );
+
+    /**
+     * Write the info of a page with the text as C strings, see info_writer_page above
+     */
+    bool info_writer_page (
+        struct InfoWriter* writer,
+        const char* name,
+        const PanelArray& panels,
+        const std::vector<std::vector<struct TextBlock>>& dialogue,
+        bool include_contour = true
+    );
+
+    /**
+     * Flush and free a writer
+     * @param writer The writer to close
+     * @returns false if any of the writes failed
+     */
+    bool info_writer_close (struct InfoWriter* writer);
+
+    /**
+     * Check the header of a binary info stream
+     * @param data The start of the stream, moved past the header
+     * @param end The end of the stream
+     * @returns false if the stream is not a supported binary info stream
+     */
+    bool info_binary_header (const uint8_t** data, const uint8_t* end);
+
+    /**
+     * Read the next page of a binary info stream
+     * @param data The start of the record, moved past it
+     * @param end The end of the stream
+     * @param name The name of the page
+     * @param panels The panels of the page
+     * @param dialogue The text of every panel (empty if it was written without text)
+     * @returns false at the end of the stream or if the record is invalid
+     */
+    bool info_binary_page (
+        const uint8_t** data,
+        const uint8_t* end,
+        std::string& name,
+        PanelArray& panels,
+        std::vector<std::vector<struct PageText>>& dialogue
+    );
+}
+
+#endif
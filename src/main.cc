@@ -16,63 +16,482 @@
  */
 
 #include "simple.hpp"
+#include "batch.hpp"
+#include "strip.hpp"
+#include "incremental.hpp"
+#include "daemon.hpp"
+#include "decode.hpp"
+#include "cli.hpp"
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <string.h>
 #include <algorithm>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
 
 using namespace chopfox;
 
-char* getCmdOption(char ** begin, char ** end, const std::string & option) {
-    char ** itr = std::find(begin, end, option);
-    if (itr != end && ++itr != end) {
-        return *itr;
+void setCacheOptions(SimpleProcessor* proc, char** begin, char** end) {
+    char* cache_dir = getCmdOption(begin, end, "--cache_dir");
+    char* cache_size = getCmdOption(begin, end, "--cache_size");
+
+    if (cache_dir) simple_processor_set_cache(proc, cache_dir, (size_t)(cache_size ? atoi(cache_size) : 1024) * 1024 * 1024);
+}
+
+void setTextOptions(SimpleProcessor* proc, char** begin, char** end) {
+    char* max_side = getCmdOption(begin, end, "--east_max_side");
+    char* large_frames = getCmdOption(begin, end, "--east_large");
+    char* prefilter = getCmdOption(begin, end, "--text_prefilter");
+
+    if (max_side) proc->text_limits.max_side = atoi(max_side);
+    if (cmdOptionExists(begin, end, "--ocr_lines")) proc->text_recognition = TEXT_RECOGNITION_LINE;
+    if (cmdOptionExists(begin, end, "--geometric_grouping")) proc->text_grouping = TEXT_GROUPING_GEOMETRIC;
+
+    if (prefilter) {
+        proc->text_prefilter.thumb_side = 384;
+        proc->text_prefilter.min_density = atof(prefilter);
     }
-    return 0;
+
+    if (large_frames) {
+        if (strcmp(large_frames, "downscale") == 0) proc->text_limits.large_frames = TEXT_LARGE_DOWNSCALE;
+        else if (strcmp(large_frames, "tile") == 0) proc->text_limits.large_frames = TEXT_LARGE_TILE;
+        else proc->text_limits.large_frames = TEXT_LARGE_AUTO;
+    }
+}
+
+bool getModelOptions(char** begin, char** end, struct TextModelOptions* options) {
+    char* precision = getCmdOption(begin, end, "--east_precision");
+    char* calibration = getCmdOption(begin, end, "--east_calibration");
+
+    options->backend = cv::dnn::DNN_BACKEND_DEFAULT;
+    options->target = cmdOptionExists(begin, end, "--east_opencl") ? cv::dnn::DNN_TARGET_OPENCL : cv::dnn::DNN_TARGET_CPU;
+    options->precision = TEXT_PRECISION_FP32;
+
+    if (precision && !text_precision_parse(precision, &options->precision)) {
+        printf("Chopfox-CLI Error: Unknown EAST precision %s (use fp32, fp16 or int8)\n", precision);
+        return false;
+    }
+
+    if (options->precision != TEXT_PRECISION_INT8) return true;
+
+    if (!calibration || !std::filesystem::is_directory(calibration)) {
+        printf("Chopfox-CLI Error: --east_precision int8 needs a directory of sample pages (use --east_calibration <directory>)\n");
+        return false;
+    }
+
+    // The samples are kept to quantize every worker's copy of the model, only at the size they are used at
+    for (auto &entry : std::filesystem::directory_iterator(calibration)) {
+        cv::Mat sample = cv::imread(entry.path().string(), cv::IMREAD_COLOR);
+        if (sample.empty()) continue;
+
+        double scale = std::min(1.0, 640.0 / std::max(sample.cols, sample.rows));
+        if (scale < 1.0) cv::resize(sample, sample, cv::Size(), scale, scale, cv::INTER_AREA);
+        options->calibration.push_back(sample);
+
+        if (options->calibration.size() >= 32) break;
+    }
+
+    if (options->calibration.empty()) {
+        printf("Chopfox-CLI Error: No images to calibrate with in %s\n", calibration);
+        return false;
+    }
+
+    return true;
 }
 
-bool cmdOptionExists(char** begin, char** end, const std::string& option) {
-    return std::find(begin, end, option) != end;
+SimpleProcessor* initTextProcessor(const char* model_file, uint8_t log_level, struct TextModelOptions* model_options) {
+    SimpleProcessor* proc = simple_processor_init(model_file, log_level, "eng", 0.4f, 0.001, 300, 15.0, 1, model_options);
+
+    if (!proc) {
+        printf("Chopfox-CLI Error: Could not initialize tesseract-ocr, is the eng traineddata installed?\n");
+        return NULL;
+    }
+
+    if (proc->text_detector.empty()) {
+        printf("Chopfox-CLI Error: Could not load the EAST model %s\n", model_file);
+        simple_processor_free(proc);
+        return NULL;
+    }
+
+    return proc;
+}
+
+void setTraceOptions(SimpleProcessor* proc, char** begin, char** end) {
+    if (getCmdOption(begin, end, "--trace_file") || cmdOptionExists(begin, end, "--trace_summary")) proc->tracer = tracer_init();
+}
+
+void writeTrace(SimpleProcessor* proc, char** begin, char** end) {
+    if (!proc->tracer) return;
+
+    char* trace_file = getCmdOption(begin, end, "--trace_file");
+
+    if (trace_file && !tracer_write_chrome(proc->tracer, trace_file)) printf("Chopfox-CLI Error: Could not write the trace file\n");
+    if (cmdOptionExists(begin, end, "--trace_summary")) tracer_print_summary(proc->tracer, stdout);
+
+    tracer_free(proc->tracer);
+    proc->tracer = NULL;
+}
+
+bool getInfoFormat(char** begin, char** end, InfoFormat* format) {
+    char* name = getCmdOption(begin, end, "--info_format");
+
+    *format = INFO_FORMAT_XML;
+    if (name && !info_format_parse(name, format)) {
+        printf("Chopfox-CLI Error: Unknown info format %s (use xml, jsonl or binary)\n", name);
+        return false;
+    }
+    return true;
+}
+
+bool writeInfo(const char* path, InfoFormat format, const char* name, SimplePageData* data, bool include_text) {
+    InfoWriter* writer = info_writer_open(path, format);
+
+    if (!writer) return false;
+
+    bool written = simple_write_info(writer, name, *data, include_text);
+    return info_writer_close(writer) && written;
 }
 
 int main (int argc, char** argv) {
+    char* model_file = getCmdOption(argv, argv+argc, "--model");
+
+    if (!model_file) model_file = (char*)"../frozen_east_text_detection.pb";
+
+    char* threads = getCmdOption(argv, argv+argc, "--threads");
+
+    char* batch_input = getCmdOption(argv, argv+argc, "--batch");
+
+    char* decode_reduce = getCmdOption(argv, argv+argc, "--decode_reduce");
+
+    InfoFormat info_format;
+
+    if (!getInfoFormat(argv, argv+argc, &info_format)) return 1;
+
+    struct TextModelOptions model_options;
+
+    if (!getModelOptions(argv, argv+argc, &model_options)) return 1;
+
+    if (batch_input) {
+        struct BatchOptions options;
+        options.output_dir = getCmdOption(argv, argv+argc, "--output_dir");
+        if (!options.output_dir) options.output_dir = ".";
+        options.process_threads = threads ? atoi(threads) : std::thread::hardware_concurrency();
+        options.decode_threads = std::max(1, options.process_threads / 4);
+        options.write_threads = std::max(1, options.process_threads / 4);
+        options.queue_size = options.process_threads * 2;
+        options.include_text = !cmdOptionExists(argv, argv+argc, "--no_text");
+        options.write_chops = cmdOptionExists(argv, argv+argc, "--chop");
+        options.info_format = info_format;
+        options.decode_reduce = decode_reduce ? atoi(decode_reduce) : 1;
+
+        SimpleProcessor* proc = options.include_text ? 
+            initTextProcessor(model_file, cmdOptionExists(argv, argv+argc, "--verbose") ? 1 : 0, &model_options) : 
+            simple_processor_init_notext(cmdOptionExists(argv, argv+argc, "--verbose") ? 1 : 0);
+
+        if (!proc) return 1;
+
+        char* panel_downscale = getCmdOption(argv, argv+argc, "--panel_downscale");
+
+        if (panel_downscale) proc->panel_downscale = atoi(panel_downscale);
+
+        // Panels are only cropped when they are needed unless they are written out anyway
+        proc->lazy_frames = !options.write_chops;
+
+        setCacheOptions(proc, argv, argv+argc);
+        setTextOptions(proc, argv, argv+argc);
+        setTraceOptions(proc, argv, argv+argc);
+
+        int failed = batch_process(proc, batch_input, &options);
+
+        writeTrace(proc, argv, argv+argc);
+        simple_processor_free(proc);
+
+        return failed == 0 ? 0 : 1;
+    }
+
+    char* strip_file = getCmdOption(argv, argv+argc, "--strip");
+
+    if (strip_file) {
+        StripReader* reader = strip_reader_open(strip_file);
+
+        if (!reader) {
+            printf("Chopfox-CLI Error: Invalid input image\n");
+            return 1;
+        }
+
+        char* band_rows = getCmdOption(argv, argv+argc, "--band_rows");
+        char* max_rows = getCmdOption(argv, argv+argc, "--max_rows");
+        char* output_format = getCmdOption(argv, argv+argc, "--chop_output");
+
+        // Only the panel geometry is kept, the pixels are written out as soon as a panel is found
+        SimplePageData data;
+
+        int found = get_panels_streaming(reader, [&] (const PanelInfo& panel, cv::Mat pixels) {
+            if (output_format) {
+                PanelView view;
+                view.roi = pixels;
+                view.polygon = panel.contour;
+                for (auto &point : view.polygon) point -= panel.bounding_box.tl();
+
+                cv::Mat frame;
+                panel_view_materialize(view, frame);
+
+                int i = data.panels.size();
+                size_t length = snprintf(NULL, 0, output_format, i);
+                std::string filename(length + 1, '\0'); // fill string with 0
+                sprintf(&filename[0], output_format, i);
+                cv::imwrite(filename.c_str(), frame);
+            }
+            data.panels.push_back(panel);
+        }, 0.001, 15.0, band_rows ? atoi(band_rows) : 1024, max_rows ? atoi(max_rows) : 0);
+
+        strip_reader_free(reader);
+
+        if (found < 0) {
+            printf("Chopfox-CLI Error: Could not read the whole strip\n");
+            return 1;
+        }
+
+        char* xml_file = getCmdOption(argv, argv+argc, "--info_file");
+
+        if (xml_file && !writeInfo(xml_file, info_format, strip_file, &data, false)) {
+            printf("Chopfox-CLI Error: Could not write the info file\n");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    char* daemon_socket = getCmdOption(argv, argv+argc, "--daemon");
+
+    if (daemon_socket) {
+        struct DaemonOptions options;
+        options.socket_path = daemon_socket;
+        options.allow_text = !cmdOptionExists(argv, argv+argc, "--no_text");
+        options.decode_reduce = decode_reduce ? atoi(decode_reduce) : 1;
+
+        char* max_jobs = getCmdOption(argv, argv+argc, "--max_jobs");
+        options.max_jobs = max_jobs ? atoi(max_jobs) : (threads ? atoi(threads) : std::thread::hardware_concurrency());
+        char* max_connections = getCmdOption(argv, argv+argc, "--max_connections");
+        options.max_connections = max_connections ? atoi(max_connections) : options.max_jobs * 4;
+
+        // The model & OCR engines are loaded once and shared by every request
+        SimpleProcessor* proc = options.allow_text ? 
+            initTextProcessor(model_file, cmdOptionExists(argv, argv+argc, "--verbose") ? 1 : 0, &model_options) : 
+            simple_processor_init_notext(cmdOptionExists(argv, argv+argc, "--verbose") ? 1 : 0);
+
+        if (!proc) return 1;
+
+        char* panel_downscale = getCmdOption(argv, argv+argc, "--panel_downscale");
+
+        if (panel_downscale) proc->panel_downscale = atoi(panel_downscale);
+
+        proc->lazy_frames = true;
+
+        setCacheOptions(proc, argv, argv+argc);
+        setTextOptions(proc, argv, argv+argc);
+        setTraceOptions(proc, argv, argv+argc);
+
+        bool served = daemon_serve(proc, &options);
+
+        writeTrace(proc, argv, argv+argc);
+        simple_processor_free(proc);
+
+        return served ? 0 : 1;
+    }
+
+    char* connect_socket = getCmdOption(argv, argv+argc, "--connect");
+
+    if (connect_socket) {
+        std::string response;
+        DaemonStatus status;
+
+        if (cmdOptionExists(argv, argv+argc, "--daemon_stats")) {
+            status = daemon_request(connect_socket, DAEMON_REQUEST_STATS, "", info_format, 0, response);
+        } else {
+            char* input = getCmdOption(argv, argv+argc, "--input");
+
+            if (!input) {
+                printf("Chopfox-CLI Error: No input file specified (use --input <image>)\n");
+                return 1;
+            }
+
+            uint8_t flags = DAEMON_FLAG_CONTOUR;
+            if (!cmdOptionExists(argv, argv+argc, "--no_text")) flags |= DAEMON_FLAG_TEXT;
+
+            // Paths are resolved by the daemon, send the bytes when it can't read the file (other user, container, ...)
+            if (cmdOptionExists(argv, argv+argc, "--send_bytes")) {
+                std::ifstream file(input, std::ios::binary);
+                std::ostringstream bytes;
+                bytes << file.rdbuf();
+                status = daemon_request(connect_socket, DAEMON_REQUEST_BYTES, bytes.str(), info_format, flags, response);
+            } else {
+                std::error_code error;
+                std::string path = std::filesystem::absolute(input, error).string();
+                status = daemon_request(connect_socket, DAEMON_REQUEST_PATH, path, info_format, flags, response);
+            }
+        }
+
+        if (status != DAEMON_OK) {
+            printf("Chopfox-CLI Error: %s\n", response.c_str());
+            return 1;
+        }
+
+        char* xml_file = getCmdOption(argv, argv+argc, "--info_file");
+        FILE* out = xml_file ? fopen(xml_file, "wb") : stdout;
+
+        if (!out) {
+            printf("Chopfox-CLI Error: Could not write the info file\n");
+            return 1;
+        }
+
+        fwrite(response.data(), 1, response.size(), out);
+        if (out != stdout) fclose(out);
+
+        return 0;
+    }
+
+    char* frames_file = getCmdOption(argv, argv+argc, "--frames");
+
+    if (frames_file) {
+        std::vector<cv::Mat> frames;
+
+        bool include_text = !cmdOptionExists(argv, argv+argc, "--no_text");
+
+        if (!decode_image_frames_file(frames_file, frames, DECODE_UNCHANGED)) {
+            printf("Chopfox-CLI Error: Invalid input animation\n");
+            return 1;
+        }
+
+        SimpleProcessor* proc = include_text ? initTextProcessor(model_file, 0, &model_options) : simple_processor_init_notext(0);
+
+        if (!proc) return 1;
+
+        char* panel_downscale = getCmdOption(argv, argv+argc, "--panel_downscale");
+
+        if (panel_downscale) proc->panel_downscale = atoi(panel_downscale);
+
+        if (threads && include_text) simple_processor_set_workers(proc, atoi(threads));
+
+        proc->lazy_frames = !cmdOptionExists(argv, argv+argc, "--chop_output");
+
+        setCacheOptions(proc, argv, argv+argc);
+        setTextOptions(proc, argv, argv+argc);
+        setTraceOptions(proc, argv, argv+argc);
+
+        char* xml_file = getCmdOption(argv, argv+argc, "--info_file");
+        char* output_format = getCmdOption(argv, argv+argc, "--chop_output");
+
+        // XML holds a single page, so --info_file is a pattern like --chop_output; the other formats stream every frame to one file
+        InfoWriter* stream = NULL;
+        if (xml_file && info_format != INFO_FORMAT_XML) stream = info_writer_open(xml_file, info_format);
+
+        SimpleIncremental* inc = simple_incremental_init(proc, include_text);
+
+        for (int f = 0; f < frames.size(); f++) {
+            SimplePageData* data = simple_incremental_frame(inc, frames[f]);
+
+            std::string name = "frame_" + std::to_string(f);
+
+            if (stream) {
+                simple_write_info(stream, name.c_str(), *data, include_text);
+            } else if (xml_file) {
+                size_t length = snprintf(NULL, 0, xml_file, f);
+                std::string filename(length + 1, '\0'); // fill string with 0
+                sprintf(&filename[0], xml_file, f);
+                writeInfo(filename.c_str(), info_format, name.c_str(), data, include_text);
+            }
+
+            if (output_format) {
+                for (int i = 0; i < simple_frame_count(*data); i++) {
+                    if (!inc->changed[i]) continue; // unchanged panels were written with an earlier frame
+                    size_t length = snprintf(NULL, 0, output_format, f, i);
+                    std::string filename(length + 1, '\0'); // fill string with 0
+                    sprintf(&filename[0], output_format, f, i);
+                    cv::imwrite(filename.c_str(), simple_frame(*data, i));
+                }
+            }
+
+            frames[f].release();
+        }
+
+        printf("[Chopfox] Processed %d frames, %d full passes, %d panels reused, %d processed again\n", 
+            (int)inc->frames, (int)inc->full_passes, (int)inc->panels_reused, (int)inc->panels_redone);
+
+        if (stream && !info_writer_close(stream)) printf("Chopfox-CLI Error: Could not write the info file\n");
+
+        simple_incremental_free(inc);
+        writeTrace(proc, argv, argv+argc);
+        simple_processor_free(proc);
+
+        return 0;
+    }
+
     char* input_file = getCmdOption(argv, argv+argc, "--input");
 
     if (!input_file) {
-        printf("Chopfox-CLI Error: No input file specified\n");
+        printf("Chopfox-CLI Error: No input file specified (use --input <image>, --strip <image>, --frames <animation>, --batch <directory|list|cbz> or --daemon <socket>)\n");
         return 1;
     }
 
-    cv::Mat img = cv::imread(input_file, cv::IMREAD_UNCHANGED);
+    cv::Mat img = decode_image_file(input_file, DECODE_UNCHANGED); // The chops keep the alpha channel, EAST & OCR convert to BGR themselves
 
     if (img.empty()) {
         printf("Chopfox-CLI Error: Invalid input image\n");
         return 1;
     }
 
-    SimpleProcessor* proc = simple_processor_init("../frozen_east_text_detection.pb", 2);
+    SimpleProcessor* proc = initTextProcessor(model_file, 2, &model_options);
+
+    if (!proc) return 1;
+
+    char* panel_downscale = getCmdOption(argv, argv+argc, "--panel_downscale");
+
+    if (panel_downscale) proc->panel_downscale = atoi(panel_downscale);
+
+    if (threads) simple_processor_set_workers(proc, atoi(threads));
+
+    proc->lazy_frames = true; // panels are cropped one at a time as they are streamed
+
+    setCacheOptions(proc, argv, argv+argc);
+    setTextOptions(proc, argv, argv+argc);
+    setTraceOptions(proc, argv, argv+argc);
 
-    SimpleComicData data;
+    char* output_format = getCmdOption(argv, argv+argc, "--chop_output");
+    char* memory_budget = getCmdOption(argv, argv+argc, "--memory_budget");
 
-    simple_process_panels(proc, img, &data);
+    // Chops are written as soon as their text is ready, only the geometry & text are kept for the info file
+    SimplePageData data;
 
-    simple_process_chop(proc, img, &data);
+    simple_process_stream(proc, img, [&] (int index, const PanelInfo& panel, cv::Mat frame, std::vector<PageText>& text) {
+        if (index >= data.panels.size()) {
+            data.panels.resize(index + 1);
+            data.dialogue.resize(index + 1);
+        }
+        data.panels[index] = panel;
+        data.dialogue[index] = std::move(text);
 
-    simple_process_text(proc, &data);
+        if (output_format) {
+            size_t length = snprintf(NULL, 0, output_format, index);
+            std::string filename(length + 1, '\0'); // fill string with 0
+            sprintf(&filename[0], output_format, index);
+            cv::imwrite(filename.c_str(), frame);
+        }
+    }, true, memory_budget ? (size_t)atoi(memory_budget) * 1024 * 1024 : 0);
 
     char* debug_file = getCmdOption(argv, argv+argc, "--debug_file");
 
     if (debug_file) {
-        cv::Mat im_debug = img.clone();
+        // Converting also copies, so the drawing never touches the input
+        cv::Mat im_debug;
 
-        bool has_alpha = im_debug.channels() == 4;
-    
-        if (has_alpha) {
-            std::vector<cv::Mat> src_channels(4);
-            cv::split(im_debug, src_channels);
-            std::vector<cv::Mat> rgb(src_channels.begin(), src_channels.end() - 1);
-            cv::merge(rgb, im_debug);
-        };
+        if (img.channels() == 4) cv::cvtColor(img, im_debug, cv::COLOR_BGRA2BGR);
+        else if (img.channels() == 1) cv::cvtColor(img, im_debug, cv::COLOR_GRAY2BGR);
+        else im_debug = img.clone();
 
-        simple_draw_bounding_boxes(&data, im_debug);
+        simple_draw_bounding_boxes(data, im_debug);
 
         cv::imwrite(debug_file, im_debug);
 
@@ -83,20 +502,11 @@ int main (int argc, char** argv) {
 
     char* xml_file = getCmdOption(argv, argv+argc, "--info_file");
 
-    if (xml_file) {
-        simple_xml_info(&data, true).SaveFile(std::string(xml_file));
+    if (xml_file && !writeInfo(xml_file, info_format, input_file, &data, true)) {
+        printf("Chopfox-CLI Error: Could not write the info file\n");
     }
 
-    char* output_format = getCmdOption(argv, argv+argc, "--chop_output");
-
-    if (output_format) {
-        for (int i = 0; i < data.frames.size(); i++) {
-            size_t length = snprintf(NULL, 0, output_format, i);
-            std::string filename(length + 1, '\0'); // fill string with 0
-            sprintf(&filename[0], output_format, i);
-            cv::imwrite(filename.c_str(), data.frames[i]);
-        }
-    }
+    writeTrace(proc, argv, argv+argc);
 
     /* cleanup */
     simple_processor_free(proc);
@@ -0,0 +1,179 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <assert.h>
+
+namespace chopfox {
+    /**
+     * A thread safe pool of expensive to create objects (OCR engines, networks, ...)
+     * Objects are created on demand up to max_size and handed back with engine_pool_release
+     */
+    template <typename T>
+    struct EnginePool {
+        std::mutex lock;
+        std::condition_variable released;
+        std::vector<T*> idle;
+        size_t created;
+        size_t max_size;
+        std::function<T*()> create;
+        std::function<void(T*)> destroy;
+    };
+
+    /**
+     * Create a new pool
+     * @param create Function creating a new object, may return NULL on failure
+     * @param destroy Function freeing an object created by create
+     * @param max_size Max amount of objects to create (0 for no limit)
+     * @returns The new pool
+     * @remarks Free the pool with engine_pool_free
+     */
+    template <typename T>
+    struct EnginePool<T>* engine_pool_init (std::function<T*()> create, std::function<void(T*)> destroy, size_t max_size = 0) {
+        struct EnginePool<T>* pool = new struct EnginePool<T>;
+
+        pool->created = 0;
+        pool->max_size = max_size;
+        pool->create = create;
+        pool->destroy = destroy;
+
+        return pool;
+    }
+
+    /**
+     * Check out an object from the pool, creating one if none are idle
+     * Blocks until one is released when max_size objects are already checked out
+     * @param pool The pool to check out from
+     * @returns The object or NULL if it could not be created
+     */
+    template <typename T>
+    T* engine_pool_acquire (struct EnginePool<T>* pool) {
+        std::unique_lock<std::mutex> guard(pool->lock);
+
+        while (pool->idle.empty() && pool->max_size != 0 && pool->created >= pool->max_size)
+            pool->released.wait(guard);
+
+        if (!pool->idle.empty()) {
+            T* item = pool->idle.back();
+            pool->idle.pop_back();
+            return item;
+        }
+
+        pool->created++;
+        guard.unlock();
+
+        // Creation is slow, don't hold the lock while doing it
+        T* item = pool->create();
+
+        if (!item) {
+            guard.lock();
+            pool->created--;
+            pool->released.notify_one();
+        }
+
+        return item;
+    }
+
+    /**
+     * Return an object to the pool
+     * @param pool The pool the object was checked out from
+     * @param item The object to return
+     */
+    template <typename T>
+    void engine_pool_release (struct EnginePool<T>* pool, T* item) {
+        assert(item);
+        {
+            std::lock_guard<std::mutex> guard(pool->lock);
+            pool->idle.push_back(item);
+        }
+        pool->released.notify_one();
+    }
+
+    /**
+     * An object checked out of a pool for the lifetime of the lease, released even when the code using it throws
+     * A NULL pool gives an empty lease, for objects that are only needed sometimes.
+     */
+    template <typename T>
+    struct EnginePoolLease {
+        struct EnginePool<T>* pool;
+        T* item; // NULL if the object could not be created
+
+        EnginePoolLease (struct EnginePool<T>* pool) : pool(pool), item(pool ? engine_pool_acquire(pool) : NULL) {}
+        ~EnginePoolLease () { if (item) engine_pool_release(pool, item); }
+        EnginePoolLease (const EnginePoolLease&) = delete;
+        EnginePoolLease& operator= (const EnginePoolLease&) = delete;
+    };
+
+    /**
+     * Hand an object created elsewhere over to the pool, it will be freed with the pool
+     * @param pool The pool to add to
+     * @param item The object to add
+     */
+    template <typename T>
+    void engine_pool_add (struct EnginePool<T>* pool, T* item) {
+        assert(item);
+        {
+            std::lock_guard<std::mutex> guard(pool->lock);
+            pool->idle.push_back(item);
+            pool->created++;
+        }
+        pool->released.notify_one();
+    }
+
+    /**
+     * Create objects up front so the first calls don't pay for initialization
+     * @param pool The pool to warm
+     * @param count The amount of idle objects the pool should hold
+     */
+    template <typename T>
+    void engine_pool_warm (struct EnginePool<T>* pool, size_t count) {
+        if (pool->max_size != 0 && count > pool->max_size) count = pool->max_size;
+
+        std::vector<T*> items;
+        for (size_t i = 0; i < count; i++) {
+            {
+                std::lock_guard<std::mutex> guard(pool->lock);
+                if (pool->created >= count) break;
+            }
+            T* item = engine_pool_acquire(pool);
+            if (!item) break;
+            items.push_back(item);
+        }
+        for (auto &item : items) engine_pool_release(pool, item);
+    }
+
+    /**
+     * Free the pool and all the objects it holds
+     * @param pool The pool to free
+     * @remarks All objects must be released before freeing the pool
+     */
+    template <typename T>
+    void engine_pool_free (struct EnginePool<T>* pool) {
+        if (!pool) return;
+        assert(pool->idle.size() == pool->created);
+        for (auto &item : pool->idle) pool->destroy(item);
+        delete pool;
+    }
+}
+
+#endif
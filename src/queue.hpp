@@ -0,0 +1,125 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace chopfox {
+    /**
+     * A thread safe FIFO queue holding at most capacity items, used to connect pipeline stages
+     * Producers block while the queue is full, consumers block while it is empty
+     */
+    template <typename T>
+    struct BoundedQueue {
+        std::mutex lock;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed;
+    };
+
+    /**
+     * Create a new queue
+     * @param capacity The max amount of items held by the queue
+     * @returns The new queue
+     * @remarks Free the queue with bounded_queue_free
+     */
+    template <typename T>
+    struct BoundedQueue<T>* bounded_queue_init (size_t capacity) {
+        struct BoundedQueue<T>* queue = new struct BoundedQueue<T>;
+
+        queue->capacity = capacity > 0 ? capacity : 1;
+        queue->closed = false;
+
+        return queue;
+    }
+
+    /**
+     * Add an item to the back of the queue, blocks while the queue is full
+     * @param queue The queue to add to
+     * @param item The item to add
+     * @returns false if the queue was closed and the item was not added
+     */
+    template <typename T>
+    bool bounded_queue_push (struct BoundedQueue<T>* queue, T item) {
+        std::unique_lock<std::mutex> guard(queue->lock);
+
+        while (!queue->closed && queue->items.size() >= queue->capacity)
+            queue->not_full.wait(guard);
+
+        if (queue->closed) return false;
+
+        queue->items.push_back(std::move(item));
+        guard.unlock();
+        queue->not_empty.notify_one();
+
+        return true;
+    }
+
+    /**
+     * Take the item at the front of the queue, blocks while the queue is empty
+     * @param queue The queue to take from
+     * @param out The item taken
+     * @returns false once the queue is closed and no items are left
+     */
+    template <typename T>
+    bool bounded_queue_pop (struct BoundedQueue<T>* queue, T& out) {
+        std::unique_lock<std::mutex> guard(queue->lock);
+
+        while (!queue->closed && queue->items.empty())
+            queue->not_empty.wait(guard);
+
+        if (queue->items.empty()) return false;
+
+        out = std::move(queue->items.front());
+        queue->items.pop_front();
+        guard.unlock();
+        queue->not_full.notify_one();
+
+        return true;
+    }
+
+    /**
+     * Stop accepting new items, consumers drain the remaining items and then stop
+     * @param queue The queue to close
+     */
+    template <typename T>
+    void bounded_queue_close (struct BoundedQueue<T>* queue) {
+        {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            queue->closed = true;
+        }
+        queue->not_empty.notify_all();
+        queue->not_full.notify_all();
+    }
+
+    /**
+     * Free the queue and any items left in it
+     * @param queue The queue to free
+     */
+    template <typename T>
+    void bounded_queue_free (struct BoundedQueue<T>* queue) {
+        delete queue;
+    }
+}
+
+#endif
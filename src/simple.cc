@@ -18,6 +18,14 @@
 #include "simple.hpp"
 #include <stdio.h>
 #include <assert.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
 
 namespace chopfox {
     struct SimpleProcessor* simple_processor_init (
@@ -27,9 +35,23 @@ namespace chopfox {
         float text_score_thresh,
         double panel_precision,
         int image_ppi,
-        double panel_min_area_divider
+        double panel_min_area_divider,
+        int ocr_engines,
+        const struct TextModelOptions* model_options
     ) {
-        return simple_processor_init(cv::dnn::readNet(east_model_path), log_level, lang, text_score_thresh, panel_precision, image_ppi, panel_min_area_divider);
+        cv::dnn::Net detector = text_detector_load(east_model_path, model_options);
+        struct SimpleProcessor* ptr = simple_processor_init(detector, log_level, lang, text_score_thresh, panel_precision, image_ppi, panel_min_area_divider, ocr_engines);
+        if (!ptr) return NULL;
+
+        ptr->text_model_path = east_model_path;
+        if (model_options) ptr->text_model = *model_options;
+
+        if (log_level >= 1 && model_options && model_options->precision != TEXT_PRECISION_FP32) {
+            printf("[Chopfox] %s the EAST model at %s\n", detector.empty() ? "Could not load" : "Loaded", model_options->precision == TEXT_PRECISION_INT8 ? "INT8" : "FP16");
+        }
+        ptr->detector_pool->max_size = 0; // copies can be loaded from the model path
+
+        return ptr;
     }
 
     struct SimpleProcessor* simple_processor_init (
@@ -39,7 +61,8 @@ namespace chopfox {
         float text_score_thresh,
         double panel_precision,
         int image_ppi,
-        double panel_min_area_divider
+        double panel_min_area_divider,
+        int ocr_engines
     ) {
         struct SimpleProcessor* ptr = simple_processor_init_notext(log_level, panel_precision, panel_min_area_divider);
 
@@ -48,6 +71,36 @@ namespace chopfox {
         ptr->text_score_thresh = text_score_thresh;
         ptr->text_detector = text_detector;
 
+        // Loading the traineddata is slow, keep the engines around and reuse them for every panel
+        ptr->ocr_pool = engine_pool_init<tesseract::TessBaseAPI>(
+            [lang] () { return ocr_engine_init(lang); },
+            ocr_engine_free
+        );
+
+        // At least one engine, so a language that can't be loaded fails here instead of in the middle of a page
+        engine_pool_warm(ptr->ocr_pool, std::max(ocr_engines, 1));
+
+        if (ptr->ocr_pool->created == 0) {
+            if (log_level >= 1) printf("[Chopfox] Could not initialize tesseract-ocr with the %s language\n", lang);
+            simple_processor_free(ptr);
+            return NULL;
+        }
+
+        if (log_level >= 1) printf("[Chopfox] Initialized %d OCR engines\n", (int)ptr->ocr_pool->created);
+
+        // Without a model path the network can't be copied, so all the workers share it
+        ptr->detector_pool = engine_pool_init<cv::dnn::Net>(
+            [ptr] () {
+                if (ptr->text_model_path.empty()) return (cv::dnn::Net*)NULL;
+                cv::dnn::Net net = text_detector_load(ptr->text_model_path.c_str(), &ptr->text_model);
+                return net.empty() ? NULL : new cv::dnn::Net(net);
+            },
+            [] (cv::dnn::Net* net) { delete net; },
+            1
+        );
+
+        engine_pool_add(ptr->detector_pool, new cv::dnn::Net(text_detector));
+
         return ptr;
     }
 
@@ -61,16 +114,161 @@ namespace chopfox {
         ptr->log_level = log_level;
         ptr->panel_precision = panel_precision;
         ptr->panel_min_area_divider = panel_min_area_divider;
+        ptr->ocr_pool = NULL;
+        ptr->text_batch_size = 8;
+        ptr->text_limits.max_side = 0; // Off: capping changes the detections on large panels, callers opt in
+        ptr->text_limits.large_frames = TEXT_LARGE_AUTO;
+        ptr->text_limits.min_text_height = 24;
+        ptr->text_limits.tile_overlap = 128;
+        ptr->text_prefilter.thumb_side = 0;
+        ptr->text_prefilter.min_contrast = 48;
+        ptr->text_prefilter.min_density = 0.002;
+        ptr->panels_textless = 0;
+        ptr->text_model.backend = cv::dnn::DNN_BACKEND_DEFAULT;
+        ptr->text_model.target = cv::dnn::DNN_TARGET_CPU;
+        ptr->text_model.precision = TEXT_PRECISION_FP32;
+        ptr->detector_pool = NULL;
+        ptr->text_workers = 1;
+        ptr->panel_downscale = 1;
+        ptr->lazy_frames = false;
+        ptr->text_grouping = TEXT_GROUPING_MASK;
+        ptr->text_recognition = TEXT_RECOGNITION_BLOCK;
+        ptr->workspace_pool = engine_pool_init<struct Workspace>(workspace_init, workspace_free);
+        ptr->cache = NULL;
+        ptr->tracer = NULL;
 
         return ptr;
     }
 
+    void simple_processor_set_workers (struct SimpleProcessor* proc, int workers) {
+        assert(proc->ocr_pool && proc->detector_pool);
+
+        if (workers < 1) workers = 1;
+
+        proc->text_workers = workers;
+
+        engine_pool_warm(proc->ocr_pool, workers);
+        if (!proc->text_model_path.empty()) engine_pool_warm(proc->detector_pool, workers);
+
+        if (proc->log_level >= 1) printf("[Chopfox] Using %d text workers\n", workers);
+    }
+
+    void simple_workspace_stats (struct SimpleProcessor* proc, size_t* reused, size_t* allocated, size_t* retained_bytes) {
+        std::lock_guard<std::mutex> guard(proc->workspace_pool->lock);
+
+        *reused = *allocated = *retained_bytes = 0;
+        for (auto &ws : proc->workspace_pool->idle) {
+            *reused += ws->reused;
+            *allocated += ws->allocated;
+            *retained_bytes += workspace_retained_bytes(ws);
+        }
+    }
+
+    bool simple_processor_set_cache (struct SimpleProcessor* proc, const char* dir, size_t max_bytes) {
+        result_cache_close(proc->cache);
+        proc->cache = result_cache_open(dir, max_bytes);
+
+        if (proc->log_level >= 1) printf("[Chopfox] %s cache %s\n", proc->cache ? "Using" : "Could not open", dir);
+
+        return proc->cache != NULL;
+    }
+
+    uint64_t simple_cache_key (struct SimpleProcessor* proc, cv::Mat img, bool include_text) {
+        std::ostringstream params;
+        params.precision(17);
+        params << "panels " << proc->panel_precision << " " << proc->panel_min_area_divider << " " << proc->panel_downscale;
+        if (include_text) {
+            params << " text " << proc->text_score_thresh << " " << proc->text_lang << " " << proc->image_ppi << " " << (int)proc->text_grouping << " " << (int)proc->text_recognition << " " << proc->text_model_path << " " << (int)proc->text_model.precision;
+            params << " " << proc->text_limits.max_side << " " << (int)proc->text_limits.large_frames << " " << proc->text_limits.min_text_height << " " << proc->text_limits.tile_overlap;
+            if (proc->text_prefilter.thumb_side > 0) params << " prefilter " << proc->text_prefilter.thumb_side << " " << proc->text_prefilter.min_contrast << " " << proc->text_prefilter.min_density;
+        }
+
+        std::string value = params.str();
+        return result_cache_hash_image(img, result_cache_hash_bytes(value.data(), value.size()));
+    }
+
+    bool simple_cache_lookup (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimplePageData* out,
+        bool include_text,
+        uint64_t* key
+    ) {
+        *key = 0;
+        if (!proc->cache) return false;
+
+        *key = simple_cache_key(proc, img, include_text);
+
+        PanelArray panels;
+        std::vector<std::vector<struct PageText>> dialogue;
+        if (!result_cache_load(proc->cache, *key, panels, dialogue)) return false;
+
+        trace_count(proc->tracer, "cache_hits", 1);
+        out->panels = std::move(panels);
+
+        // Views whether or not the processor uses lazy_frames, a hit shouldn't pay for cropping every panel up front
+        out->frames.clear();
+        out->views = view_frames(img, out->panels);
+        out->dialogue.insert(out->dialogue.end(), std::make_move_iterator(dialogue.begin()), std::make_move_iterator(dialogue.end()));
+
+        if (proc->log_level >= 1) printf("[Chopfox] Found %d panels in the cache\n", (int)out->panels.size());
+
+        return true;
+    }
+
+    void simple_cache_store (struct SimpleProcessor* proc, uint64_t key, struct SimplePageData* data, bool include_text) {
+        if (!proc->cache) return;
+
+        // The text of the page is only copied out when the data holds the text of other pages as well
+        static const std::vector<std::vector<struct PageText>> no_text;
+        if (!include_text) {
+            result_cache_store(proc->cache, key, data->panels, no_text);
+        } else if (data->dialogue.size() == data->panels.size()) {
+            result_cache_store(proc->cache, key, data->panels, data->dialogue);
+        } else {
+            std::vector<std::vector<struct PageText>> dialogue(data->dialogue.end() - data->panels.size(), data->dialogue.end());
+            result_cache_store(proc->cache, key, data->panels, dialogue);
+        }
+    }
+
+    bool simple_process_page (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimplePageData* out,
+        bool include_text
+    ) {
+        uint64_t key;
+
+        if (simple_cache_lookup(proc, img, out, include_text, &key)) return true;
+
+        simple_process_panels(proc, img, out);
+        simple_process_chop(proc, img, out);
+        if (include_text) simple_process_text(proc, out);
+
+        simple_cache_store(proc, key, out, include_text);
+
+        return false;
+    }
+
+    struct SimplePageData simple_process_page (struct SimpleProcessor* proc, cv::Mat img, bool include_text) {
+        struct SimplePageData data;
+        simple_process_page(proc, img, &data, include_text);
+        return data;
+    }
+
     void simple_process_panels (
         struct SimpleProcessor* proc, 
         cv::Mat img,
-        struct SimpleComicData* out
+        struct SimplePageData* out
     ) {
-        out->panels = get_panels_rgb(img, proc->panel_precision, proc->panel_min_area_divider);
+        EnginePoolLease<struct Workspace> ws(proc->workspace_pool);
+
+        int64_t span = trace_begin(proc->tracer);
+        if (proc->panel_downscale > 1) out->panels = get_panels_coarse(img, proc->panel_precision, proc->panel_min_area_divider, proc->panel_downscale, ws.item);
+        else out->panels = get_panels_rgb(img, proc->panel_precision, proc->panel_min_area_divider, ws.item);
+        trace_end(proc->tracer, "panel_detect", span);
+        trace_count(proc->tracer, "pages", 1);
+        trace_count(proc->tracer, "panels", out->panels.size());
 
         if (proc->log_level >= 1) printf("[Chopfox] Found %d panels\n", out->panels.size());
     }
@@ -78,51 +276,344 @@ namespace chopfox {
     void simple_process_chop (
         struct SimpleProcessor* proc, 
         cv::Mat img,
-        struct SimpleComicData* out
+        struct SimplePageData* out
     ) {
-        out->frames = crop_frames(img, out->panels);
+        int64_t span = trace_begin(proc->tracer);
+        if (proc->lazy_frames) {
+            out->views = view_frames(img, out->panels);
+        } else {
+            EnginePoolLease<struct Workspace> ws(proc->workspace_pool);
+            out->frames = crop_frames(img, out->panels, ws.item);
+        }
+        trace_end(proc->tracer, "chop", span);
         if (proc->log_level >= 1) printf("[Chopfox] Chopped up panels...\n");
     }
 
+    std::vector<std::vector<int>> simple_text_batches (struct SimpleProcessor* proc, struct SimplePageData* data, int batch_size) {
+        int frame_count = simple_frame_count(*data);
+        bool prefilter = proc->text_prefilter.thumb_side > 0;
+
+        EnginePoolLease<struct Workspace> ws(prefilter ? proc->workspace_pool : NULL);
+
+        std::vector<int> candidates;
+        std::vector<cv::Size> frame_sizes;
+        for (int i = 0; i < frame_count; i++) {
+            if (prefilter) {
+                int64_t span = trace_begin(proc->tracer);
+                bool likely = text_likely(simple_frame(*data, i, ws.item), &proc->text_prefilter, ws.item);
+                trace_end(proc->tracer, "text_prefilter", span, i);
+                if (!likely) continue;
+            }
+            candidates.push_back(i);
+            frame_sizes.push_back(data->frames.empty() ? data->views[i].roi.size() : data->frames[i].size());
+        }
+
+        int skipped = frame_count - candidates.size();
+        proc->panels_textless += skipped;
+        trace_count(proc->tracer, "panels_textless", skipped);
+        if (prefilter && proc->log_level >= 2) printf("[Chopfox] Skipped %d panels without text\n", skipped);
+
+        // One forward pass per batch of similarly sized panels
+        std::vector<std::vector<int>> batches = text_batch_buckets(frame_sizes, batch_size, &proc->text_limits);
+        for (auto &batch : batches) {
+            for (auto &i : batch) i = candidates[i];
+        }
+
+        return batches;
+    }
+
+    void simple_process_text_batch (
+        struct SimpleProcessor* proc,
+        struct SimplePageData* out,
+        size_t first,
+        const std::vector<int>& batch,
+        struct Workspace* ws,
+        std::vector<cv::Mat>* batch_frames
+    ) {
+        // Lazy views are only cropped for as long as the batch needs them
+        std::vector<cv::Mat> frames;
+        std::vector<int> indices;
+        for (int k = 0; k < batch.size(); k++) {
+            frames.push_back(simple_frame(*out, batch[k], ws));
+            indices.push_back(k);
+        }
+
+        int64_t start = cv::getTickCount();
+        std::vector<struct TextDetections> detections;
+        {
+            EnginePoolLease<cv::dnn::Net> detector(proc->detector_pool);
+            if (!detector.item) throw std::runtime_error("Could not load a copy of the EAST model");
+            detect_text_batch(frames, indices, *detector.item, proc->text_score_thresh, detections, ws, proc->tracer, &proc->text_limits);
+        }
+        if (proc->log_level >= 3) printf("[Chopfox] Detected text in batch of %d frames in %.2fms\n", (int)batch.size(), (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+
+        EnginePoolLease<tesseract::TessBaseAPI> ocr(proc->ocr_pool);
+        if (!ocr.item) throw std::runtime_error("Could not initialize a tesseract-ocr engine");
+        for (int k = 0; k < batch.size(); k++) {
+            int i = batch[k];
+            start = cv::getTickCount();
+            int64_t span = trace_begin(proc->tracer);
+            std::vector<struct PageText> text = recognize_text(frames[k], detections[k], ocr.item, proc->image_ppi, proc->text_grouping, ws, proc->tracer, proc->text_recognition);
+            trace_end(proc->tracer, "panel_text", span, i);
+            if (proc->log_level >= 2) printf("[Chopfox] Found %d text regions in frame %d\n", text.size(), i);
+            if (proc->log_level >= 3) printf("[Chopfox] Transcribed frame %d in %.2fms\n", i, (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+            out->dialogue[first + i] = std::move(text);
+        }
+
+        if (batch_frames) *batch_frames = std::move(frames);
+    }
+
     void simple_process_text (
         struct SimpleProcessor* proc,
-        struct SimpleComicData* out
+        struct SimplePageData* out
     ) {
         assert(!proc->text_detector.empty());
+        assert(proc->ocr_pool);
 
         if (proc->log_level >= 1) printf("[Chopfox] Trascribing...\n");
 
-        for (int i = 0; i < out->frames.size(); i++) {
-            std::vector<struct TextBlock> text = transcribe(out->frames[i], proc->text_detector, proc->text_score_thresh, proc->text_lang, proc->image_ppi);
-            if (proc->log_level >= 2) printf("[Chopfox] Found %d text regions in frame %d\n", text.size(), i);
-            out->dialogue.push_back(text);
+        int frame_count = simple_frame_count(*out);
+
+        size_t first = out->dialogue.size();
+        out->dialogue.resize(first + frame_count);
+
+        int workers = proc->text_workers;
+        if (workers > frame_count) workers = frame_count;
+        if (workers < 1) workers = 1;
+
+        // Keep enough batches around for all the workers to have something to do
+        int batch_size = proc->text_batch_size;
+        int per_worker = (frame_count + workers - 1) / workers;
+        if (batch_size > per_worker) batch_size = per_worker;
+
+        std::vector<std::vector<int>> batches = simple_text_batches(proc, out, batch_size);
+
+        if (proc->log_level >= 2) printf("[Chopfox] Detecting text in %d batches on %d workers\n", (int)batches.size(), workers);
+
+        // Workers take the next batch until there is none left, results go to the panel's own slot so the order is kept
+        // The first exception of a worker stops the others and is rethrown on the calling thread
+        std::atomic<int> next_batch(0);
+        std::mutex error_lock;
+        std::exception_ptr error;
+        auto worker = [&] () {
+            EnginePoolLease<struct Workspace> ws(proc->workspace_pool);
+
+            for (int b = next_batch++; b < batches.size(); b = next_batch++) {
+                try {
+                    simple_process_text_batch(proc, out, first, batches[b], ws.item);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(error_lock);
+                    if (!error) error = std::current_exception();
+                    next_batch = batches.size();
+                }
+            }
+        };
+
+        int64_t start = cv::getTickCount();
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workers; i++) threads.push_back(std::thread(worker));
+        worker();
+        for (auto &thread : threads) thread.join();
+
+        if (error) std::rethrow_exception(error);
+
+        if (proc->log_level >= 3) printf("[Chopfox] Transcribed %d frames on %d workers in %.2fms\n", frame_count, workers, (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+    }
+
+    /**
+     * Bytes held by the panels in flight, workers wait for room before starting a batch
+     */
+    struct StreamBudget {
+        std::mutex lock;
+        std::condition_variable room;
+        size_t limit; // 0 for no limit
+        size_t used;
+        size_t peak;
+    };
+
+    static void stream_budget_take (struct StreamBudget* budget, size_t bytes) {
+        std::unique_lock<std::mutex> guard(budget->lock);
+        while (budget->limit > 0 && budget->used > 0 && budget->used + bytes > budget->limit) budget->room.wait(guard);
+        budget->used += bytes;
+        budget->peak = std::max(budget->peak, budget->used);
+    }
+
+    static void stream_budget_give (struct StreamBudget* budget, size_t bytes) {
+        {
+            std::lock_guard<std::mutex> guard(budget->lock);
+            budget->used -= bytes;
         }
+        budget->room.notify_all();
     }
 
-    void simple_processor_free (struct SimpleProcessor* ptr) {
-        delete ptr;
+    /**
+     * Estimated peak bytes of a panel: its crop, the resized copy fed to EAST, the FP32 blob (12 bytes per pixel) 
+     * and the score & geometry maps (6 floats per 4x4 pixels)
+     */
+    static size_t stream_panel_bytes (struct SimpleProcessor* proc, cv::Size size, size_t pixel_bytes, bool include_text) {
+        size_t bytes = (size_t)size.area() * pixel_bytes;
+        if (!include_text) return bytes;
+
+        std::vector<struct TextInput> inputs;
+        text_input_plan(size, 0, &proc->text_limits, inputs);
+
+        bytes += (size_t)inputs[0].scaled.area() * 3;
+        for (auto &input : inputs) bytes += (size_t)input.tile.area() * 12 + (size_t)input.tile.area() * 6 * 4 / 16;
+
+        return bytes;
     }
 
-    void simple_data_free (struct SimpleComicData data) {
-        free_mat_vector(data.frames);
+    size_t simple_process_stream (
+        struct SimpleProcessor* proc,
+        cv::Mat img,
+        SimpleStreamCallback on_panel,
+        bool include_text,
+        size_t memory_budget
+    ) {
+        assert(!include_text || proc->ocr_pool);
+
+        struct SimplePageData data;
+        uint64_t key = 0;
+        bool cached = simple_cache_lookup(proc, img, &data, include_text, &key);
+
+        // Views only, the pixels are copied when a panel is emitted
+        if (!cached) {
+            simple_process_panels(proc, img, &data);
+            data.views = view_frames(img, data.panels);
+        }
+
+        int count = data.panels.size();
+        bool transcribe = include_text && !cached && count > 0;
+        bool store = !cached && proc->cache; // the cache is written once every panel is done
+        bool keep_text = store && include_text;
+        if (include_text) data.dialogue.resize(count);
+
+        struct StreamBudget budget;
+        budget.limit = memory_budget;
+        budget.used = 0;
+        budget.peak = 0;
+
+        std::mutex callback_lock;
+        auto emit = [&] (int i, cv::Mat frame) {
+            std::vector<struct PageText> text;
+            if (include_text) {
+                if (keep_text) text = data.dialogue[i];
+                else text.swap(data.dialogue[i]);
+            }
+
+            std::lock_guard<std::mutex> guard(callback_lock);
+            on_panel(i, data.panels[i], frame, text);
+        };
+
+        auto release = [&] (int i) {
+            if (!data.frames.empty()) data.frames[i].release();
+        };
+
+        std::vector<std::vector<int>> batches;
+        if (transcribe) batches = simple_text_batches(proc, &data, proc->text_batch_size);
+
+        std::vector<bool> batched(count, false);
+        for (auto &batch : batches) {
+            for (auto &i : batch) batched[i] = true;
+        }
+
+        int64_t span = trace_begin(proc->tracer);
+
+        {
+            EnginePoolLease<struct Workspace> ws(proc->workspace_pool);
+            for (int i = 0; i < count; i++) {
+                if (batched[i]) continue;
+
+                size_t bytes = stream_panel_bytes(proc, data.panels[i].bounding_box.size(), img.elemSize(), false);
+                stream_budget_take(&budget, bytes);
+                emit(i, simple_frame(data, i, ws.item));
+                release(i);
+                stream_budget_give(&budget, bytes);
+            }
+        }
+
+        // Same workers as simple_process_text, a batch only starts once the budget has room for it
+        int workers = std::max(1, std::min(proc->text_workers, (int)batches.size()));
+
+        std::atomic<int> next_batch(0);
+        std::exception_ptr error;
+        auto worker = [&] () {
+            EnginePoolLease<struct Workspace> ws(proc->workspace_pool);
+
+            for (int b = next_batch++; b < batches.size(); b = next_batch++) {
+                size_t bytes = 0;
+                for (auto &i : batches[b]) bytes += stream_panel_bytes(proc, data.panels[i].bounding_box.size(), img.elemSize(), true);
+
+                stream_budget_take(&budget, bytes);
+                try {
+                    std::vector<cv::Mat> frames;
+                    simple_process_text_batch(proc, &data, 0, batches[b], ws.item, &frames);
+                    for (int k = 0; k < batches[b].size(); k++) {
+                        emit(batches[b][k], frames[k]);
+                        frames[k].release();
+                        release(batches[b][k]);
+                    }
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(callback_lock);
+                    if (!error) error = std::current_exception();
+                    next_batch = batches.size(); // skip the rest
+                }
+                stream_budget_give(&budget, bytes);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workers; i++) threads.push_back(std::thread(worker));
+        worker();
+        for (auto &thread : threads) thread.join();
+
+        trace_end(proc->tracer, "stream", span);
+
+        if (error) std::rethrow_exception(error);
+
+        if (store) simple_cache_store(proc, key, &data, include_text);
+
+        if (proc->log_level >= 2) printf("[Chopfox] Streamed %d panels, peak of %.1fMB in flight\n", count, budget.peak / (1024.0 * 1024.0));
+
+        return budget.peak;
     }
 
-    void simple_draw_bounding_boxes (
-        struct SimpleComicData* data,
+    /// Read-only functions, shared by SimplePageData & SimpleComicData through templates so neither is copied
+
+    template <typename Data>
+    static int frame_count (const Data& data) {
+        return data.frames.empty() ? data.views.size() : data.frames.size();
+    }
+
+    template <typename Data>
+    static cv::Mat frame_at (const Data& data, int index, struct Workspace* ws) {
+        if (!data.frames.empty()) return data.frames[index];
+
+        cv::Mat frame;
+        panel_view_materialize(data.views[index], frame, ws);
+        return frame;
+    }
+
+    template <typename Text>
+    static void draw_bounding_boxes (
+        const PanelArray& panels,
+        const std::vector<std::vector<Text>>& dialogue,
         cv::Mat dst,
         cv::Scalar text_color,
         cv::Scalar panel_color,
         int text_thickness,
         int panel_thickness
     ) {
-        for (int i = 0; i < data->panels.size(); i++) {
+        for (int i = 0; i < panels.size(); i++) {
             std::vector<std::vector<cv::Point>> cnt;
-            cnt.push_back(data->panels[i].contour);
+            cnt.push_back(panels[i].contour);
             cv::drawContours(dst, cnt, -1, panel_color, panel_thickness);
-            for (auto &text: data->dialogue[i]) {
+            if (i >= dialogue.size()) continue;
+            for (auto &text: dialogue[i]) {
                 cv::Rect offset_rec(
-                    data->panels[i].bounding_box.x + text.bounding_box.x, 
-                    data->panels[i].bounding_box.y + text.bounding_box.y,
+                    panels[i].bounding_box.x + text.bounding_box.x, 
+                    panels[i].bounding_box.y + text.bounding_box.y,
                     text.bounding_box.width,
                     text.bounding_box.height
                 );
@@ -131,22 +622,23 @@ namespace chopfox {
         }
     }
 
-    TiXmlDocument simple_xml_info (struct SimpleComicData* data, bool include_text, bool include_contour) {
+    template <typename Text>
+    static TiXmlDocument xml_info (const PanelArray& panels, const std::vector<std::vector<Text>>& dialogue, bool include_text, bool include_contour) {
         TiXmlDocument doc;
         TiXmlDeclaration decl("1.0", "", "" );
         TiXmlComment gen("Generated by Chopfox");
         doc.InsertEndChild(decl);
         doc.InsertEndChild(gen);
         TiXmlElement root("comic-strip");
-        for (int i = 0; i < data->panels.size(); i++) {
+        for (int i = 0; i < panels.size(); i++) {
             TiXmlElement panel("panel");
-            panel.SetAttribute("top", data->panels[i].bounding_box.x);
-            panel.SetAttribute("left", data->panels[i].bounding_box.y);
-            panel.SetAttribute("width", data->panels[i].bounding_box.width);
-            panel.SetAttribute("height", data->panels[i].bounding_box.height);
+            panel.SetAttribute("top", panels[i].bounding_box.x);
+            panel.SetAttribute("left", panels[i].bounding_box.y);
+            panel.SetAttribute("width", panels[i].bounding_box.width);
+            panel.SetAttribute("height", panels[i].bounding_box.height);
             if (include_contour) {
                 std::ostringstream path;
-                for (auto &point : data->panels[i].contour) {
+                for (auto &point : panels[i].contour) {
                     path << point.x << " " << point.y << " ";
                 }
                 std::string path_value = path.str();
@@ -154,15 +646,15 @@ namespace chopfox {
                 panel.SetAttribute("path", path_value.c_str());
             }
             if (include_text) {
-                for (auto &text : data->dialogue[i]) {
-                    TiXmlElement dialogue("dialogue");
-                    dialogue.SetAttribute("top", text.bounding_box.x);
-                    dialogue.SetAttribute("left", text.bounding_box.y);
-                    dialogue.SetAttribute("width", text.bounding_box.width);
-                    dialogue.SetAttribute("height", text.bounding_box.height);
-                    TiXmlText dialogue_text(text.text);
-                    dialogue.InsertEndChild(dialogue_text);
-                    panel.InsertEndChild(dialogue);
+                for (auto &text : dialogue[i]) {
+                    TiXmlElement dialogue_element("dialogue");
+                    dialogue_element.SetAttribute("top", text.bounding_box.x);
+                    dialogue_element.SetAttribute("left", text.bounding_box.y);
+                    dialogue_element.SetAttribute("width", text.bounding_box.width);
+                    dialogue_element.SetAttribute("height", text.bounding_box.height);
+                    TiXmlText dialogue_text(text_string(text));
+                    dialogue_element.InsertEndChild(dialogue_text);
+                    panel.InsertEndChild(dialogue_element);
                 }
             }
             root.InsertEndChild(panel);
@@ -170,4 +662,146 @@ namespace chopfox {
         doc.InsertEndChild(root);
         return doc;
     }
-}
\ No newline at end of file
+
+    template <typename Text>
+    static bool write_info (struct InfoWriter* writer, const char* name, const PanelArray& panels, const std::vector<std::vector<Text>>& dialogue, bool include_text, bool include_contour) {
+        static const std::vector<std::vector<Text>> no_text;
+
+        return info_writer_page(writer, name, panels, include_text ? dialogue : no_text, include_contour);
+    }
+
+    int simple_frame_count (const struct SimplePageData& data) {
+        return frame_count(data);
+    }
+
+    cv::Mat simple_frame (const struct SimplePageData& data, int index, struct Workspace* ws) {
+        return frame_at(data, index, ws);
+    }
+
+    void simple_processor_free (struct SimpleProcessor* ptr) {
+        engine_pool_free(ptr->ocr_pool);
+        engine_pool_free(ptr->detector_pool);
+        engine_pool_free(ptr->workspace_pool);
+        result_cache_close(ptr->cache);
+        delete ptr;
+    }
+
+    void simple_data_rescale (struct SimplePageData* data, cv::Size from, cv::Size to) {
+        if (from == to) return;
+
+        rescale_panels(data->panels, from, to);
+
+        double sx = (double)to.width / from.width;
+        double sy = (double)to.height / from.height;
+        for (auto &blocks : data->dialogue) {
+            for (auto &block : blocks) {
+                cv::Rect& box = block.bounding_box;
+                box = cv::Rect(cvRound(box.x * sx), cvRound(box.y * sy), cvRound(box.width * sx), cvRound(box.height * sy));
+            }
+        }
+
+        free_mat_vector(data->frames);
+        data->views.clear();
+    }
+
+    void simple_data_free (struct SimplePageData& data) {
+        free_mat_vector(data.frames);
+        data = SimplePageData();
+    }
+
+    void simple_draw_bounding_boxes (
+        const struct SimplePageData& data,
+        cv::Mat dst,
+        cv::Scalar text_color,
+        cv::Scalar panel_color,
+        int text_thickness,
+        int panel_thickness
+    ) {
+        draw_bounding_boxes(data.panels, data.dialogue, dst, text_color, panel_color, text_thickness, panel_thickness);
+    }
+
+    TiXmlDocument simple_xml_info (const struct SimplePageData& data, bool include_text, bool include_contour) {
+        return xml_info(data.panels, data.dialogue, include_text, include_contour);
+    }
+
+    bool simple_write_info (struct InfoWriter* writer, const char* name, const struct SimplePageData& data, bool include_text, bool include_contour) {
+        return write_info(writer, name, data.panels, data.dialogue, include_text, include_contour);
+    }
+
+    /**
+     * Move the panels & frames of a SimpleComicData into a SimplePageData, the existing dialogue is left as empty placeholders
+     */
+    static struct SimplePageData simple_data_borrow (struct SimpleComicData* data) {
+        struct SimplePageData page;
+        page.panels = std::move(data->panels);
+        page.frames = std::move(data->frames);
+        page.views = std::move(data->views);
+        page.dialogue.resize(data->dialogue.size());
+        return page;
+    }
+
+    /**
+     * Move the panels & frames back, the dialogue added since simple_data_borrow is copied into C strings
+     */
+    static void simple_data_return (struct SimplePageData& page, struct SimpleComicData* data) {
+        data->panels = std::move(page.panels);
+        data->frames = std::move(page.frames);
+        data->views = std::move(page.views);
+        for (size_t i = data->dialogue.size(); i < page.dialogue.size(); i++) data->dialogue.push_back(text_blocks_export(page.dialogue[i]));
+    }
+
+    bool simple_process_page (struct SimpleProcessor* proc, cv::Mat img, struct SimpleComicData* out, bool include_text) {
+        struct SimplePageData page = simple_data_borrow(out);
+        bool cached = simple_process_page(proc, img, &page, include_text);
+        simple_data_return(page, out);
+        return cached;
+    }
+
+    void simple_process_panels (struct SimpleProcessor* proc, cv::Mat img, struct SimpleComicData* out) {
+        struct SimplePageData page = simple_data_borrow(out);
+        simple_process_panels(proc, img, &page);
+        simple_data_return(page, out);
+    }
+
+    void simple_process_chop (struct SimpleProcessor* proc, cv::Mat img, struct SimpleComicData* out) {
+        struct SimplePageData page = simple_data_borrow(out);
+        simple_process_chop(proc, img, &page);
+        simple_data_return(page, out);
+    }
+
+    void simple_process_text (struct SimpleProcessor* proc, struct SimpleComicData* out) {
+        struct SimplePageData page = simple_data_borrow(out);
+        simple_process_text(proc, &page);
+        simple_data_return(page, out);
+    }
+
+    int simple_frame_count (struct SimpleComicData* data) {
+        return frame_count(*data);
+    }
+
+    cv::Mat simple_frame (struct SimpleComicData* data, int index, struct Workspace* ws) {
+        return frame_at(*data, index, ws);
+    }
+
+    void simple_data_free (struct SimpleComicData* data) {
+        free_mat_vector(data->frames);
+        data->views.clear();
+        for (auto &blocks : data->dialogue) {
+            for (auto &block : blocks) delete[] block.text;
+        }
+        data->dialogue.clear();
+        data->panels.clear();
+    }
+
+    void simple_draw_bounding_boxes (struct SimpleComicData* data, cv::Mat dst, cv::Scalar text_color, cv::Scalar panel_color, int text_thickness, int panel_thickness) {
+        draw_bounding_boxes(data->panels, data->dialogue, dst, text_color, panel_color, text_thickness, panel_thickness);
+    }
+
+    TiXmlDocument simple_xml_info (struct SimpleComicData* data, bool include_text, bool include_contour) {
+        return xml_info(data->panels, data->dialogue, include_text, include_contour);
+    }
+
+    bool simple_write_info (struct InfoWriter* writer, const char* name, struct SimpleComicData* data, bool include_text, bool include_contour) {
+        return write_info(writer, name, data->panels, data->dialogue, include_text, include_contour);
+    }
+}
@@ -20,15 +20,42 @@
 
 #include "text_detect.hpp"
 #include "extract.hpp"
+#include "pool.hpp"
+#include "cache.hpp"
+#include "info.hpp"
 #include <tinyxml.h>
+#include <atomic>
+#include <functional>
 
 namespace chopfox {
+    /**
+     * Results of one or more pages with the text as C strings
+     * Copies share the frames & text, free one of them with simple_data_free. New code should use SimplePageData.
+     */
     struct SimpleComicData {
         PanelArray panels;
         std::vector<cv::Mat> frames;
+        std::vector<struct PanelView> views; // Filled instead of frames when the processor uses lazy_frames
         std::vector<std::vector<struct TextBlock>> dialogue;
     };
 
+    /**
+     * Results of one or more pages, owning all of their buffers
+     * Move it to hand it over, copies are not allowed so the frames & text are never duplicated by accident.
+     */
+    struct SimplePageData {
+        PanelArray panels;
+        std::vector<cv::Mat> frames;
+        std::vector<struct PanelView> views; // Filled instead of frames when the processor uses lazy_frames
+        std::vector<std::vector<struct PageText>> dialogue;
+
+        SimplePageData () = default;
+        SimplePageData (SimplePageData&&) = default;
+        SimplePageData& operator= (SimplePageData&&) = default;
+        SimplePageData (const SimplePageData&) = delete;
+        SimplePageData& operator= (const SimplePageData&) = delete;
+    };
+
     struct SimpleProcessor {
         cv::dnn::Net text_detector;
         const char* text_lang;
@@ -37,6 +64,22 @@ namespace chopfox {
         uint8_t log_level;
         double panel_precision;
         double panel_min_area_divider;
+        struct EnginePool<tesseract::TessBaseAPI>* ocr_pool;
+        int text_batch_size; // Max panels per EAST forward pass (1 disables batching)
+        std::string text_model_path; // Used to load a copy of the EAST model for every worker
+        struct TextModelOptions text_model; // Backend, target & precision of every copy of the EAST model
+        struct EnginePool<cv::dnn::Net>* detector_pool;
+        int text_workers; // Amount of threads used by simple_process_text
+        int panel_downscale; // Find the panels on an image reduced by this factor and refine them at full resolution (1 disables)
+        bool lazy_frames; // simple_process_chop creates views of the panels instead of cropping them
+        enum TextGrouping text_grouping; // How the text boxes are merged into blocks
+        enum TextRecognition text_recognition; // Whether tesseract segments the blocks or reads the detected lines
+        struct EnginePool<struct Workspace>* workspace_pool; // Scratch buffers reused across panels and pages, one per thread
+        struct ResultCache* cache; // Results of pages processed before (NULL disables caching)
+        struct Tracer* tracer; // Spans & counters of every stage, owned by the caller (NULL disables tracing)
+        struct TextInputLimits text_limits; // How large panels are fed to EAST
+        struct TextPrefilter text_prefilter; // Skips EAST & OCR on the panels without text (disabled by default)
+        std::atomic<size_t> panels_textless; // Panels skipped by the prefilter since the processor was created
     };
 
     /**
@@ -48,7 +91,10 @@ namespace chopfox {
      * @param panel_precision Used in contour appoximation
      * @param image_ppi Used for tesseract-ocr
      * @param panel_min_area_divider Min area of panel calculates as min_area = (strip.width / panel_min_area_divider) * (strip.height / panel_min_area_divider)
-     * @returns The SimpleProcessor containing the EAST model and processing parameters
+     * @param ocr_engines Amount of tesseract-ocr engines to initialize up front (at least one), more are created on demand
+     * @param model_options Backend, target & precision of the EAST model (NULL for FP32 with the default backend), INT8 copies for extra workers are quantized again
+     * @returns The SimpleProcessor containing the EAST model and processing parameters, NULL if tesseract-ocr could not load lang
+     * @remarks text_detector is empty if the model could not be loaded or quantized
      */
     struct SimpleProcessor* simple_processor_init (
         const char* east_model_path, 
@@ -57,7 +103,9 @@ namespace chopfox {
         float text_score_thresh = 0.4f,
         double panel_precision = 0.001,
         int image_ppi = 300,
-        double panel_min_area_divider = 15.0
+        double panel_min_area_divider = 15.0,
+        int ocr_engines = 1,
+        const struct TextModelOptions* model_options = NULL
     );
 
     /**
@@ -69,7 +117,8 @@ namespace chopfox {
      * @param panel_precision Used in contour appoximation
      * @param image_ppi Used for tesseract-ocr
      * @param panel_min_area_divider Min area of panel calculates as min_area = (strip.width / panel_min_area_divider) * (strip.height / panel_min_area_divider)
-     * @returns The SimpleProcessor containing the EAST model and processing parameters
+     * @param ocr_engines Amount of tesseract-ocr engines to initialize up front (at least one), more are created on demand
+     * @returns The SimpleProcessor containing the EAST model and processing parameters, NULL if tesseract-ocr could not load lang
      */
     struct SimpleProcessor* simple_processor_init (
         cv::dnn::Net text_detector, 
@@ -78,7 +127,8 @@ namespace chopfox {
         float text_score_thresh = 0.4f,
         double panel_precision = 0.001,
         int image_ppi = 300,
-        double panel_min_area_divider = 15.0
+        double panel_min_area_divider = 15.0,
+        int ocr_engines = 1
     );
 
     /**
@@ -94,6 +144,98 @@ namespace chopfox {
         double panel_min_area_divider = 15.0
     );
 
+    /**
+     * Set the amount of threads used to detect and recognize text
+     * Every worker uses its own copy of the EAST model and its own tesseract-ocr engine.
+     * When the processor was created from a cv::dnn::Net instead of a model path the network is shared, 
+     * so only the recognition runs in parallel.
+     * @param proc The processor to configure
+     * @param workers The amount of workers (1 processes a panel at a time on the calling thread)
+     */
+    void simple_processor_set_workers (struct SimpleProcessor* proc, int workers);
+
+    /**
+     * Get the counters of the workspaces of the processor (only the ones that aren't in use are counted)
+     * @param proc The processor
+     * @param reused Amount of buffers that were reused instead of allocated
+     * @param allocated Amount of buffers that had to be allocated
+     * @param retained_bytes Memory held by the workspaces between calls
+     */
+    void simple_workspace_stats (struct SimpleProcessor* proc, size_t* reused, size_t* allocated, size_t* retained_bytes);
+
+    /**
+     * Keep the results of every page processed with simple_process_page in a cache directory
+     * @param proc The processor to configure
+     * @param dir The cache directory, may be shared by several processes
+     * @param max_bytes The max size of the cache (0 for no limit)
+     * @returns false if the cache directory could not be created
+     */
+    bool simple_processor_set_cache (struct SimpleProcessor* proc, const char* dir, size_t max_bytes);
+
+    /**
+     * Get the cache key of a page, a hash of the pixels and of every parameter that changes the results
+     * @param proc The processor holding the parameters
+     * @param img The input image
+     * @param include_text Whether the text is extracted as well
+     * @returns The key
+     */
+    uint64_t simple_cache_key (struct SimpleProcessor* proc, cv::Mat img, bool include_text);
+
+    /**
+     * Fill the data with the cached panels & text of a page
+     * The panels are always returned as views (like lazy_frames), read them with simple_frame.
+     * @param proc The processor struct to use containing the options
+     * @param img The input image
+     * @param out The resulting data
+     * @param include_text Whether the text is extracted as well
+     * @param key The cache key of the page, to pass to simple_cache_store on a miss (0 without a cache)
+     * @returns true if the page was found in the cache
+     */
+    bool simple_cache_lookup (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimplePageData* out,
+        bool include_text,
+        uint64_t* key
+    );
+
+    /**
+     * Store the panels & text of a processed page in the cache, does nothing without a cache
+     * @param proc The processor struct to use containing the options
+     * @param key The key from simple_cache_lookup
+     * @param data The processed page
+     * @param include_text Whether the text was extracted (the last panels.size() dialogue entries)
+     */
+    void simple_cache_store (struct SimpleProcessor* proc, uint64_t key, struct SimplePageData* data, bool include_text);
+
+    /**
+     * Get the panels, chop them up and extract their text, reusing the cached results if the page was processed before
+     * @param proc The processor struct to use containing the options
+     * @param img The input image
+     * @param out The resulting data
+     * @param include_text Extract the text as well as the panels
+     * @returns true if the panels & text came from the cache
+     */
+    bool simple_process_page (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimplePageData* out,
+        bool include_text = true
+    );
+
+    /**
+     * Get the panels, chop them up and extract their text, returning the results of the page
+     * @param proc The processor struct to use containing the options
+     * @param img The input image
+     * @param include_text Extract the text as well as the panels
+     * @returns The data of the page, moved out without copying the panels, frames or text
+     */
+    struct SimplePageData simple_process_page (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        bool include_text = true
+    );
+
     /**
      * Get the panel regions from imput image
      * @param proc The processor struct to use containing the options
@@ -103,7 +245,7 @@ namespace chopfox {
     void simple_process_panels (
         struct SimpleProcessor* proc, 
         cv::Mat img,
-        struct SimpleComicData* out
+        struct SimplePageData* out
     );
 
     /**
@@ -115,7 +257,35 @@ namespace chopfox {
     void simple_process_chop (
         struct SimpleProcessor* proc, 
         cv::Mat img,
-        struct SimpleComicData* out
+        struct SimplePageData* out
+    );
+
+    /**
+     * Group the chopped up panels into batches sharing an EAST input size
+     * Panels rejected by the text prefilter are left out, their dialogue stays empty.
+     * @param proc The processor struct to use containing the options
+     * @param data The data chopped up by simple_process_chop
+     * @param batch_size The max amount of panels in a batch
+     * @returns The panel indices of every batch
+     */
+    std::vector<std::vector<int>> simple_text_batches (struct SimpleProcessor* proc, struct SimplePageData* data, int batch_size);
+
+    /**
+     * Extract the text from a batch of chopped up panels on the calling thread
+     * @param proc The processor struct to use containing the options
+     * @param out The resulting data, dialogue must already have a slot for every panel
+     * @param first The dialogue slot of the first panel
+     * @param batch The panels to transcribe, from simple_text_batches
+     * @param ws Workspace to use for the intermediates
+     * @param batch_frames The panels the batch cropped are moved here instead of being released (optional)
+     */
+    void simple_process_text_batch (
+        struct SimpleProcessor* proc,
+        struct SimplePageData* out,
+        size_t first,
+        const std::vector<int>& batch,
+        struct Workspace* ws,
+        std::vector<cv::Mat>* batch_frames = NULL
     );
 
     /**
@@ -125,9 +295,51 @@ namespace chopfox {
      */
     void simple_process_text (
         struct SimpleProcessor* proc, 
-        struct SimpleComicData* out
+        struct SimplePageData* out
     );
 
+    /**
+     * Called once per panel by simple_process_stream as soon as its crop & text are ready (panels may come out of order)
+     * Callbacks are never run concurrently. The library drops its buffers of the panel when the callback returns,
+     * keep a reference to the frame or move the text out to hold on to them.
+     */
+    typedef std::function<void (int index, const struct PanelInfo& panel, cv::Mat frame, std::vector<struct PageText>& text)> SimpleStreamCallback;
+
+    /**
+     * Process a page panel by panel, only the panels in flight hold a crop, EAST inputs & outputs
+     * Panels without text (or all of them without include_text) are emitted one at a time on the calling thread,
+     * the text batches run on the text workers for as long as the memory budget allows.
+     * @param proc The processor struct to use containing the options
+     * @param img The input image, referenced until the function returns
+     * @param on_panel Receives every panel with its crop & text
+     * @param include_text Extract the text as well as the panels
+     * @param memory_budget Bytes the panels in flight may take (0 for no limit), a batch larger than the budget runs on its own
+     * @returns The most bytes the panels in flight were estimated to take at once
+     */
+    size_t simple_process_stream (
+        struct SimpleProcessor* proc,
+        cv::Mat img,
+        SimpleStreamCallback on_panel,
+        bool include_text = true,
+        size_t memory_budget = 0
+    );
+
+    /**
+     * Get the amount of chopped up panels
+     * @param data The data chopped up by simple_process_chop
+     * @returns The amount of frames or views
+     */
+    int simple_frame_count (const struct SimplePageData& data);
+
+    /**
+     * Get a chopped up panel, cropping it from its view if the processor uses lazy_frames
+     * @param data The data chopped up by simple_process_chop
+     * @param index The panel to get
+     * @param ws Workspace to keep the cropping mask in (NULL allocates it)
+     * @returns The cropped panel
+     */
+    cv::Mat simple_frame (const struct SimplePageData& data, int index, struct Workspace* ws = NULL);
+
     /**
      * Free the SimpleProcessor
      * @param ptr Pointer to the struct to free
@@ -135,10 +347,130 @@ namespace chopfox {
     void simple_processor_free (struct SimpleProcessor* ptr);
 
     /**
-     * Free the chopped up panels
+     * Map the results of a page decoded at reduced resolution (decode_image) back to the full resolution coordinates
+     * The frames & views only have the reduced pixels and are dropped.
+     * @param data The data to rescale
+     * @param from The size of the image the data was extracted from
+     * @param to The size of the full resolution image
+     */
+    void simple_data_rescale (struct SimplePageData* data, cv::Size from, cv::Size to);
+
+    /**
+     * Free the chopped up panels and the text, leaving the data empty
      * @param data The output data structure
+     * @remarks Only needed to free the buffers early, they are freed with the data anyway
      */
-    void simple_data_free (struct SimpleComicData data);
+    void simple_data_free (struct SimplePageData& data);
+
+    /**
+     * Draw the bounding boxes generated by simple_process_chop & simple_process_text
+     * @param data The data containing the bonding boxes & contours
+     * @param dst The destination image to draw to
+     * @param text_color Color of the text boxes
+     * @param panel_color Color of the panel contours
+     * @param text_thickness Thickness of the text boxes
+     * @param panel_thickness Thickness of the panel contours
+     */
+    void simple_draw_bounding_boxes (
+        const struct SimplePageData& data,
+        cv::Mat dst,
+        cv::Scalar text_color = cv::Scalar(255,255,0),
+        cv::Scalar panel_color = cv::Scalar(0,255,0),
+        int text_thickness = 2,
+        int panel_thickness = 2
+    );
+
+    /**
+     * Generate XML representation of the data
+     * @param include_text Include the text processed in the XML output
+     * @param include_contour Include the contour points of the panels in the XML output
+     * @returns The resulting TinyXML document
+     */
+    TiXmlDocument simple_xml_info (const struct SimplePageData& data, bool include_text, bool include_contour = true);
+
+    /**
+     * Write the data with a streaming writer, without building a document in memory
+     * @param writer The writer to use, from info_writer_open
+     * @param name The name of the page
+     * @param data The data containing the panels & text
+     * @param include_text Include the text processed in the output
+     * @param include_contour Include the contour points of the panels in the output
+     * @returns false if the page could not be written
+     */
+    bool simple_write_info (struct InfoWriter* writer, const char* name, const struct SimplePageData& data, bool include_text, bool include_contour = true);
+
+    /// SimpleComicData versions, they run the SimplePageData functions and copy the new text into C strings, the read-only ones use the data as is
+
+    /**
+     * Get the panels, chop them up and extract their text, reusing the cached results if the page was processed before
+     * @param proc The processor struct to use containing the options
+     * @param img The input image
+     * @param out The resulting data
+     * @param include_text Extract the text as well as the panels
+     * @returns true if the panels & text came from the cache
+     */
+    bool simple_process_page (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimpleComicData* out,
+        bool include_text = true
+    );
+
+    /**
+     * Get the panel regions from imput image
+     * @param proc The processor struct to use containing the options
+     * @param img The input image
+     * @param out The resulting data
+     */
+    void simple_process_panels (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimpleComicData* out
+    );
+
+    /**
+     * Chop up the images after getting the panels with simple_process_panels
+     * @param proc The processor struct to use containing the options
+     * @param img The input image to chop up
+     * @param out The resulting data
+     */ 
+    void simple_process_chop (
+        struct SimpleProcessor* proc, 
+        cv::Mat img,
+        struct SimpleComicData* out
+    );
+
+    /**
+     * Extract the text from the chopped up panels
+     * @param proc The processor struct to use containing the options
+     * @param out The resulting data
+     */
+    void simple_process_text (
+        struct SimpleProcessor* proc, 
+        struct SimpleComicData* out
+    );
+
+    /**
+     * Get the amount of chopped up panels
+     * @param data The data chopped up by simple_process_chop
+     * @returns The amount of frames or views
+     */
+    int simple_frame_count (struct SimpleComicData* data);
+
+    /**
+     * Get a chopped up panel, cropping it from its view if the processor uses lazy_frames
+     * @param data The data chopped up by simple_process_chop
+     * @param index The panel to get
+     * @param ws Workspace to keep the cropping mask in (NULL allocates it)
+     * @returns The cropped panel
+     */
+    cv::Mat simple_frame (struct SimpleComicData* data, int index, struct Workspace* ws = NULL);
+
+    /**
+     * Free the chopped up panels and the text, leaving the data empty
+     * @param data The output data structure, its copies must not be used afterwards
+     */
+    void simple_data_free (struct SimpleComicData* data);
 
     /**
      * Draw the bounding boxes generated by simple_process_chop & simple_process_text
@@ -165,6 +497,17 @@ namespace chopfox {
      * @returns The resulting TinyXML document
      */
     TiXmlDocument simple_xml_info (struct SimpleComicData* data, bool include_text, bool include_contour = true);
+
+    /**
+     * Write the data with a streaming writer, without building a document in memory
+     * @param writer The writer to use, from info_writer_open
+     * @param name The name of the page
+     * @param data The data containing the panels & text
+     * @param include_text Include the text processed in the output
+     * @param include_contour Include the contour points of the panels in the output
+     * @returns false if the page could not be written
+     */
+    bool simple_write_info (struct InfoWriter* writer, const char* name, struct SimpleComicData* data, bool include_text, bool include_contour = true);
 }
 
 #endif
\ No newline at end of file
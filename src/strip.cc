@@ -0,0 +1,357 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "strip.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <png.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+namespace chopfox {
+    /// PNG
+
+    struct PngStrip {
+        FILE* file;
+        png_structp png;
+        png_infop info;
+    };
+
+    static void png_strip_close (struct PngStrip* state) {
+        png_destroy_read_struct(&state->png, &state->info, NULL);
+        fclose(state->file);
+        delete state;
+    }
+
+    static struct StripReader* png_strip_open (FILE* file) {
+        struct PngStrip* state = new struct PngStrip;
+        state->file = file;
+        state->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        state->info = state->png ? png_create_info_struct(state->png) : NULL;
+
+        if (!state->info || setjmp(png_jmpbuf(state->png))) {
+            png_strip_close(state);
+            return NULL;
+        }
+
+        png_init_io(state->png, file);
+        png_read_info(state->png, state->info);
+
+        // Interlaced images can't be read row by row
+        if (png_get_interlace_type(state->png, state->info) != PNG_INTERLACE_NONE) {
+            png_strip_close(state);
+            return NULL;
+        }
+
+        // Always read 8 bit BGR, the same as IMREAD_COLOR
+        int color_type = png_get_color_type(state->png, state->info);
+        if (png_get_bit_depth(state->png, state->info) == 16) png_set_strip_16(state->png);
+        if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(state->png);
+        if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+            png_set_expand_gray_1_2_4_to_8(state->png);
+            png_set_gray_to_rgb(state->png);
+        }
+        png_set_strip_alpha(state->png);
+        png_set_bgr(state->png);
+        png_read_update_info(state->png, state->info);
+
+        struct StripReader* reader = new struct StripReader;
+        reader->size = cv::Size(png_get_image_width(state->png, state->info), png_get_image_height(state->png, state->info));
+        reader->type = CV_8UC3;
+        reader->read = [state] (cv::Mat rows) {
+            if (setjmp(png_jmpbuf(state->png))) return false;
+            for (int y = 0; y < rows.rows; y++) png_read_row(state->png, rows.ptr<uchar>(y), NULL);
+            return true;
+        };
+        reader->close = [state] () { png_strip_close(state); };
+
+        return reader;
+    }
+
+    /// JPEG
+
+    struct JpegError {
+        struct jpeg_error_mgr mgr;
+        jmp_buf jump;
+    };
+
+    struct JpegStrip {
+        FILE* file;
+        struct jpeg_decompress_struct cinfo;
+        struct JpegError error;
+    };
+
+    static void jpeg_strip_error (j_common_ptr cinfo) {
+        longjmp(((struct JpegError*)cinfo->err)->jump, 1);
+    }
+
+    static void jpeg_strip_close (struct JpegStrip* state) {
+        jpeg_destroy_decompress(&state->cinfo);
+        fclose(state->file);
+        delete state;
+    }
+
+    static struct StripReader* jpeg_strip_open (FILE* file) {
+        struct JpegStrip* state = new struct JpegStrip();
+        state->file = file;
+        state->cinfo.err = jpeg_std_error(&state->error.mgr);
+        state->error.mgr.error_exit = jpeg_strip_error;
+
+        if (setjmp(state->error.jump)) {
+            jpeg_strip_close(state);
+            return NULL;
+        }
+
+        jpeg_create_decompress(&state->cinfo);
+        jpeg_stdio_src(&state->cinfo, file);
+        jpeg_read_header(&state->cinfo, TRUE);
+
+        // CMYK & YCCK can't be converted by libjpeg
+        bool gray = state->cinfo.jpeg_color_space == JCS_GRAYSCALE;
+        if (!gray && state->cinfo.num_components != 3) {
+            jpeg_strip_close(state);
+            return NULL;
+        }
+
+        state->cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+        jpeg_start_decompress(&state->cinfo);
+
+        struct StripReader* reader = new struct StripReader;
+        reader->size = cv::Size(state->cinfo.output_width, state->cinfo.output_height);
+        reader->type = gray ? CV_8UC1 : CV_8UC3;
+        reader->read = [state, gray] (cv::Mat rows) {
+            if (setjmp(state->error.jump)) return false;
+            for (int y = 0; y < rows.rows; y++) {
+                JSAMPROW row = rows.ptr<uchar>(y);
+                if (jpeg_read_scanlines(&state->cinfo, &row, 1) != 1) return false;
+                if (!gray) {
+                    for (int x = 0; x < rows.cols; x++) std::swap(row[x * 3], row[x * 3 + 2]); // RGB to BGR
+                }
+            }
+            return true;
+        };
+        reader->close = [state] () { jpeg_strip_close(state); };
+
+        return reader;
+    }
+
+    /// Readers
+
+    struct StripReader* strip_reader_open (const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (!file) return NULL;
+
+        unsigned char signature[8] = { 0 };
+        size_t length = fread(signature, 1, sizeof(signature), file);
+        rewind(file);
+
+        struct StripReader* reader = NULL;
+        if (length == 8 && png_sig_cmp(signature, 0, 8) == 0) reader = png_strip_open(file);
+        else if (length >= 3 && signature[0] == 0xFF && signature[1] == 0xD8 && signature[2] == 0xFF) reader = jpeg_strip_open(file);
+        else fclose(file);
+
+        if (reader) return reader;
+
+        // Formats that can't be streamed are decoded up front
+        cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
+        if (img.empty()) return NULL;
+        return strip_reader_mat(img);
+    }
+
+    struct StripReader* strip_reader_mat (cv::Mat img) {
+        assert(!img.empty());
+
+        struct StripReader* reader = new struct StripReader;
+        reader->size = img.size();
+        reader->type = img.type();
+
+        int next = 0;
+        reader->read = [img, next] (cv::Mat rows) mutable {
+            if (next + rows.rows > img.rows) return false;
+            img.rowRange(next, next + rows.rows).copyTo(rows);
+            next += rows.rows;
+            return true;
+        };
+        reader->close = [] () {};
+
+        return reader;
+    }
+
+    void strip_reader_free (struct StripReader* reader) {
+        if (!reader) return;
+        reader->close();
+        delete reader;
+    }
+
+    /// Extraction
+
+    struct EmittedContour {
+        cv::Rect bounding_box;
+        std::vector<cv::Point> contour;
+    };
+
+    int get_panels_streaming (
+        struct StripReader* reader,
+        StripPanelCallback on_panel,
+        double precision,
+        double min_area_divider,
+        int band_rows,
+        int max_rows
+    ) {
+        const int W = reader->size.width, H = reader->size.height;
+
+        if (band_rows < 16) band_rows = 16;
+        if (max_rows > 0 && max_rows < band_rows) max_rows = band_rows;
+
+        // Same min area as the whole strip would have
+        double min_area = (H / min_area_divider) * (W / min_area_divider);
+
+        // Rows [buffer_start, buffer_start + buffer_rows) of the strip
+        cv::Mat buffer(band_rows + 4, W, reader->type);
+        int buffer_start = 0, buffer_rows = 0;
+
+        // Panels already emitted that reach into the current window, anything inside them isn't a panel
+        std::vector<struct EmittedContour> emitted;
+
+        int found = 0;
+
+        // The mask is generated for the window [a, b), with 2 extra rows on either side for the laplacian & dilation
+        int a = 0, b = std::min(band_rows, H);
+
+        // Whether the window starts just above a panel that wasn't complete in the previous window.
+        // Contours touching the top row are then the rest of panels that were already emitted.
+        bool from_carry = false;
+
+        while (a < H) {
+            int s0 = std::max(a - 2, 0), s1 = std::min(b + 2, H);
+
+            // Drop the rows above the window
+            if (s0 > buffer_start) {
+                int drop = std::min(s0 - buffer_start, buffer_rows);
+                memmove(buffer.data, buffer.ptr<uchar>(drop), (buffer_rows - drop) * buffer.step[0]);
+                buffer_rows -= drop;
+                buffer_start += drop;
+            }
+
+            // Grow the buffer when a panel is taller than the window
+            if (s1 - buffer_start > buffer.rows) {
+                int rows = std::max(s1 - buffer_start, buffer.rows * 2);
+                if (max_rows > 0) rows = std::max(s1 - buffer_start, std::min(rows, max_rows + 4));
+
+                cv::Mat grown(rows, W, reader->type);
+                buffer.rowRange(0, buffer_rows).copyTo(grown.rowRange(0, buffer_rows));
+                buffer = grown;
+            }
+
+            if (buffer_start + buffer_rows < s1) {
+                if (!reader->read(buffer.rowRange(buffer_rows, s1 - buffer_start))) return -1;
+                buffer_rows = s1 - buffer_start;
+            }
+
+            cv::Mat window = buffer.rowRange(s0 - buffer_start, s1 - buffer_start);
+            cv::Mat mask;
+            panel_edge_mask(window, mask, cv::Rect(0, a - s0, W, b - a));
+
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, cv::Point(0, a));
+
+            mask.release();
+
+            std::vector<cv::Rect> boxes;
+            std::vector<bool> piece, open;
+            int carry = b;
+            for (auto &contour : contours) {
+                cv::Rect box = cv::boundingRect(contour);
+                boxes.push_back(box);
+                piece.push_back(from_carry && box.y == a);
+                open.push_back(!piece.back() && b < H && box.y + box.height == b);
+                if (open.back()) carry = std::min(carry, box.y);
+            }
+
+            bool has_open = carry < b;
+
+            // The next window starts one row above the highest panel that isn't complete yet
+            int next_a = has_open ? carry - 1 : b;
+
+            // Keeping the open panels would take more than max_rows, they are cut at the bottom of the window instead
+            // and the rest of them is found again as new panels below
+            int next_b = next_a <= a ? std::min(b + band_rows, H) : std::min(std::max(next_a + band_rows, b + band_rows / 2), H);
+            if (has_open && max_rows > 0 && next_b - std::min(next_a, a) > max_rows) {
+                open.assign(open.size(), false);
+                has_open = false;
+                next_a = b;
+            }
+
+            if (next_a <= a) {
+                b = std::min(b + band_rows, H);
+                continue;
+            }
+
+            std::vector<struct EmittedContour> emitted_now;
+
+            for (int i = 0; i < contours.size(); i++) {
+                if (piece[i] || open[i]) continue;
+
+                // Contours starting below next_a are seen again in the next window, which may show they are inside an open panel
+                if (boxes[i].y > next_a) continue;
+
+                bool nested = false;
+                for (auto &outer : emitted) {
+                    if (cv::pointPolygonTest(outer.contour, contours[i][0], false) > 0) {
+                        nested = true;
+                        break;
+                    }
+                }
+                if (nested) continue;
+
+                struct EmittedContour item;
+                item.bounding_box = boxes[i];
+                item.contour = contours[i];
+                emitted_now.push_back(item);
+
+                if (cv::contourArea(contours[i]) <= min_area) continue;
+
+                std::vector<cv::Point> approx;
+                double epsilon = precision * cv::arcLength(contours[i], true);
+                cv::approxPolyDP(contours[i], approx, epsilon, true);
+
+                struct PanelInfo info;
+                info.contour = approx;
+                info.bounding_box = cv::boundingRect(approx);
+
+                cv::Rect local = info.bounding_box - cv::Point(0, buffer_start);
+                on_panel(info, buffer(local));
+                found++;
+            }
+
+            // Only keep the contours that reach into the next window
+            emitted.insert(emitted.end(), emitted_now.begin(), emitted_now.end());
+            emitted.erase(std::remove_if(emitted.begin(), emitted.end(), [next_a] (const struct EmittedContour& item) {
+                return item.bounding_box.y + item.bounding_box.height <= next_a;
+            }), emitted.end());
+
+            from_carry = has_open;
+            b = std::min(std::max(next_a + band_rows, b + band_rows / 2), H);
+            a = next_a;
+        }
+
+        return found;
+    }
+}
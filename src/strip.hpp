@@ -0,0 +1,91 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRIP_H
+#define STRIP_H
+
+#include "extract.hpp"
+#include <functional>
+
+namespace chopfox {
+    /**
+     * Sequential reader of the rows of a (very tall) strip
+     */
+    struct StripReader {
+        cv::Size size;
+        int type; // CV_8UC1, CV_8UC3 or CV_8UC4
+        std::function<bool(cv::Mat)> read; // Fill all the rows of the argument with the next rows of the strip
+        std::function<void()> close;
+    };
+
+    /**
+     * Called as soon as a panel is complete
+     * pixels is a view of the bounding box of the panel, only valid for the duration of the call
+     */
+    typedef std::function<void(const struct PanelInfo& panel, cv::Mat pixels)> StripPanelCallback;
+
+    /// Readers
+
+    /**
+     * Open a strip for reading row by row
+     * PNG and JPEG files are decoded as they are read, other formats (and interlaced PNGs) are decoded up front.
+     * @param path The path to the image
+     * @returns The reader or NULL if the image could not be opened
+     * @remarks Free the reader with strip_reader_free
+     */
+    struct StripReader* strip_reader_open (const char* path);
+
+    /**
+     * Read the rows of an image that has already been decoded
+     * @param img The image to read
+     * @returns The reader
+     * @remarks Free the reader with strip_reader_free
+     */
+    struct StripReader* strip_reader_mat (cv::Mat img);
+
+    /**
+     * Close and free a reader
+     * @param reader The reader to free
+     */
+    void strip_reader_free (struct StripReader* reader);
+
+    /// Extraction
+
+    /**
+     * Extract the panels of a strip band by band, keeping only the rows of the panels that aren't complete yet in memory
+     * Finds the same panels as get_panels_rgb on the whole strip (chopfox-bench checks it), panels are emitted from top to bottom as they are closed.
+     * The buffer holds the rows from the top of the highest open panel down to the window, so a panel taller than the band
+     * keeps all of its rows in memory until it is complete. max_rows caps that, a panel taller than it is emitted in pieces.
+     * @param reader The strip to read
+     * @param on_panel Called for every panel found
+     * @param precision The accuracy of the approximated contour (lower is more precise)
+     * @param panel_min_area_divider Min area of panel calculates as min_area = (strip.width / panel_min_area_divider) * (strip.height / panel_min_area_divider)
+     * @param band_rows The amount of rows read at once, the window grows in steps of band_rows while a panel is taller than it
+     * @param max_rows The most rows kept in the window (0 for no limit, at least band_rows), the buffer holds max_rows + 4 rows at most
+     * @returns The amount of panels found
+     */
+    int get_panels_streaming (
+        struct StripReader* reader,
+        StripPanelCallback on_panel,
+        double precision = 0.001,
+        double min_area_divider = 15.0,
+        int band_rows = 1024,
+        int max_rows = 0
+    );
+}
+
+#endif
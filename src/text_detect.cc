@@ -19,27 +19,37 @@
 #include <opencv2/imgproc.hpp>
 #include <tesseract/baseapi.h>
 #include <leptonica/allheaders.h>
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+
+#define TEXT_MIN_DETECTABLE_HEIGHT 10 // Smallest text height in EAST input pixels that is still reliably detected
+#define TEXT_EAST_MEAN cv::Scalar(123.68, 116.78, 103.94) // RGB mean subtracted from the EAST input
 
 namespace chopfox {
     // From OpenCV example: https://github.com/opencv/opencv/blob/master/samples/dnn/text_detection.cpp
-    void decodeBoundingBoxes(const cv::Mat& scores, const cv::Mat& geometry, float scoreThresh,
+    // Modified to decode a single image from a batch, only looking at the region not covered by padding
+    void decodeBoundingBoxes(const cv::Mat& scores, const cv::Mat& geometry, int batch_index, cv::Size valid, float scoreThresh,
                             std::vector<cv::RotatedRect>& detections, std::vector<float>& confidences)
     {
         detections.clear();
-        CV_Assert(scores.dims == 4); CV_Assert(geometry.dims == 4); CV_Assert(scores.size[0] == 1);
-        CV_Assert(geometry.size[0] == 1); CV_Assert(scores.size[1] == 1); CV_Assert(geometry.size[1] == 5);
+        confidences.clear();
+        CV_Assert(scores.dims == 4); CV_Assert(geometry.dims == 4); CV_Assert(scores.size[0] == geometry.size[0]);
+        CV_Assert(batch_index < scores.size[0]); CV_Assert(scores.size[1] == 1); CV_Assert(geometry.size[1] == 5);
         CV_Assert(scores.size[2] == geometry.size[2]); CV_Assert(scores.size[3] == geometry.size[3]);
 
-        const int height = scores.size[2];
-        const int width = scores.size[3];
+        // Multiple by 4 because feature maps are 4 time less than input image.
+        const int height = std::min(scores.size[2], valid.height / 4);
+        const int width = std::min(scores.size[3], valid.width / 4);
         for (int y = 0; y < height; ++y)
         {
-            const float* scoresData = scores.ptr<float>(0, 0, y);
-            const float* x0_data = geometry.ptr<float>(0, 0, y);
-            const float* x1_data = geometry.ptr<float>(0, 1, y);
-            const float* x2_data = geometry.ptr<float>(0, 2, y);
-            const float* x3_data = geometry.ptr<float>(0, 3, y);
-            const float* anglesData = geometry.ptr<float>(0, 4, y);
+            const float* scoresData = scores.ptr<float>(batch_index, 0, y);
+            const float* x0_data = geometry.ptr<float>(batch_index, 0, y);
+            const float* x1_data = geometry.ptr<float>(batch_index, 1, y);
+            const float* x2_data = geometry.ptr<float>(batch_index, 2, y);
+            const float* x3_data = geometry.ptr<float>(batch_index, 3, y);
+            const float* anglesData = geometry.ptr<float>(batch_index, 4, y);
             for (int x = 0; x < width; ++x)
             {
                 float score = scoresData[x];
@@ -66,62 +76,470 @@ namespace chopfox {
         }
     }
 
+    tesseract::TessBaseAPI* ocr_engine_init (const char* lang) {
+        tesseract::TessBaseAPI* ocr = new tesseract::TessBaseAPI;
+
+        if (ocr->Init(NULL, lang, tesseract::OEM_LSTM_ONLY /* Use the deep learning engine instead of the legacy one */) != 0) {
+            delete ocr;
+            return NULL;
+        }
+
+        ocr->SetPageSegMode(tesseract::PSM_SINGLE_BLOCK); // assume single block of text
+
+        return ocr;
+    }
+
+    void ocr_engine_free (tesseract::TessBaseAPI* ocr) {
+        if (!ocr) return;
+        ocr->End();
+        delete ocr;
+    }
+
     std::vector<struct TextBlock> transcribe (cv::Mat frame, cv::dnn::Net detector, float score_thresh, const char* lang, int ppi) {
-        cv::Mat blob, color;
-
-        bool has_alpha = frame.channels() == 4;
-    
-        if (has_alpha) {
-            std::vector<cv::Mat> src_channels(4);
-            cv::split(frame, src_channels);
-            std::vector<cv::Mat> rgb(src_channels.begin(), src_channels.end() - 1);
-            cv::merge(rgb, color);
-        } else color = frame;
-
-        int blob_w = color.size().width / 32;
+        tesseract::TessBaseAPI* ocr = ocr_engine_init(lang);
+        if (!ocr) return std::vector<struct TextBlock>();
+
+        std::vector<struct TextBlock> text_blocks = transcribe(frame, detector, ocr, score_thresh, ppi);
+
+        ocr_engine_free(ocr);
+
+        return text_blocks;
+    }
+
+    /**
+     * Convert the frame to BGR, dropping the alpha channel or expanding a gray frame
+     */
+    static cv::Mat text_bgr (cv::Mat frame) {
+        if (frame.channels() == 3) return frame;
+
+        // Single pass, no per channel planes. Resizing a gray frame into the BGR canvas would replace the canvas view instead.
+        cv::Mat color;
+        cv::cvtColor(frame, color, frame.channels() == 4 ? cv::COLOR_BGRA2BGR : cv::COLOR_GRAY2BGR);
+
+        return color;
+    }
+
+    /**
+     * The size the EAST blob of a frame is resized to (multiple of 32)
+     */
+    static cv::Size text_blob_size (cv::Size frame_size) {
+        int blob_w = frame_size.width / 32;
         if (blob_w <= 0) blob_w = 1;
-        int blob_h = color.size().height / 32;
+        int blob_h = frame_size.height / 32;
         if (blob_h <= 0) blob_h = 1;
 
-        cv::dnn::blobFromImage(color, blob, 1.0, cv::Size(blob_w * 32,blob_h * 32), cv::Scalar(123.68, 116.78, 103.94), true, false);
+        return cv::Size(blob_w * 32, blob_h * 32);
+    }
+
+    double text_stroke_density (cv::Mat frame, const struct TextPrefilter* prefilter, struct Workspace* ws) {
+        assert(prefilter->thumb_side > 0);
+
+        double scale = std::min(1.0, (double)prefilter->thumb_side / std::max(frame.cols, frame.rows));
+        cv::Size size(std::max(1, cvRound(frame.cols * scale)), std::max(1, cvRound(frame.rows * scale)));
+
+        // Reduce first, the color conversion then only runs on the thumbnail
+        cv::Mat small = frame;
+        if (size != frame.size()) {
+            small = workspace_mat(ws, WS_TEXT_PREFILTER_SMALL, size, frame.type());
+            cv::resize(frame, small, size, 0, 0, cv::INTER_AREA);
+        }
+
+        cv::Mat thumb = workspace_mat(ws, WS_TEXT_PREFILTER, size, CV_8UC1);
+        if (small.channels() == 4) cv::cvtColor(small, thumb, cv::COLOR_BGRA2GRAY);
+        else if (small.channels() == 3) cv::cvtColor(small, thumb, cv::COLOR_BGR2GRAY);
+        else small.copyTo(thumb);
+
+        // Black-hat keeps the dark details thinner than the kernel: lettering strokes, not the flat & shaded areas of the artwork
+        cv::Mat strokes = workspace_mat(ws, WS_TEXT_PREFILTER_STROKES, size, CV_8UC1);
+        static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+        cv::morphologyEx(thumb, strokes, cv::MORPH_BLACKHAT, kernel);
+        cv::threshold(strokes, strokes, prefilter->min_contrast, 255, cv::THRESH_BINARY);
+
+        return (double)cv::countNonZero(strokes) / size.area();
+    }
+
+    bool text_likely (cv::Mat frame, const struct TextPrefilter* prefilter, struct Workspace* ws) {
+        if (!prefilter || prefilter->thumb_side <= 0 || frame.empty()) return true;
+        return text_stroke_density(frame, prefilter, ws) >= prefilter->min_density;
+    }
+
+    /**
+     * Offsets of tiles of the given length covering a dimension, neighbours overlap by at least overlap pixels
+     */
+    static std::vector<int> text_tile_offsets (int length, int tile, int overlap) {
+        if (length <= tile) return std::vector<int>(1, 0);
+
+        int stride = std::max(32, tile - overlap);
+        int count = (length - tile + stride - 1) / stride + 1;
+
+        std::vector<int> offsets;
+        for (int i = 0; i < count; i++) offsets.push_back((int)((long long)(length - tile) * i / (count - 1)));
+        return offsets;
+    }
+
+    void text_input_plan (cv::Size frame_size, int frame, const struct TextInputLimits* limits, std::vector<struct TextInput>& inputs) {
+        int max_side = limits ? limits->max_side / 32 * 32 : 0;
+        cv::Size full = text_blob_size(frame_size);
+
+        double scale = 1.0;
+        bool tiled = false;
+
+        if (max_side > 0 && std::max(full.width, full.height) > max_side) {
+            double fit = (double)max_side / std::max(frame_size.width, frame_size.height);
+
+            if (limits->large_frames == TEXT_LARGE_DOWNSCALE) {
+                scale = fit;
+            } else if (limits->large_frames == TEXT_LARGE_TILE) {
+                tiled = true;
+            } else {
+                // Downscaling further would make the smallest text undetectable, the rest of the way is covered by tiles
+                double readable = limits->min_text_height > 0 ? std::min(1.0, (double)TEXT_MIN_DETECTABLE_HEIGHT / limits->min_text_height) : 0.0;
+                scale = std::max(fit, readable);
+                tiled = scale > fit;
+            }
+        }
+
+        struct TextInput input;
+        input.frame = frame;
+        input.scaled = scale < 1.0 ? text_blob_size(cv::Size(cvRound(frame_size.width * scale), cvRound(frame_size.height * scale))) : full;
+
+        if (!tiled) {
+            input.tile = input.core = cv::Rect(cv::Point(0, 0), input.scaled);
+            inputs.push_back(input);
+            return;
+        }
+
+        cv::Size tile(std::min(max_side, input.scaled.width), std::min(max_side, input.scaled.height));
+        std::vector<int> xs = text_tile_offsets(input.scaled.width, tile.width, limits->tile_overlap);
+        std::vector<int> ys = text_tile_offsets(input.scaled.height, tile.height, limits->tile_overlap);
+
+        // Cores meet in the middle of the overlaps, the outer sides reach past the frame to keep the boxes sticking out of it
+        for (int iy = 0; iy < ys.size(); iy++) {
+            int top = iy == 0 ? -tile.height : (ys[iy - 1] + tile.height + ys[iy]) / 2;
+            int bottom = iy == ys.size() - 1 ? input.scaled.height + tile.height : (ys[iy] + tile.height + ys[iy + 1]) / 2;
+            for (int ix = 0; ix < xs.size(); ix++) {
+                int left = ix == 0 ? -tile.width : (xs[ix - 1] + tile.width + xs[ix]) / 2;
+                int right = ix == xs.size() - 1 ? input.scaled.width + tile.width : (xs[ix] + tile.width + xs[ix + 1]) / 2;
+                input.tile = cv::Rect(cv::Point(xs[ix], ys[iy]), tile);
+                input.core = cv::Rect(left, top, right - left, bottom - top);
+                inputs.push_back(input);
+            }
+        }
+    }
+
+    cv::dnn::Net text_detector_quantize (cv::dnn::Net net, const std::vector<cv::Mat>& samples, int max_side) {
+        // The activation ranges can't be measured without samples
+        if (samples.empty()) return cv::dnn::Net();
+
+        struct TextInputLimits limits = { max_side, TEXT_LARGE_DOWNSCALE, 0, 0 };
+
+        // Calibration blobs are built the same way as the real input, only one sample at a time
+        std::vector<cv::Mat> blobs;
+        for (auto &sample : samples) {
+            std::vector<struct TextInput> inputs;
+            text_input_plan(sample.size(), 0, &limits, inputs);
+
+            cv::Mat resized;
+            cv::resize(text_bgr(sample), resized, inputs[0].scaled);
+            blobs.push_back(cv::dnn::blobFromImage(resized, 1.0, cv::Size(), TEXT_EAST_MEAN, true, false));
+        }
+
+        try {
+            return net.quantize(blobs, CV_32F, CV_32F);
+        } catch (const cv::Exception&) {
+            return cv::dnn::Net();
+        }
+    }
+
+    cv::dnn::Net text_detector_load (const char* path, const struct TextModelOptions* options) {
+        cv::dnn::Net net = cv::dnn::readNet(path);
+        if (net.empty() || !options) return net;
+
+        int backend = options->backend;
+        int target = options->target;
+
+        if (options->precision == TEXT_PRECISION_INT8) {
+            net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+            net = text_detector_quantize(net, options->calibration);
+            if (net.empty()) return net;
+
+            // Quantized layers only have CPU implementations
+            backend = cv::dnn::DNN_BACKEND_OPENCV;
+            target = cv::dnn::DNN_TARGET_CPU;
+        } else if (options->precision == TEXT_PRECISION_FP16) {
+            if (target == cv::dnn::DNN_TARGET_OPENCL) target = cv::dnn::DNN_TARGET_OPENCL_FP16;
+            else if (target == cv::dnn::DNN_TARGET_CUDA) target = cv::dnn::DNN_TARGET_CUDA_FP16;
+#if CV_VERSION_MAJOR > 4 || CV_VERSION_MINOR >= 9
+            else if (target == cv::dnn::DNN_TARGET_CPU) target = cv::dnn::DNN_TARGET_CPU_FP16;
+#endif
+        }
+
+        net.setPreferableBackend(backend);
+        net.setPreferableTarget(target);
+
+        return net;
+    }
+
+    bool text_precision_parse (const char* name, enum TextPrecision* precision) {
+        if (!strcmp(name, "fp32")) *precision = TEXT_PRECISION_FP32;
+        else if (!strcmp(name, "fp16")) *precision = TEXT_PRECISION_FP16;
+        else if (!strcmp(name, "int8")) *precision = TEXT_PRECISION_INT8;
+        else return false;
+        return true;
+    }
+
+    std::vector<std::vector<int>> text_batch_buckets (const std::vector<cv::Size>& frame_sizes, int max_batch, const struct TextInputLimits* limits) {
+        std::vector<std::vector<int>> batches;
+        std::vector<cv::Size> batch_sizes;
+        std::vector<int> batch_inputs;
+
+        if (max_batch <= 0) max_batch = 1;
+
+        for (int i = 0; i < frame_sizes.size(); i++) {
+            std::vector<struct TextInput> inputs;
+            text_input_plan(frame_sizes[i], 0, limits, inputs);
+
+            // Only frames with the same blob size share a batch: padding a frame to a larger batch mate
+            // changes its EAST output near the edges, the detections of a panel would depend on the rest of the page
+            cv::Size bucket = inputs[0].tile.size();
+
+            int found = -1;
+            for (int j = 0; j < batches.size(); j++) {
+                if (batch_sizes[j] == bucket && batch_inputs[j] + inputs.size() <= max_batch) {
+                    found = j;
+                    break;
+                }
+            }
+
+            if (found < 0) {
+                batches.push_back(std::vector<int>());
+                batch_sizes.push_back(bucket);
+                batch_inputs.push_back(0);
+                found = batches.size() - 1;
+            }
+
+            batches[found].push_back(i);
+            batch_inputs[found] += inputs.size();
+        }
+
+        return batches;
+    }
+
+    void text_forward_batch (
+        const std::vector<cv::Mat>& frames, 
+        const std::vector<int>& indices, 
+        cv::dnn::Net detector, 
+        std::vector<cv::Mat>& outs,
+        std::vector<struct TextInput>& inputs,
+        struct Workspace* ws,
+        struct Tracer* tracer,
+        const struct TextInputLimits* limits
+    ) {
+        assert(!indices.empty());
+
+        int64_t span = trace_begin(tracer);
+
+        // Every frame is resized to its own blob size (and maybe tiled), the inputs of batches from text_batch_buckets all have
+        // that size, other batches are padded to the largest input
+        inputs.clear();
+        for (int k = 0; k < indices.size(); k++) text_input_plan(frames[indices[k]].size(), k, limits, inputs);
+
+        cv::Size bucket(0, 0);
+        for (auto &input : inputs) {
+            bucket.width = std::max(bucket.width, input.tile.width);
+            bucket.height = std::max(bucket.height, input.tile.height);
+        }
+
+        // Padding with the mean cancels out to zero after mean subtraction (mean is RGB, the canvas BGR)
+        cv::Scalar mean = TEXT_EAST_MEAN;
+        cv::Scalar pad_color(mean[2], mean[1], mean[0]);
+
+        std::vector<cv::Mat> canvases;
+        cv::Mat scaled;
+        int scaled_frame = -1;
+        for (int j = 0; j < inputs.size(); j++) {
+            const struct TextInput& input = inputs[j];
+            cv::Mat canvas = workspace_mat(ws, WS_TEXT_CANVAS + j, bucket, CV_8UC3);
+            canvas.setTo(pad_color);
+
+            if (input.tile.size() == input.scaled) {
+                cv::resize(text_bgr(frames[indices[input.frame]]), canvas(input.tile), input.scaled);
+            } else {
+                // Tiles of the same frame are next to each other, the frame is only resized once
+                if (scaled_frame != input.frame) {
+                    scaled = workspace_mat(ws, WS_TEXT_SCALED, input.scaled, CV_8UC3);
+                    cv::resize(text_bgr(frames[indices[input.frame]]), scaled, input.scaled);
+                    scaled_frame = input.frame;
+                }
+                scaled(input.tile).copyTo(canvas(cv::Rect(cv::Point(0, 0), input.tile.size())));
+            }
+
+            canvases.push_back(canvas);
+        }
+
+        // blobFromImages reuses the blob kept in the workspace when the batch has the same shape
+        cv::Mat local_blob;
+        cv::Mat& blob = ws ? workspace_slot(ws, WS_TEXT_BLOB) : local_blob;
+        uchar* blob_data = blob.data;
+        cv::dnn::blobFromImages(canvases, blob, 1.0, cv::Size(), mean, true, false);
+        if (ws && blob_data && blob.data == blob_data) ws->reused++;
+        else if (ws) ws->allocated++;
+
+        canvases.clear();
+
+        trace_end(tracer, "blob_build", span);
+        span = trace_begin(tracer);
+
         detector.setInput(blob);
-        std::vector<cv::Mat> outs;
         std::vector<cv::String> outNames(2);
         outNames[0] = "feature_fusion/Conv_7/Sigmoid";
         outNames[1] = "feature_fusion/concat_3";
         detector.forward(outs, outNames);
 
-        blob.release(); // free the blob data from memory
+        trace_end(tracer, "forward", span);
+
+        if (!ws) blob.release(); // free the blob data from memory
+    }
+
+    void text_decode_batch (
+        const std::vector<cv::Mat>& frames, 
+        const std::vector<int>& indices, 
+        const std::vector<cv::Mat>& outs,
+        const std::vector<struct TextInput>& inputs,
+        float score_thresh,
+        std::vector<struct TextDetections>& out,
+        struct Tracer* tracer
+    ) {
+        out.clear();
+        out.resize(indices.size());
 
         cv::Mat scores = outs[0];
         cv::Mat geometry = outs[1];
 
-        // Decode predicted bounding boxes.
-        std::vector<cv::RotatedRect> boxes;
-        std::vector<float> confidences;
-        decodeBoundingBoxes(scores, geometry, score_thresh, boxes, confidences);
+        std::vector<std::vector<cv::RotatedRect>> boxes(indices.size());
+        std::vector<std::vector<float>> confidences(indices.size());
+        std::vector<cv::Size> scaled(indices.size());
+
+        for (int j = 0; j < inputs.size(); j++) {
+            const struct TextInput& input = inputs[j];
+            scaled[input.frame] = input.scaled;
+
+            // Decode predicted bounding boxes.
+            int64_t span = trace_begin(tracer);
+            std::vector<cv::RotatedRect> tile_boxes;
+            std::vector<float> tile_confidences;
+            decodeBoundingBoxes(scores, geometry, j, input.tile.size(), score_thresh, tile_boxes, tile_confidences);
+
+            // Boxes of tiles are moved to frame coordinates, the overlaps are left to the neighbour whose core they are in
+            bool tiled = input.tile.size() != input.scaled;
+            for (int b = 0; b < tile_boxes.size(); b++) {
+                cv::RotatedRect box = tile_boxes[b];
+                box.center += cv::Point2f(input.tile.tl());
+                if (tiled && !input.core.contains(cv::Point(cvFloor(box.center.x), cvFloor(box.center.y)))) continue;
+                boxes[input.frame].push_back(box);
+                confidences[input.frame].push_back(tile_confidences[b]);
+            }
+            trace_end(tracer, "decode", span, indices[input.frame]);
+        }
 
-        // Apply non-maximum suppression procedure.
-        std::vector<int> indices;
-        cv::dnn::NMSBoxes(boxes, confidences, score_thresh, 0.8, indices);
+        for (int k = 0; k < indices.size(); k++) {
+            cv::Size frame_size = frames[indices[k]].size();
 
-        cv::Point2f ratio((float)color.cols / (blob_w * 32), (float)color.rows / (blob_h * 32));
-        
-        cv::Mat text_mask(color.size(), CV_8UC1, cv::Scalar(0));
+            // Apply non-maximum suppression procedure.
+            int64_t span = trace_begin(tracer);
+            std::vector<int> nms_indices;
+            cv::dnn::NMSBoxes(boxes[k], confidences[k], score_thresh, 0.8, nms_indices);
+            trace_end(tracer, "nms", span, indices[k]);
+            trace_count(tracer, "boxes", nms_indices.size());
+
+            struct TextDetections& det = out[k];
+            for (auto &i : nms_indices) {
+                det.boxes.push_back(boxes[k][i]);
+                det.confidences.push_back(confidences[k][i]);
+            }
+            det.ratio = cv::Point2f((float)frame_size.width / scaled[k].width, (float)frame_size.height / scaled[k].height);
+            det.blob_size = scaled[k];
+        }
+    }
+
+    void detect_text_batch (
+        const std::vector<cv::Mat>& frames, 
+        const std::vector<int>& indices, 
+        cv::dnn::Net detector, 
+        float score_thresh,
+        std::vector<struct TextDetections>& out,
+        struct Workspace* ws,
+        struct Tracer* tracer,
+        const struct TextInputLimits* limits
+    ) {
+        std::vector<cv::Mat> outs;
+        std::vector<struct TextInput> inputs;
+
+        text_forward_batch(frames, indices, detector, outs, inputs, ws, tracer, limits);
+        text_decode_batch(frames, indices, outs, inputs, score_thresh, out, tracer);
+    }
+
+    /**
+     * Pixel bounds of a detection in frame coordinates, the same pixels fillConvexPoly would cover
+     */
+    static cv::Rect text_box_bounds (const cv::RotatedRect& box, cv::Point2f ratio) {
+        cv::Point2f vertices2f[4];
+        box.points(vertices2f);
+
+        cv::Point top_left(INT_MAX, INT_MAX), bottom_right(INT_MIN, INT_MIN);
+        for (int j = 0; j < 4; ++j) {
+            cv::Point vertex = cv::Point2f(vertices2f[j].x * ratio.x, vertices2f[j].y * ratio.y);
+            top_left.x = std::min(top_left.x, vertex.x);
+            top_left.y = std::min(top_left.y, vertex.y);
+            bottom_right.x = std::max(bottom_right.x, vertex.x);
+            bottom_right.y = std::max(bottom_right.y, vertex.y);
+        }
+
+        return cv::Rect(top_left, bottom_right + cv::Point(1, 1));
+    }
+
+    /**
+     * Union-find root with path halving
+     */
+    static int group_root (std::vector<int>& parent, int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    /**
+     * Whether closing with a gap x gap kernel would join the two boxes: they overlap, touch diagonally,
+     * or share rows (columns) and are less than gap columns (rows) apart
+     */
+    static bool text_boxes_close (const cv::Rect& a, const cv::Rect& b, int gap) {
+        int gap_x = std::max(b.x - (a.x + a.width), a.x - (b.x + b.width));
+        int gap_y = std::max(b.y - (a.y + a.height), a.y - (b.y + b.height));
+
+        if (gap_x <= 0 && gap_y <= 0) return true;
+        if (gap_x < 0) return gap_y < gap;
+        if (gap_y < 0) return gap_x < gap;
+        return false;
+    }
+
+    static std::vector<cv::Rect> text_regions_mask (cv::Size frame_size, const struct TextDetections& detections, struct Workspace* ws) {
+        int blob_w = detections.blob_size.width / 32;
+
+        cv::Mat text_mask = workspace_mat(ws, WS_TEXT_MASK, frame_size, CV_8UC1);
+        text_mask.setTo(cv::Scalar(0));
 
         // Generate mask of text
-        for (size_t i = 0; i < indices.size(); ++i)
+        for (auto &box : detections.boxes)
         {
-            cv::RotatedRect& box = boxes[indices[i]];
-
             cv::Point2f vertices2f[4];
             box.points(vertices2f);
 
             // rescale 
             for (int j = 0; j < 4; ++j)
             {
-                vertices2f[j].x *= ratio.x;
-                vertices2f[j].y *= ratio.y;
+                vertices2f[j].x *= detections.ratio.x;
+                vertices2f[j].y *= detections.ratio.y;
             }
 
             cv::Point vertices[4];    
@@ -133,7 +551,7 @@ namespace chopfox {
         }
 
         // Get text regions from the mask
-        cv::Mat text_regions;
+        cv::Mat text_regions = workspace_mat(ws, WS_TEXT_REGIONS, frame_size, CV_8UC1);
         cv::Mat close_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(blob_w,blob_w)); // blob_w is nice size for the kernel ?
         cv::morphologyEx(text_mask, text_regions, cv::MORPH_CLOSE, close_kernel);
 
@@ -146,30 +564,244 @@ namespace chopfox {
 
         text_regions.release();
 
-        std::vector<struct TextBlock> text_blocks;
+        std::vector<cv::Rect> regions;
+        for (auto &contour : contours) regions.push_back(cv::boundingRect(contour));
 
-        tesseract::TessBaseAPI ocr;
+        return regions;
+    }
 
-        ocr.Init(NULL, lang, tesseract::OEM_LSTM_ONLY /* Use the deep learning engine instead of the legacy one */); 
-        ocr.SetPageSegMode(tesseract::PSM_SINGLE_BLOCK); // assume single block of text
+    static std::vector<cv::Rect> text_regions_geometric (cv::Size frame_size, const struct TextDetections& detections) {
+        int gap = std::max(detections.blob_size.width / 32, 1); // same as the closing kernel of the mask
 
-        for (auto &contour : contours) {
-            struct TextBlock block;
+        cv::Rect frame_rect(cv::Point(0, 0), frame_size);
+
+        std::vector<cv::Rect> bounds;
+        for (auto &box : detections.boxes) {
+            cv::Rect rect = text_box_bounds(box, detections.ratio) & frame_rect;
+            if (!rect.empty()) bounds.push_back(rect);
+        }
+
+        if (bounds.empty()) return std::vector<cv::Rect>();
+
+        // Grid of cells about the size of a box, every box is listed in the cells its bounds grown by the gap cover
+        int cell = gap;
+        for (auto &rect : bounds) cell = std::max(cell, std::min(rect.width, rect.height));
+
+        int grid_w = frame_size.width / cell + 1, grid_h = frame_size.height / cell + 1;
+        std::vector<std::vector<int>> grid(grid_w * grid_h);
+
+        for (int i = 0; i < bounds.size(); i++) {
+            cv::Rect reach(bounds[i].x - gap, bounds[i].y - gap, bounds[i].width + gap * 2, bounds[i].height + gap * 2);
+            reach &= frame_rect;
+            for (int gy = reach.y / cell; gy <= (reach.y + reach.height - 1) / cell; gy++) {
+                for (int gx = reach.x / cell; gx <= (reach.x + reach.width - 1) / cell; gx++) {
+                    grid[gy * grid_w + gx].push_back(i);
+                }
+            }
+        }
+
+        // Join the boxes that would be joined by the closing, only boxes sharing a cell can be close enough
+        std::vector<int> parent(bounds.size());
+        for (int i = 0; i < parent.size(); i++) parent[i] = i;
+
+        for (auto &members : grid) {
+            for (int m = 0; m < members.size(); m++) {
+                for (int n = m + 1; n < members.size(); n++) {
+                    int a = group_root(parent, members[m]), b = group_root(parent, members[n]);
+                    if (a == b || !text_boxes_close(bounds[members[m]], bounds[members[n]], gap)) continue;
+                    parent[std::max(a, b)] = std::min(a, b);
+                }
+            }
+        }
+
+        std::vector<int> group_index(bounds.size(), -1);
+        std::vector<cv::Rect> regions;
+        for (int i = 0; i < bounds.size(); i++) {
+            int root = group_root(parent, i);
+            if (group_index[root] < 0) {
+                group_index[root] = regions.size();
+                regions.push_back(bounds[i]);
+            } else {
+                regions[group_index[root]] |= bounds[i];
+            }
+        }
+
+        // Reading order, top to bottom
+        std::sort(regions.begin(), regions.end(), [] (const cv::Rect& a, const cv::Rect& b) {
+            return a.y != b.y ? a.y < b.y : a.x < b.x;
+        });
+
+        return regions;
+    }
+
+    std::vector<cv::Rect> text_regions (cv::Size frame_size, const struct TextDetections& detections, enum TextGrouping grouping, struct Workspace* ws) {
+        if (grouping == TEXT_GROUPING_MASK) return text_regions_mask(frame_size, detections, ws);
+        return text_regions_geometric(frame_size, detections);
+    }
+
+    std::vector<cv::Rect> text_lines (cv::Size frame_size, const struct TextDetections& detections, const cv::Rect& block) {
+        cv::Rect frame_rect(cv::Point(0, 0), frame_size);
+
+        std::vector<cv::Rect> bounds;
+        for (auto &box : detections.boxes) {
+            cv::Rect rect = text_box_bounds(box, detections.ratio) & frame_rect;
+            if (!rect.empty() && block.contains(cv::Point(rect.x + rect.width / 2, rect.y + rect.height / 2))) bounds.push_back(rect);
+        }
+
+        std::sort(bounds.begin(), bounds.end(), [] (const cv::Rect& a, const cv::Rect& b) {
+            return a.y * 2 + a.height < b.y * 2 + b.height;
+        });
+
+        std::vector<cv::Rect> lines;
+        for (auto &rect : bounds) {
+            bool joined = false;
+            for (auto &line : lines) {
+                int shared = std::min(line.y + line.height, rect.y + rect.height) - std::max(line.y, rect.y);
+                if (shared * 2 <= std::min(line.height, rect.height)) continue;
+                line |= rect;
+                joined = true;
+                break;
+            }
+            if (!joined) lines.push_back(rect);
+        }
+
+        std::sort(lines.begin(), lines.end(), [] (const cv::Rect& a, const cv::Rect& b) {
+            return a.y != b.y ? a.y < b.y : a.x < b.x;
+        });
+
+        return lines;
+    }
+
+    /**
+     * Amount of characters (not bytes) in an UTF-8 string
+     */
+    static size_t utf8_length (const char* text) {
+        size_t length = 0;
+        for (; text && *text; text++) {
+            if ((*text & 0xC0) != 0x80) length++;
+        }
+        return length;
+    }
+
+    std::vector<struct PageText> recognize_text (
+        cv::Mat frame, 
+        const struct TextDetections& detections, 
+        tesseract::TessBaseAPI* ocr, 
+        int ppi, 
+        enum TextGrouping grouping,
+        struct Workspace* ws,
+        struct Tracer* tracer,
+        enum TextRecognition recognition
+    ) {
+        cv::Mat color = text_bgr(frame);
+
+        int64_t span = trace_begin(tracer);
+        std::vector<cv::Rect> regions = text_regions(color.size(), detections, grouping, ws);
+        trace_end(tracer, "grouping", span);
+
+        std::vector<struct PageText> text_blocks;
+
+        if (recognition == TEXT_RECOGNITION_LINE && !regions.empty()) {
+            // Reading order for the mask grouping as well
+            std::sort(regions.begin(), regions.end(), [] (const cv::Rect& a, const cv::Rect& b) {
+                return a.y != b.y ? a.y < b.y : a.x < b.x;
+            });
+
+            cv::Rect frame_rect(cv::Point(0, 0), color.size());
+            tesseract::PageSegMode mode = ocr->GetPageSegMode();
+
+            ocr->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+            ocr->SetImage(color.data, color.cols, color.rows, color.channels(), color.step); // Load the panel once
+            ocr->SetSourceResolution(ppi);
+
+            size_t line_count = 0;
+            for (int i = 0; i < regions.size(); i++) {
+                struct PageText block;
+                block.bounding_box = regions[i];
+
+                span = trace_begin(tracer);
+
+                for (auto &line : text_lines(color.size(), detections, regions[i])) {
+                    // EAST boxes hug the glyphs, tesseract reads better with a little background around them
+                    int pad = std::max(line.height / 6, 1);
+                    cv::Rect padded = cv::Rect(line.x - pad, line.y - pad, line.width + pad * 2, line.height + pad * 2) & frame_rect;
+
+                    ocr->SetRectangle(padded.x, padded.y, padded.width, padded.height);
+
+                    char* text = ocr->GetUTF8Text();
+                    if (text) block.text += text;
+                    delete[] text;
+
+                    line_count++;
+                }
+
+                trace_end(tracer, "ocr", span, i);
+                if (tracer) trace_count_add(tracer, "characters", utf8_length(block.text.c_str()));
+
+                text_blocks.push_back(std::move(block));
+            }
+
+            ocr->Clear();
+            ocr->SetPageSegMode(mode); // engines are pooled, the next user may expect block mode
+
+            trace_count(tracer, "text_blocks", text_blocks.size());
+            trace_count(tracer, "text_lines", line_count);
+
+            return text_blocks;
+        }
+
+        for (int i = 0; i < regions.size(); i++) {
+            const cv::Rect& region = regions[i];
+            struct PageText block;
+
+            span = trace_begin(tracer);
             
-            block.bounding_box = cv::boundingRect(contour);
+            block.bounding_box = region;
 
             cv::Mat txt_im = color(block.bounding_box);
 
-            ocr.SetImage(txt_im.data, txt_im.cols, txt_im.rows, txt_im.channels(), txt_im.step); // Load the image
-            ocr.SetSourceResolution(ppi); // Set the ppi
+            ocr->SetImage(txt_im.data, txt_im.cols, txt_im.rows, txt_im.channels(), txt_im.step); // Load the image
+            ocr->SetSourceResolution(ppi); // Set the ppi
             
-            block.text = ocr.GetUTF8Text(); // get the text
+            char* text = ocr->GetUTF8Text(); // get the text
+            if (text) block.text = text;
+            delete[] text;
+
+            trace_end(tracer, "ocr", span, i);
+            if (tracer) trace_count_add(tracer, "characters", utf8_length(block.text.c_str()));
 
-            text_blocks.push_back(block);
+            text_blocks.push_back(std::move(block));
 
             txt_im.release();
         }
 
+        ocr->Clear(); // drop the panel image, keep the loaded models
+
+        trace_count(tracer, "text_blocks", text_blocks.size());
+
         return text_blocks;
     }
+
+    std::vector<struct TextBlock> text_blocks_export (const std::vector<struct PageText>& text) {
+        std::vector<struct TextBlock> blocks;
+        blocks.reserve(text.size());
+        for (auto &region : text) {
+            struct TextBlock block;
+            block.bounding_box = region.bounding_box;
+            block.text = new char[region.text.size() + 1];
+            memcpy(block.text, region.text.c_str(), region.text.size() + 1);
+            blocks.push_back(block);
+        }
+        return blocks;
+    }
+
+    std::vector<struct TextBlock> transcribe (cv::Mat frame, cv::dnn::Net detector, tesseract::TessBaseAPI* ocr, float score_thresh, int ppi, struct Workspace* ws, struct Tracer* tracer, const struct TextInputLimits* limits) {
+        std::vector<cv::Mat> frames = { frame };
+        std::vector<int> indices = { 0 };
+        std::vector<struct TextDetections> detections;
+
+        detect_text_batch(frames, indices, detector, score_thresh, detections, ws, tracer, limits);
+
+        return text_blocks_export(recognize_text(frame, detections[0], ocr, ppi, TEXT_GROUPING_MASK, ws, tracer));
+    }
 }
\ No newline at end of file
@@ -20,13 +20,111 @@
 
 #include <opencv2/core.hpp>
 #include <opencv2/dnn.hpp>
+#include "workspace.hpp"
+#include "trace.hpp"
+
+namespace tesseract {
+    class TessBaseAPI;
+}
 
 namespace chopfox {
+    /**
+     * Text of a region as returned by transcribe
+     * The text is allocated with new[] and belongs to the caller, simple_data_free releases the text of a SimpleComicData.
+     */
     struct TextBlock {
         cv::Rect bounding_box;
         char* text;
     };
 
+    /**
+     * Text of a region owning its string, used by SimplePageData & recognize_text
+     */
+    struct PageText {
+        cv::Rect bounding_box;
+        std::string text; // UTF-8
+    };
+
+    struct TextDetections {
+        std::vector<cv::RotatedRect> boxes; // Text boxes after NMS in blob coordinates
+        std::vector<float> confidences;
+        cv::Point2f ratio; // Scale from blob to frame coordinates
+        cv::Size blob_size; // Size of the whole frame in the EAST input coordinates
+    };
+
+    /**
+     * How the detected text boxes are merged into text blocks
+     */
+    enum TextGrouping {
+        TEXT_GROUPING_GEOMETRIC, // Union-find on the box bounds, cost depends on the amount of boxes (opt-in, check chopfox-bench grouping_agreement)
+        TEXT_GROUPING_MASK // Close a mask of the boxes and find its contours, cost depends on the frame size (default)
+    };
+
+    /**
+     * How the text of a block is recognized
+     */
+    enum TextRecognition {
+        TEXT_RECOGNITION_BLOCK, // Every block is set as its own image and tesseract runs its layout analysis on it
+        TEXT_RECOGNITION_LINE // The panel is set once, the detected lines of every block are recognized as single lines
+    };
+
+    /**
+     * How frames larger than the max EAST input are handled
+     */
+    enum TextLargeFrames {
+        TEXT_LARGE_AUTO, // Downscale as long as the smallest text stays detectable, tile what is left
+        TEXT_LARGE_DOWNSCALE, // Always downscale to the max input size
+        TEXT_LARGE_TILE // Keep the resolution and split the frame into overlapping tiles
+    };
+
+    /**
+     * Caps the EAST input size so the inference cost of large panels is bounded
+     */
+    struct TextInputLimits {
+        int max_side; // Longest side of an EAST input in pixels (0 for no limit)
+        enum TextLargeFrames large_frames;
+        int min_text_height; // Height in frame pixels of the smallest text that has to stay detectable (auto mode)
+        int tile_overlap; // Pixels shared by neighbouring tiles, text longer than this may be split in two boxes
+    };
+
+    /**
+     * One EAST input of a batch, a whole frame or a tile of it
+     */
+    struct TextInput {
+        int frame; // Position of the frame in the batch indices
+        cv::Size scaled; // Size the whole frame is resized to (multiple of 32)
+        cv::Rect tile; // Area of the resized frame fed to EAST
+        cv::Rect core; // Boxes centered in this area of the resized frame are taken from this tile, the rest from its neighbours
+    };
+
+    /**
+     * Numeric precision of the EAST forward pass
+     */
+    enum TextPrecision {
+        TEXT_PRECISION_FP32,
+        TEXT_PRECISION_FP16, // Half precision target, needs hardware FP16 support (ARMv8.2, OpenCL, CUDA)
+        TEXT_PRECISION_INT8 // Weights & activations quantized from calibration samples, OpenCV backend on the CPU only
+    };
+
+    /**
+     * Where & how the EAST model runs
+     */
+    struct TextModelOptions {
+        int backend; // cv::dnn::Backend
+        int target; // cv::dnn::Target, switched to its FP16 variant with TEXT_PRECISION_FP16
+        enum TextPrecision precision;
+        std::vector<cv::Mat> calibration; // Sample pages or panels the INT8 activation ranges are measured on
+    };
+
+    /**
+     * Cheap check of a thumbnail of a panel, run before the EAST & OCR stages to skip the panels without text
+     */
+    struct TextPrefilter {
+        int thumb_side; // Longest side of the thumbnail (0 disables the prefilter)
+        int min_contrast; // Gray level difference between a stroke pixel and its surroundings
+        double min_density; // Fraction of the thumbnail covered by strokes below which a panel is considered textless
+    };
+
     /**
      * Transcibe chopped up panel
      * @param frame The panel to transcribe
@@ -34,7 +132,7 @@ namespace chopfox {
      * @param score_thresh The minimum score for text regions found
      * @param lang The language to use for tesseract-ocr text recognition
      * @param ppi The frame ppi (used for tesseract)
-     * @returns Structure containing the identified text strings and regions
+     * @returns Structure containing the identified text strings and regions, free the text with delete[] (empty if lang could not be loaded)
      */
     std::vector<struct TextBlock> transcribe (
         cv::Mat frame, 
@@ -43,6 +141,239 @@ namespace chopfox {
         const char* lang = "eng", 
         int ppi = 300
     );
+
+    /**
+     * Transcibe chopped up panel using an already initialized tesseract engine
+     * @param frame The panel to transcribe
+     * @param detector The EAST CNN to use for text ROI detection
+     * @param ocr The tesseract-ocr engine to use, usually created by ocr_engine_init
+     * @param score_thresh The minimum score for text regions found
+     * @param ppi The frame ppi (used for tesseract)
+     * @param ws Workspace to keep the EAST input & text mask in between calls (NULL allocates them every time)
+     * @param tracer Tracer to record the stages in (NULL disables tracing)
+     * @param limits Cap on the EAST input size (NULL feeds the whole frame)
+     * @returns Structure containing the identified text strings and regions, free the text with delete[]
+     */
+    std::vector<struct TextBlock> transcribe (
+        cv::Mat frame, 
+        cv::dnn::Net detector, 
+        tesseract::TessBaseAPI* ocr,
+        float score_thresh = 0.4f, 
+        int ppi = 300,
+        struct Workspace* ws = NULL,
+        struct Tracer* tracer = NULL,
+        const struct TextInputLimits* limits = NULL
+    );
+
+    /**
+     * Copy owned text into the TextBlock layout
+     * @param text The text regions to copy
+     * @returns The same regions with the text in new[] allocated C strings
+     */
+    std::vector<struct TextBlock> text_blocks_export (const std::vector<struct PageText>& text);
+
+    /**
+     * Text of a region as a C string, so code can read both layouts without copying
+     */
+    inline const char* text_string (const struct PageText& text) { return text.text.c_str(); }
+    inline const char* text_string (const struct TextBlock& text) { return text.text ? text.text : ""; }
+
+    /**
+     * Measure how much of a thumbnail of the frame is covered by thin dark strokes, like lettering on a bright background
+     * @param frame The panel to check
+     * @param prefilter The thumbnail size & stroke contrast to use
+     * @param ws Workspace to keep the thumbnail in between calls (NULL allocates it every time)
+     * @returns The fraction of thumbnail pixels on strokes
+     */
+    double text_stroke_density (cv::Mat frame, const struct TextPrefilter* prefilter, struct Workspace* ws = NULL);
+
+    /**
+     * Whether the frame may contain text and has to go through the EAST & OCR stages
+     * @param frame The panel to check
+     * @param prefilter The prefilter options (NULL or a thumb_side of 0 always returns true)
+     * @param ws Workspace to keep the thumbnail in between calls (NULL allocates it every time)
+     * @returns false if the panel is textless
+     */
+    bool text_likely (cv::Mat frame, const struct TextPrefilter* prefilter, struct Workspace* ws = NULL);
+
+    /// Batched text detection
+
+    /**
+     * Group frames into batches that share the same EAST input size
+     * Nothing is padded so the detections of a frame don't depend on the other frames, or on max_batch.
+     * @param frame_sizes The sizes of the panels to group
+     * @param max_batch The max amount of EAST inputs in a batch (1 disables batching), a tiled frame is never split across batches
+     * @param limits Cap on the EAST input size (NULL feeds whole frames)
+     * @returns Vector of batches, each containing indices into frame_sizes
+     */
+    std::vector<std::vector<int>> text_batch_buckets (const std::vector<cv::Size>& frame_sizes, int max_batch = 8, const struct TextInputLimits* limits = NULL);
+
+    /**
+     * Plan the EAST inputs of a frame: its resized size and the tiles it is split in
+     * @param frame_size The size of the panel
+     * @param frame The position of the frame in the batch, stored in the inputs
+     * @param limits Cap on the EAST input size (NULL for a single input covering the whole frame)
+     * @param inputs The inputs of the frame are appended to it
+     */
+    void text_input_plan (cv::Size frame_size, int frame, const struct TextInputLimits* limits, std::vector<struct TextInput>& inputs);
+
+    /**
+     * Find the text regions in several frames with a single forward pass of the EAST CNN
+     * @param frames The panels to look for text in
+     * @param indices The frames in this batch, usually one of the batches from text_batch_buckets
+     * @param detector The EAST CNN to use for text ROI detection
+     * @param score_thresh The minimum score for text regions found
+     * @param out Detections for every frame in indices (same order)
+     * @param ws Workspace to keep the canvases & blob in between batches (NULL allocates them every time)
+     * @param tracer Tracer to record the blob_build, forward, decode & nms spans in (NULL disables tracing)
+     * @param limits Cap on the EAST input size, larger frames are downscaled or tiled (NULL feeds whole frames)
+     */
+    void detect_text_batch (
+        const std::vector<cv::Mat>& frames, 
+        const std::vector<int>& indices, 
+        cv::dnn::Net detector, 
+        float score_thresh,
+        std::vector<struct TextDetections>& out,
+        struct Workspace* ws = NULL,
+        struct Tracer* tracer = NULL,
+        const struct TextInputLimits* limits = NULL
+    );
+
+    /**
+     * Run the EAST CNN on a batch of frames, the first half of detect_text_batch
+     * @param frames The panels to look for text in
+     * @param indices The frames in this batch, usually one of the batches from text_batch_buckets
+     * @param detector The EAST CNN to use for text ROI detection
+     * @param outs The score & geometry maps of the whole batch
+     * @param inputs The EAST inputs of the batch, one per frame or one per tile of a tiled frame
+     * @param ws Workspace to keep the canvases & blob in between batches (NULL allocates them every time)
+     * @param tracer Tracer to record the blob_build & forward spans in (NULL disables tracing)
+     * @param limits Cap on the EAST input size (NULL feeds whole frames)
+     */
+    void text_forward_batch (
+        const std::vector<cv::Mat>& frames, 
+        const std::vector<int>& indices, 
+        cv::dnn::Net detector, 
+        std::vector<cv::Mat>& outs,
+        std::vector<struct TextInput>& inputs,
+        struct Workspace* ws = NULL,
+        struct Tracer* tracer = NULL,
+        const struct TextInputLimits* limits = NULL
+    );
+
+    /**
+     * Decode the boxes from the EAST output and apply non-maximum suppression, the second half of detect_text_batch
+     * The boxes of all the tiles of a frame are merged before the suppression.
+     * @param frames The panels the forward pass was run on
+     * @param indices The frames in this batch
+     * @param outs The score & geometry maps from text_forward_batch
+     * @param inputs The inputs from text_forward_batch
+     * @param score_thresh The minimum score for text regions found
+     * @param out Detections for every frame in indices (same order)
+     * @param tracer Tracer to record the decode & nms spans of every frame and the boxes counter in (NULL disables tracing)
+     */
+    void text_decode_batch (
+        const std::vector<cv::Mat>& frames, 
+        const std::vector<int>& indices, 
+        const std::vector<cv::Mat>& outs,
+        const std::vector<struct TextInput>& inputs,
+        float score_thresh,
+        std::vector<struct TextDetections>& out,
+        struct Tracer* tracer = NULL
+    );
+
+    /**
+     * Merge detected text regions into blocks
+     * Boxes are joined when they overlap or when a blob_w x blob_w closing would bridge the gap between them.
+     * The geometric grouping works on the axis aligned bounds of the boxes, so it can differ from the mask on strongly rotated text.
+     * @param frame_size The size of the panel the detections were made on
+     * @param detections The text regions found by detect_text_batch
+     * @param grouping How to merge the text regions
+     * @param ws Workspace to keep the text mask in (only used by TEXT_GROUPING_MASK)
+     * @returns The bounding boxes of the text blocks (top to bottom for the geometric grouping)
+     */
+    std::vector<cv::Rect> text_regions (
+        cv::Size frame_size, 
+        const struct TextDetections& detections, 
+        enum TextGrouping grouping = TEXT_GROUPING_MASK,
+        struct Workspace* ws = NULL
+    );
+
+    /**
+     * Merge detected text regions into blocks and recognize the text in them
+     * @param frame The panel the detections were made on
+     * @param detections The text regions found by detect_text_batch
+     * @param ocr The tesseract-ocr engine to use
+     * @param ppi The frame ppi (used for tesseract)
+     * @param grouping How to merge the text regions into blocks
+     * @param ws Workspace to keep the text mask in (NULL allocates it)
+     * @param tracer Tracer to record the grouping & ocr spans and the blocks, lines & characters counters in (NULL disables tracing)
+     * @param recognition Whether tesseract segments the blocks itself or reads the lines EAST found
+     * @returns Structure containing the identified text strings and regions
+     */
+    std::vector<struct PageText> recognize_text (
+        cv::Mat frame, 
+        const struct TextDetections& detections, 
+        tesseract::TessBaseAPI* ocr, 
+        int ppi = 300,
+        enum TextGrouping grouping = TEXT_GROUPING_MASK,
+        struct Workspace* ws = NULL,
+        struct Tracer* tracer = NULL,
+        enum TextRecognition recognition = TEXT_RECOGNITION_BLOCK
+    );
+
+    /**
+     * Split the detections of a text block into lines
+     * Boxes are on the same line when they share more than half of the height of the smaller one.
+     * @param frame_size The size of the panel the detections were made on
+     * @param detections The text regions found by detect_text_batch
+     * @param block The block the lines are in, usually one of the text_regions
+     * @returns The bounds of the lines, top to bottom
+     */
+    std::vector<cv::Rect> text_lines (cv::Size frame_size, const struct TextDetections& detections, const cv::Rect& block);
+
+    /// EAST models
+
+    /**
+     * Load the EAST model for a backend, target & precision
+     * @param path Path to the EAST model .pb file
+     * @param options The backend, target & precision (NULL for FP32 with the default backend)
+     * @returns The network, empty if it could not be loaded or quantized
+     */
+    cv::dnn::Net text_detector_load (const char* path, const struct TextModelOptions* options = NULL);
+
+    /**
+     * Quantize the EAST model to INT8, the input & outputs stay FP32 so the rest of the pipeline is unchanged
+     * @param net The FP32 network
+     * @param samples Pages or panels representative of the input, the activation ranges are measured on them
+     * @param max_side Samples are downscaled to fit this size, like text_forward_batch would
+     * @returns The quantized network, empty if there are no samples or the model has layers that can't be quantized
+     */
+    cv::dnn::Net text_detector_quantize (cv::dnn::Net net, const std::vector<cv::Mat>& samples, int max_side = 640);
+
+    /**
+     * Get a precision from its name
+     * @param name fp32, fp16 or int8
+     * @param precision The precision
+     * @returns false if the name is not known
+     */
+    bool text_precision_parse (const char* name, enum TextPrecision* precision);
+
+    /// OCR engines
+
+    /**
+     * Create and initialize a tesseract-ocr engine
+     * @param lang The language to use for text recognition
+     * @returns The engine or NULL if the language data could not be loaded
+     * @remarks Free the engine with ocr_engine_free
+     */
+    tesseract::TessBaseAPI* ocr_engine_init (const char* lang = "eng");
+
+    /**
+     * Free a tesseract-ocr engine created by ocr_engine_init
+     * @param ocr The engine to free
+     */
+    void ocr_engine_free (tesseract::TessBaseAPI* ocr);
 }
 
 #endif
\ No newline at end of file
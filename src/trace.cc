@@ -0,0 +1,145 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "trace.hpp"
+#include <atomic>
+
+namespace chopfox {
+    /**
+     * Small sequential id of the calling thread, used as the tid of the trace
+     */
+    static int trace_thread_id () {
+        static std::atomic<int> next_id(1);
+        thread_local int id = next_id++;
+        return id;
+    }
+
+    struct Tracer* tracer_init (size_t max_events) {
+        struct Tracer* tracer = new struct Tracer;
+
+        tracer->origin = cv::getTickCount();
+        tracer->max_events = max_events;
+        tracer->dropped = 0;
+
+        return tracer;
+    }
+
+    void trace_end_span (struct Tracer* tracer, const char* name, int64_t start, int index) {
+        int64_t end = cv::getTickCount();
+        double ms = (end - start) * 1000.0 / cv::getTickFrequency();
+
+        int bucket = 0;
+        for (double us = ms * 1000.0; us >= 1.0 && bucket < TRACE_BUCKETS - 1; us /= 2) bucket++;
+
+        struct TraceEvent event = { name, start - tracer->origin, end - start, trace_thread_id(), index };
+
+        std::lock_guard<std::mutex> guard(tracer->lock);
+
+        if (tracer->events.size() < tracer->max_events) tracer->events.push_back(event);
+        else tracer->dropped++;
+
+        struct TraceStats& stats = tracer->stats[name]; // Value-initialized the first time
+        stats.count++;
+        stats.total_ms += ms;
+        stats.max_ms = std::max(stats.max_ms, ms);
+        stats.buckets[bucket]++;
+    }
+
+    void trace_count_add (struct Tracer* tracer, const char* name, int64_t value) {
+        std::lock_guard<std::mutex> guard(tracer->lock);
+        tracer->counters[name] += value;
+    }
+
+    bool tracer_write_chrome (struct Tracer* tracer, const char* path) {
+        FILE* out = fopen(path, "w");
+        if (!out) return false;
+
+        std::lock_guard<std::mutex> guard(tracer->lock);
+
+        double us_per_tick = 1000000.0 / cv::getTickFrequency();
+        int64_t last = 0;
+        bool first = true;
+
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (auto &event : tracer->events) {
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"chopfox\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+                first ? "" : ",\n", event.name, event.start * us_per_tick, event.duration * us_per_tick, event.thread);
+            if (event.index >= 0) fprintf(out, ",\"args\":{\"index\":%d}", event.index);
+            fprintf(out, "}");
+            last = std::max(last, event.start + event.duration);
+            first = false;
+        }
+
+        // Counters are totals, shown at the end of the trace
+        for (auto &counter : tracer->counters) {
+            fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"value\":%lld}}",
+                first ? "" : ",\n", counter.first.c_str(), last * us_per_tick, (long long)counter.second);
+            first = false;
+        }
+
+        fprintf(out, "\n],\"otherData\":{\"dropped_events\":%d}}\n", (int)tracer->dropped);
+
+        return fclose(out) == 0;
+    }
+
+    /**
+     * Upper bound in milliseconds of the bucket holding the percentile p
+     */
+    static double trace_percentile (const struct TraceStats& stats, double p) {
+        size_t rank = (size_t)(p / 100.0 * stats.count);
+        size_t seen = 0;
+        for (int i = 0; i < TRACE_BUCKETS; i++) {
+            seen += stats.buckets[i];
+            if (seen > rank) return std::min((double)(1LL << i) / 1000.0, stats.max_ms);
+        }
+        return stats.max_ms;
+    }
+
+    void tracer_print_summary (struct Tracer* tracer, FILE* out) {
+        std::lock_guard<std::mutex> guard(tracer->lock);
+
+        fprintf(out, "[Chopfox] Trace summary (percentiles are bucket upper bounds)\n");
+
+        for (auto &item : tracer->stats) {
+            const struct TraceStats& stats = item.second;
+
+            fprintf(out, "%-14s count %-7d total %10.2fms  mean %8.3fms  p50 %8.3fms  p90 %8.3fms  p99 %8.3fms  max %8.3fms\n",
+                item.first.c_str(), (int)stats.count, stats.total_ms, stats.total_ms / stats.count,
+                trace_percentile(stats, 50), trace_percentile(stats, 90), trace_percentile(stats, 99), stats.max_ms);
+
+            size_t largest = 0;
+            for (int i = 0; i < TRACE_BUCKETS; i++) largest = std::max(largest, stats.buckets[i]);
+
+            for (int i = 0; i < TRACE_BUCKETS; i++) {
+                if (!stats.buckets[i]) continue;
+                double low = i == 0 ? 0 : (1LL << (i - 1)) / 1000.0, high = (1LL << i) / 1000.0;
+                int bar = (int)(40.0 * stats.buckets[i] / largest);
+                fprintf(out, "    %9.3f - %9.3fms %7d %s\n", low, high, (int)stats.buckets[i], std::string(std::max(bar, 1), '#').c_str());
+            }
+        }
+
+        for (auto &counter : tracer->counters) {
+            fprintf(out, "%-14s %lld\n", counter.first.c_str(), (long long)counter.second);
+        }
+
+        if (tracer->dropped) fprintf(out, "%d spans were not kept for the trace file\n", (int)tracer->dropped);
+    }
+
+    void tracer_free (struct Tracer* tracer) {
+        delete tracer;
+    }
+}
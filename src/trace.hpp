@@ -0,0 +1,128 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#define TRACE_BUCKETS 32 // Power of 2 buckets of microseconds
+
+namespace chopfox {
+    struct TraceEvent {
+        const char* name; // Static string
+        int64_t start; // Ticks since the tracer was created
+        int64_t duration; // Ticks
+        int thread;
+        int index; // Panel or block the span is about (-1 for none)
+    };
+
+    /**
+     * Aggregate of all the spans with the same name, kept even when the events are dropped
+     */
+    struct TraceStats {
+        size_t count;
+        double total_ms;
+        double max_ms;
+        size_t buckets[TRACE_BUCKETS]; // Bucket i counts the spans of [2^(i-1), 2^i) microseconds
+    };
+
+    /**
+     * Records the spans & counters of the processing stages
+     * Every function taking a tracer accepts NULL and then does nothing, so tracing costs a pointer check when disabled.
+     */
+    struct Tracer {
+        std::mutex lock;
+        int64_t origin; // Tick count when the tracer was created
+        size_t max_events; // Events past this are dropped, the stats are still updated
+        size_t dropped;
+        std::vector<struct TraceEvent> events;
+        std::map<std::string, struct TraceStats> stats;
+        std::map<std::string, int64_t> counters;
+    };
+
+    /**
+     * Create a new tracer
+     * @param max_events The max amount of spans kept for the Chrome trace
+     * @returns The new tracer
+     * @remarks Free the tracer with tracer_free
+     */
+    struct Tracer* tracer_init (size_t max_events = 1000000);
+
+    /**
+     * Start a span
+     * @param tracer The tracer (NULL when tracing is disabled)
+     * @returns The start of the span to pass to trace_end
+     */
+    inline int64_t trace_begin (struct Tracer* tracer) {
+        return tracer ? cv::getTickCount() : 0;
+    }
+
+    /**
+     * Record a span started with trace_begin
+     * @param tracer The tracer (NULL when tracing is disabled)
+     * @param name The name of the stage, must be a static string
+     * @param start The value returned by trace_begin
+     * @param index The panel or block the span is about (-1 for none)
+     */
+    void trace_end_span (struct Tracer* tracer, const char* name, int64_t start, int index);
+
+    inline void trace_end (struct Tracer* tracer, const char* name, int64_t start, int index = -1) {
+        if (tracer) trace_end_span(tracer, name, start, index);
+    }
+
+    /**
+     * Add to a counter
+     * @param tracer The tracer (NULL when tracing is disabled)
+     * @param name The name of the counter
+     * @param value The amount to add
+     */
+    void trace_count_add (struct Tracer* tracer, const char* name, int64_t value);
+
+    inline void trace_count (struct Tracer* tracer, const char* name, int64_t value) {
+        if (tracer) trace_count_add(tracer, name, value);
+    }
+
+    /**
+     * Write the spans & counters in the Chrome trace event format (chrome://tracing, Perfetto)
+     * @param tracer The tracer to export
+     * @param path The JSON file to write
+     * @returns false if the file could not be written
+     */
+    bool tracer_write_chrome (struct Tracer* tracer, const char* path);
+
+    /**
+     * Print the count, percentiles and a histogram of the duration of every stage, followed by the counters
+     * @param tracer The tracer to summarize
+     * @param out The file to print to
+     */
+    void tracer_print_summary (struct Tracer* tracer, FILE* out);
+
+    /**
+     * Free a tracer
+     * @param tracer The tracer to free
+     */
+    void tracer_free (struct Tracer* tracer);
+}
+
+#endif
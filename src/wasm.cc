@@ -0,0 +1,96 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "extract.hpp"
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+#include <assert.h>
+
+namespace chopfox {
+    /**
+     * Panel extraction state of one web worker, the page & the results stay in the WASM heap between calls
+     * The views returned to JS point into the heap, they are only valid until the next call (the heap may grow).
+     */
+    struct WasmExtractor {
+        struct Workspace* ws;
+        cv::Mat page; // RGBA, the layout of ImageData
+        PanelArray panels;
+        std::vector<int32_t> layout; // Panels as returned by wasm_panels
+        cv::Mat frame; // Last frame cropped by wasm_frame
+
+        WasmExtractor () : ws(workspace_init()) {}
+        ~WasmExtractor () { workspace_free(ws); }
+        WasmExtractor (const WasmExtractor&) = delete;
+        WasmExtractor& operator= (const WasmExtractor&) = delete;
+    };
+
+    /**
+     * Make room for a page, JS writes the ImageData pixels straight into the returned view
+     * @returns A Uint8Array view of the width * height * 4 page bytes
+     */
+    static emscripten::val wasm_page (WasmExtractor& ex, int width, int height) {
+        ex.page.create(height, width, CV_8UC4); // keeps the buffer when the size doesn't change
+        ex.panels.clear();
+
+        return emscripten::val(emscripten::typed_memory_view(ex.page.total() * 4, ex.page.data));
+    }
+
+    /**
+     * Find the panels on the page
+     * @returns An Int32Array view: the panel count, then x, y, width, height, the point count & the x, y of every point for every panel
+     */
+    static emscripten::val wasm_panels (WasmExtractor& ex, double precision, double min_area_divider) {
+        assert(!ex.page.empty());
+
+        ex.panels = get_panels_rgb(ex.page, precision, min_area_divider, ex.ws);
+
+        ex.layout.clear();
+        ex.layout.push_back(ex.panels.size());
+        for (auto &panel : ex.panels) {
+            const cv::Rect& box = panel.bounding_box;
+            ex.layout.insert(ex.layout.end(), { box.x, box.y, box.width, box.height, (int32_t)panel.contour.size() });
+            for (auto &point : panel.contour) {
+                ex.layout.push_back(point.x);
+                ex.layout.push_back(point.y);
+            }
+        }
+
+        return emscripten::val(emscripten::typed_memory_view(ex.layout.size(), ex.layout.data()));
+    }
+
+    /**
+     * Crop a panel found by wasm_panels, masked like crop_frames
+     * @returns A Uint8Array view of the RGBA pixels, the size of the panel bounding box
+     */
+    static emscripten::val wasm_frame (WasmExtractor& ex, int index) {
+        assert(index >= 0 && index < ex.panels.size());
+
+        PanelArray panel = { ex.panels[index] };
+        std::vector<cv::Mat> frames = crop_frames(ex.page, panel, ex.ws);
+        ex.frame = frames[0];
+
+        return emscripten::val(emscripten::typed_memory_view(ex.frame.total() * 4, ex.frame.data));
+    }
+}
+
+EMSCRIPTEN_BINDINGS(chopfox) {
+    emscripten::class_<chopfox::WasmExtractor>("Extractor")
+        .constructor<>()
+        .function("page", &chopfox::wasm_page)
+        .function("panels", &chopfox::wasm_panels)
+        .function("frame", &chopfox::wasm_frame);
+}
@@ -0,0 +1,73 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "workspace.hpp"
+#include <assert.h>
+
+namespace chopfox {
+    struct Workspace* workspace_init () {
+        struct Workspace* ws = new struct Workspace;
+
+        ws->reused = 0;
+        ws->allocated = 0;
+
+        return ws;
+    }
+
+    cv::Mat workspace_mat (struct Workspace* ws, int slot, cv::Size size, int type) {
+        if (!ws) return cv::Mat(size, type);
+
+        assert(slot >= 0);
+        if (slot >= ws->slots.size()) ws->slots.resize(slot + 1);
+
+        cv::Mat& storage = ws->slots[slot];
+        size_t bytes = (size_t)size.area() * CV_ELEM_SIZE(type);
+
+        if (storage.total() >= bytes && !storage.empty()) {
+            ws->reused++;
+        } else {
+            // A bit of slack so slightly larger panels don't grow the storage again
+            storage.create(1, (int)(bytes + bytes / 4 + 64), CV_8UC1);
+            ws->allocated++;
+        }
+
+        // Header over the storage, rows are packed
+        return cv::Mat(size, type, storage.data);
+    }
+
+    cv::Mat& workspace_slot (struct Workspace* ws, int slot) {
+        assert(ws && slot >= 0);
+        if (slot >= ws->slots.size()) ws->slots.resize(slot + 1);
+        return ws->slots[slot];
+    }
+
+    size_t workspace_retained_bytes (struct Workspace* ws) {
+        size_t bytes = 0;
+        for (auto &storage : ws->slots) bytes += storage.total() * storage.elemSize();
+        return bytes;
+    }
+
+    void workspace_clear (struct Workspace* ws) {
+        ws->slots.clear();
+    }
+
+    void workspace_free (struct Workspace* ws) {
+        if (!ws) return;
+        workspace_clear(ws);
+        delete ws;
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace chopfox {
+    /**
+     * Buffers handed out by a workspace, every stage uses its own slots
+     */
+    enum WorkspaceSlot {
+        WS_EDGE_MASK,
+        WS_COARSE,
+        WS_COARSE_MASK,
+        WS_REFINE_BAND,
+        WS_REFINE_TILES,
+        WS_REFINE_EDGES,
+        WS_CROP_MASK,
+        WS_CROP_ERODED,
+        WS_TEXT_MASK,
+        WS_TEXT_REGIONS,
+        WS_TEXT_BLOB,
+        WS_TEXT_PREFILTER_SMALL, // Frame reduced to the thumbnail size in its own channels
+        WS_TEXT_PREFILTER,
+        WS_TEXT_PREFILTER_STROKES,
+        WS_TEXT_SCALED, // Frame resized for EAST before it is split into tiles
+        WS_TEXT_CANVAS // First of the canvases of a text batch, one slot per frame
+    };
+
+    /**
+     * Scratch buffers kept between panels and pages so the intermediates of every stage aren't reallocated
+     * A workspace must only be used by one thread at a time
+     */
+    struct Workspace {
+        std::vector<cv::Mat> slots; // Storage of every slot, grows but never shrinks
+        size_t reused; // Buffers handed out from the existing storage (allocations avoided)
+        size_t allocated; // Buffers that needed new storage
+    };
+
+    /**
+     * Create a new empty workspace
+     * @returns The new workspace
+     * @remarks Free the workspace with workspace_free
+     */
+    struct Workspace* workspace_init ();
+
+    /**
+     * Get the buffer of a slot with the given size and type, reusing its storage if it is large enough
+     * The contents are left as they were, clear the buffer if needed.
+     * @param ws The workspace to take the buffer from, NULL allocates a new matrix
+     * @param slot The slot (WorkspaceSlot) the buffer is kept in
+     * @param size The size of the buffer
+     * @param type The type of the buffer
+     * @returns The buffer, only valid until the slot is used again
+     */
+    cv::Mat workspace_mat (struct Workspace* ws, int slot, cv::Size size, int type);
+
+    /**
+     * Get a slot to pass as the output of an OpenCV function which creates it (blobs, ...)
+     * The storage is reused by the function when the shape doesn't change.
+     * @param ws The workspace to take the slot from
+     * @param slot The slot (WorkspaceSlot)
+     * @returns The matrix kept in the slot
+     */
+    cv::Mat& workspace_slot (struct Workspace* ws, int slot);
+
+    /**
+     * Amount of memory held by the workspace
+     * @param ws The workspace
+     * @returns The size of the storage of all the slots in bytes
+     */
+    size_t workspace_retained_bytes (struct Workspace* ws);
+
+    /**
+     * Release the storage of all the slots, the counters are kept
+     * @param ws The workspace to clear
+     */
+    void workspace_clear (struct Workspace* ws);
+
+    /**
+     * Free a workspace and all its buffers
+     * @param ws The workspace to free
+     */
+    void workspace_free (struct Workspace* ws);
+}
+
+#endif
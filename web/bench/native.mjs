@@ -0,0 +1,198 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compares the opencv.js panel extraction (src/extract.js) with the WASM build of the native library on generated pages.
+// Needs cv/opencv_js.js and native/chopfox_native.js (chopfox-wasm), prints the same JSON layout as chopfox-bench.
+//
+// node bench/native.mjs --pages 20 --width 1654 --height 2339 --rows 3 --cols 2 --gutter 30 --chop
+
+import { createRequire } from 'module';
+import { performance } from 'perf_hooks';
+import fs from 'fs';
+
+const require = createRequire(import.meta.url);
+
+function option (name, fallback) {
+    const i = process.argv.indexOf(name);
+    return i >= 0 && i + 1 < process.argv.length ? Number(process.argv[i + 1]) : fallback;
+}
+
+const options = {
+    pages: option('--pages', 20),
+    width: option('--width', 1654),
+    height: option('--height', 2339),
+    rows: option('--rows', 3),
+    cols: option('--cols', 2),
+    gutter: option('--gutter', 30),
+    seed: option('--seed', 1),
+    chop: process.argv.includes('--chop')
+};
+
+/**
+ * Seeded generator (mulberry32), the same seed always gives the same pages
+ */
+function rng_init (seed) {
+    let state = seed >>> 0;
+    const next = () => {
+        state = (state + 0x6D2B79F5) >>> 0;
+        let t = state;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+    next.uniform = (a, b) => Math.floor(a + next() * (b - a));
+    return next;
+}
+
+/**
+ * Split length into count parts separated (and surrounded) by gutter, each part jittered by up to 15%
+ */
+function bench_split (length, count, gutter, rng) {
+    const weights = [];
+    for (let i = 0; i < count; i++) weights.push(0.85 + rng() * 0.3);
+    const total = weights.reduce((a, b) => a + b, 0);
+
+    const parts = [];
+    const available = length - (count + 1) * gutter;
+    let pos = gutter;
+    for (const weight of weights) {
+        const size = available * weight / total;
+        parts.push([Math.floor(pos), Math.floor(size)]);
+        pos += size + gutter;
+    }
+    return parts;
+}
+
+/**
+ * Generate an RGBA page with a grid of bordered panels filled with shapes
+ */
+function bench_generate_page (cv, rng) {
+    const page = new cv.Mat(options.height, options.width, cv.CV_8UC4, new cv.Scalar(255, 255, 255, 255));
+    const panels = [];
+
+    for (const [y, height] of bench_split(options.height, options.rows, options.gutter, rng)) {
+        for (const [x, width] of bench_split(options.width, options.cols, options.gutter, rng)) {
+            const panel = new cv.Rect(x, y, width, height);
+            panels.push(panel);
+
+            const art = page.roi(panel);
+            art.setTo(new cv.Scalar(rng.uniform(180, 256), rng.uniform(180, 256), rng.uniform(180, 256), 255));
+            const shapes = rng.uniform(3, 12);
+            for (let i = 0; i < shapes; i++) {
+                const center = new cv.Point(rng.uniform(0, width), rng.uniform(0, height));
+                const radius = rng.uniform(5, Math.max(6, Math.floor(Math.min(width, height) / 4)));
+                const color = new cv.Scalar(rng.uniform(0, 200), rng.uniform(0, 200), rng.uniform(0, 200), 255);
+                cv.circle(art, center, radius, color, rng.uniform(0, 2) ? cv.FILLED : rng.uniform(1, 4), cv.LINE_AA);
+            }
+            art.delete();
+
+            cv.rectangle(page, new cv.Point(x, y), new cv.Point(x + width, y + height), new cv.Scalar(0, 0, 0, 255), 3);
+        }
+    }
+
+    return { page, panels };
+}
+
+function bench_time (stages, name, items, fn) {
+    const start = performance.now();
+    const ret = fn();
+    const stage = stages[name] || (stages[name] = { ms: [], items: 0 });
+    stage.ms.push(performance.now() - start);
+    stage.items += items;
+    return ret;
+}
+
+function bench_same_boxes (a, b) {
+    const key = box => `${box.x},${box.y},${box.width},${box.height}`;
+    const keys = new Set(a.map(key));
+    return b.length === a.length && b.every(box => keys.has(key(box)));
+}
+
+async function main () {
+    const cv_factory = require('../cv/opencv_js.js');
+    globalThis.cv = await cv_factory();
+    const cv = globalThis.cv;
+
+    const { get_panels_rgb, crop_frames, free_mat_vector } = await import('../src/extract.js');
+
+    const native_path = new URL('../native/chopfox_native.js', import.meta.url);
+    if (!fs.existsSync(native_path)) {
+        console.error('Chopfox-Bench: native/chopfox_native.js is missing, build the chopfox-wasm target first');
+        process.exit(1);
+    }
+    const native = await require(native_path.pathname)();
+    const extractor = new native.Extractor();
+
+    const rng = rng_init(options.seed);
+    const stages = {};
+    let pages_agreeing = 0, panels_expected = 0, panels_js = 0, panels_native = 0;
+
+    for (let p = 0; p < options.pages; p++) {
+        const { page, panels } = bench_generate_page(cv, rng);
+        panels_expected += panels.length;
+
+        // Current JS path, every intermediate is a cv.Mat on the opencv.js heap
+        const js = bench_time(stages, 'js_panels', 1, () => get_panels_rgb(page, 0.001, 15.0));
+        if (options.chop) free_mat_vector(bench_time(stages, 'js_crop', js.length, () => crop_frames(page, js)));
+
+        // Native path, the page is written once into the module heap
+        bench_time(stages, 'native_page_copy', 1, () => extractor.page(options.width, options.height).set(page.data));
+        const layout = bench_time(stages, 'native_panels', 1, () => extractor.panels(0.001, 15.0).slice());
+        if (options.chop) {
+            bench_time(stages, 'native_crop', layout[0], () => {
+                for (let i = 0; i < layout[0]; i++) extractor.frame(i).slice();
+            });
+        }
+
+        const native_boxes = [];
+        for (let i = 0, pos = 1; i < layout[0]; i++) {
+            native_boxes.push({ x: layout[pos], y: layout[pos + 1], width: layout[pos + 2], height: layout[pos + 3] });
+            pos += 5 + layout[pos + 4] * 2;
+        }
+
+        panels_js += js.length;
+        panels_native += native_boxes.length;
+        if (bench_same_boxes(js.map(panel => panel.bounding_box), native_boxes)) pages_agreeing++;
+
+        for (const panel of js) panel.contour.delete();
+        page.delete();
+    }
+
+    extractor.delete();
+
+    const result = { config: { ...options }, stages: {}, checks: {} };
+    for (const name of Object.keys(stages).sort()) {
+        const ms = stages[name].ms.slice().sort((a, b) => a - b);
+        const total = ms.reduce((a, b) => a + b, 0);
+        const percentile = q => ms[Math.min(ms.length - 1, Math.floor(q / 100 * ms.length))];
+        result.stages[name] = {
+            samples: ms.length, items: stages[name].items, total_ms: total, mean_ms: total / ms.length,
+            p50_ms: percentile(50), p90_ms: percentile(90), p99_ms: percentile(99), max_ms: ms[ms.length - 1],
+            items_per_sec: total > 0 ? stages[name].items * 1000 / total : 0
+        };
+    }
+    result.checks.panels_expected = panels_expected;
+    result.checks.panels_js = panels_js;
+    result.checks.panels_native = panels_native;
+    result.checks.pages_agreeing = pages_agreeing / options.pages;
+
+    console.log(JSON.stringify(result, null, 2));
+
+    process.exit(0); // the pthread pool keeps node alive
+}
+
+main();
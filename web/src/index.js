@@ -16,12 +16,15 @@
  */
 import * as extract from './extract';
 import * as simple from './simple';
+import * as native from './native';
 
 if (typeof window==="object") window.chopfox = {
     ...extract,
     ...simple,
+    ...native,
     _git_commit: __COMMIT_HASH__
 };
 
 export * from './extract'
-export * from './simple'
\ No newline at end of file
+export * from './simple'
+export * from './native'
\ No newline at end of file
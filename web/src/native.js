@@ -0,0 +1,100 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+export function NativeProcessor () {}
+NativeProcessor.prototype.log_level = 0;
+NativeProcessor.prototype.panel_precision = 0.001;
+NativeProcessor.prototype.panel_min_area_divider = 15.0;
+
+/**
+ * Start a worker running the WASM build of the native library, the page never touches the main thread's opencv.js
+ * @param {string} worker_url URL of native_worker.js, chopfox_native.js & .wasm have to be next to it
+ * @param {number} log_level Value between 0-3 for logging to the console
+ * @param {number} panel_precision Used in contour appoximation
+ * @param {number} panel_min_area_divider Min area of panel calculates as min_area = (strip.width / panel_min_area_divider) * (strip.height / panel_min_area_divider)
+ * @returns {NativeProcessor} The processor, free it with native_processor_free
+ */
+export function native_processor_init (
+    worker_url = 'native_worker.js',
+    log_level = 0,
+    panel_precision = 0.001,
+    panel_min_area_divider = 15.0
+) {
+    const ret = new NativeProcessor();
+
+    ret.log_level = log_level;
+    ret.panel_precision = panel_precision;
+    ret.panel_min_area_divider = panel_min_area_divider;
+    ret.worker = new Worker(worker_url);
+    ret.pending = new Map();
+    ret.next_id = 0;
+
+    ret.worker.onmessage = (e) => {
+        const { id, error, ...data } = e.data;
+        const { resolve, reject } = ret.pending.get(id);
+        ret.pending.delete(id);
+
+        if (error) reject(new Error(error));
+        else resolve(data);
+    };
+
+    return ret;
+}
+
+/**
+ * Find the panels of a page in the worker
+ * The pixels are transferred to the worker, not copied: image_data is detached until the result comes back with it as `image`.
+ * @param {NativeProcessor} proc The processor to use
+ * @param {ImageData} image_data The page, usually from getImageData
+ * @param {boolean} chop Also crop the panels, returned as ImageData in `frames`
+ * @returns {Promise} Resolves to the panels (bounding_box & Int32Array contour of x, y pairs), the frames & the image
+ */
+export function native_process_page (
+    proc,
+    image_data,
+    chop = false
+) {
+    const id = proc.next_id++;
+    const { width, height } = image_data;
+    const pixels = image_data.data.buffer;
+
+    return new Promise((resolve, reject) => {
+        proc.pending.set(id, { resolve, reject });
+        proc.worker.postMessage({
+            id, width, height, pixels, chop,
+            precision: proc.panel_precision,
+            min_area_divider: proc.panel_min_area_divider
+        }, [pixels]);
+    }).then(({ panels, frames, pixels }) => {
+        if (proc.log_level >= 1) console.log(`[Chopfox] Found ${panels.length} panels\n`);
+
+        return {
+            panels,
+            frames: frames.map(f => new ImageData(new Uint8ClampedArray(f.data.buffer), f.width, f.height)),
+            image: new ImageData(new Uint8ClampedArray(pixels), width, height)
+        };
+    });
+}
+
+/**
+ * Stop the worker, pages still being processed are dropped
+ * @param {NativeProcessor} proc The processor to free
+ */
+export function native_processor_free (proc) {
+    proc.worker.terminate();
+    proc.pending.clear();
+}
@@ -0,0 +1,67 @@
+/**
+ *  This file is part of Chopfox.
+ *
+ *  Chopfox is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Chopfox is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with Chopfox.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Web worker running the WASM build of the native library (chopfox-wasm), loaded by native_processor_init.
+// Not bundled: it is copied next to chopfox_native.js and loads it with importScripts.
+
+importScripts('chopfox_native.js');
+
+const ready = ChopfoxNative().then(native => new native.Extractor());
+
+/**
+ * Read the panels out of the Int32Array layout returned by Extractor.panels
+ */
+function read_panels (layout) {
+    const panels = [];
+    let pos = 1;
+    for (let i = 0; i < layout[0]; i++) {
+        const [x, y, width, height, points] = layout.subarray(pos, pos + 5);
+        pos += 5;
+        panels.push({
+            bounding_box: { x, y, width, height },
+            contour: layout.slice(pos, pos + points * 2) // copied out of the WASM heap
+        });
+        pos += points * 2;
+    }
+    return panels;
+}
+
+self.onmessage = async (e) => {
+    const { id, width, height, pixels, precision, min_area_divider, chop } = e.data;
+
+    try {
+        const extractor = await ready;
+
+        extractor.page(width, height).set(new Uint8Array(pixels));
+
+        const panels = read_panels(extractor.panels(precision, min_area_divider));
+
+        const frames = [];
+        if (chop) {
+            for (let i = 0; i < panels.length; i++) {
+                const box = panels[i].bounding_box;
+                frames.push({ width: box.width, height: box.height, data: extractor.frame(i).slice() });
+            }
+        }
+
+        // The pixels go back to the caller so the page buffer can be reused
+        const transfer = [pixels, ...panels.map(p => p.contour.buffer), ...frames.map(f => f.data.buffer)];
+        self.postMessage({ id, panels, frames, pixels }, transfer);
+    } catch (err) {
+        self.postMessage({ id, error: String(err), pixels }, [pixels]);
+    }
+};
@@ -48,7 +48,9 @@ module.exports = (env, argv) => {
         new CopyPlugin({
             patterns: [
                 { from: './cv/opencv_js.wasm', to: '.' },
-                { from: './cv/opencv_js.js', to: '.' }
+                { from: './cv/opencv_js.js', to: '.' },
+                { from: './src/native_worker.js', to: '.' },
+                { from: './native', to: '.', noErrorOnMissing: true } // chopfox-wasm output, see README
             ]
         }),
         new webpack.ProgressPlugin(),